@@ -64,6 +64,13 @@ namespace agg_util
     return _location;
   }
 
+  /* virtual */
+  void
+  AggMemberDataset::releaseDDS()
+  {
+    // nothing to release by default
+  }
+
   AggMemberDataset&
   AggMemberDataset::operator=(const AggMemberDataset& rhs)
   {
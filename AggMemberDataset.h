@@ -82,10 +82,14 @@ public:
      */
     virtual const libdap::DDS* getDDS() = 0;
 
-    // TODO Consider adding freeDDS() or equivalent
-    // to clear the memory made by getDDS if it was
-    // loaded so we can tighten up the memory usage
-    // for large AMD Lists.
+    /**
+     * Free the DDS made by getDDS() if this object loaded it, so that
+     * walking a large AMDList doesn't keep every granule in memory.
+     * A later getDDS() will load it again.  Any DDS ptr gotten from
+     * getDDS() is invalid after this call.
+     * Default does nothing, for subclasses that don't own their DDS.
+     */
+    virtual void releaseDDS();
 
     /**
      * Get the size of the given dimension named dimName
@@ -125,6 +129,12 @@ public:
      */
     virtual void setDimensionCacheFor(const Dimension& dim, bool throwIfFound) = 0;
 
+    /**
+     * Append a copy of every dimension currently in the dimension
+     * cache to dims, in the order they were added.
+     */
+    virtual void getCachedDimensions(std::vector<Dimension>& dims) const = 0;
+
     /**
      * Uses the getDDS() call in order to find all named dimensions
      * within it and to seed them into the dimension cache table for
@@ -7,10 +7,19 @@
 
 #include "AggMemberDatasetDimensionCache.h"
 #include "AggMemberDataset.h"
+#include "GranuleReadAhead.h"
+#include "LoadedGranuleLRU.h"
 #include <string>
 #include <fstream>
 #include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include "util.h"
 #include "BESInternalError.h"
@@ -30,6 +39,29 @@ AggMemberDatasetDimensionCache *AggMemberDatasetDimensionCache::d_instance = 0;
 const string AggMemberDatasetDimensionCache::CACHE_DIR_KEY = "NCML.DimensionCache.directory";
 const string AggMemberDatasetDimensionCache::PREFIX_KEY    = "NCML.DimensionCache.prefix";
 const string AggMemberDatasetDimensionCache::SIZE_KEY      = "NCML.DimensionCache.size";
+const string AggMemberDatasetDimensionCache::MEMORY_ENTRIES_KEY = "NCML.DimensionCache.memoryEntries";
+const string AggMemberDatasetDimensionCache::STORAGE_KEY = "NCML.DimensionCache.storage";
+
+// Binary aggregation index file layout (native byte order, it never leaves the host):
+//   char[8] INDEX_MAGIC
+//   uint32  INDEX_VERSION
+//   uint32  INDEX_BYTE_ORDER, as written by this host
+//   uint32  granule count
+//   per granule:
+//     uint32 record size in bytes, not counting this field
+//     uint32 location length, location bytes
+//     int64  source dataset mtime
+//     uint32 dimension count
+//     per dimension: uint32 name length, name bytes, uint32 size
+// A file with another version or byte order, or a record that doesn't decode
+// to exactly its recorded size, is ignored and rewritten.
+static const char INDEX_MAGIC[8] = { 'N', 'C', 'M', 'L', 'D', 'I', 'D', 'X' };
+static const uint32_t INDEX_VERSION = 2;
+static const uint32_t INDEX_BYTE_ORDER = 0x01020304;
+static const string INDEX_FILE_SUFFIX = ".dimidx";
+
+// Default number of datasets held in the in-process layer
+static const unsigned long DEFAULT_MEMORY_ENTRIES = 50000;
 // const string AggMemberDatasetDimensionCache::CACHE_CONTROL_FILE  = "ncmlAggDimensions.cache.info";
 
 /**
@@ -54,6 +86,37 @@ unsigned long AggMemberDatasetDimensionCache::getCacheSizeFromConfig(){
     return size_in_megabytes;
 }
 
+/**
+ * Checks TheBESKeys for the AggMemberDatasetDimensionCache::MEMORY_ENTRIES_KEY
+ * Returns the value if found, DEFAULT_MEMORY_ENTRIES otherwise. Zero turns the
+ * in-process layer off.
+ */
+unsigned long AggMemberDatasetDimensionCache::getMemoryEntriesFromConfig(){
+
+	bool found;
+    string value;
+    unsigned long entries = DEFAULT_MEMORY_ENTRIES;
+    TheBESKeys::TheKeys()->get_value( MEMORY_ENTRIES_KEY, value, found ) ;
+    if( found ) {
+    	std::istringstream iss(value);
+    	iss >> entries;
+    	if (iss.fail())
+    		entries = DEFAULT_MEMORY_ENTRIES;
+    }
+    return entries;
+}
+
+/**
+ * Checks TheBESKeys for the AggMemberDatasetDimensionCache::STORAGE_KEY
+ * Returns true if it is "index", false (the per-granule files) otherwise.
+ */
+bool AggMemberDatasetDimensionCache::getUseAggregationIndexFromConfig(){
+	bool found;
+    string value;
+    TheBESKeys::TheKeys()->get_value( STORAGE_KEY, value, found ) ;
+    return found && BESUtil::lowercase(value) == "index";
+}
+
 /**
  * Checks TheBESKeys for the AggMemberDatasetDimensionCache::CACHE_DIR_KEY
  * Returns the value if found, throws an exception otherwise.
@@ -120,6 +183,8 @@ string AggMemberDatasetDimensionCache::getBesDataRootDirFromConfig(){
  * Builds a instance of the cache object using the values found in TheBESKeys
  */
 AggMemberDatasetDimensionCache::AggMemberDatasetDimensionCache()
+	: d_maxMemoryEntries(getMemoryEntriesFromConfig()), d_memoryHits(0), d_memoryMisses(0),
+	  d_useAggregationIndex(getUseAggregationIndexFromConfig())
 {
 	BESDEBUG("cache", "AggMemberDatasetDimensionCache::AggMemberDatasetDimensionCache() -  BEGIN" << endl);
 
@@ -141,7 +206,10 @@ AggMemberDatasetDimensionCache::AggMemberDatasetDimensionCache()
 /**
  * Builds a instance of the cache object using the values passed in.
  */
-AggMemberDatasetDimensionCache::AggMemberDatasetDimensionCache(const string &data_root_dir, const string &cache_dir, const string &prefix, unsigned long long size){
+AggMemberDatasetDimensionCache::AggMemberDatasetDimensionCache(const string &data_root_dir, const string &cache_dir, const string &prefix, unsigned long long size)
+	: d_maxMemoryEntries(DEFAULT_MEMORY_ENTRIES), d_memoryHits(0), d_memoryMisses(0),
+	  d_useAggregationIndex(false)
+{
 
 	BESDEBUG("cache", "AggMemberDatasetDimensionCache::AggMemberDatasetDimensionCache() -  BEGIN" << endl);
 
@@ -217,7 +285,73 @@ void AggMemberDatasetDimensionCache::delete_instance() {
 
 AggMemberDatasetDimensionCache::~AggMemberDatasetDimensionCache()
 {
-	// Nothing to do here....
+	BESDEBUG("cache", "AggMemberDatasetDimensionCache - in-process layer hits: " << d_memoryHits << " misses: " << d_memoryMisses << endl);
+	d_memoryCache.clear();
+}
+
+/**
+ * @return The LMT of the source dataset for local_id, or 0 if it isn't a
+ * file we can stat (which, like is_valid(), we treat as never changing).
+ */
+time_t AggMemberDatasetDimensionCache::getDatasetTime(const string &local_id)
+{
+	string datasetFileName = BESUtil::assemblePath(d_dataRootDir, local_id, true);
+    struct stat buf;
+    if (stat(datasetFileName.c_str(), &buf) == 0)
+    	return buf.st_mtime;
+    return 0;
+}
+
+/**
+ * If the in-process layer has the dimensions for amd and the source dataset
+ * hasn't changed since they were stored, load them into amd.
+ * @return true if amd was loaded, false on a miss.
+ */
+bool AggMemberDatasetDimensionCache::loadFromMemoryCache(AggMemberDataset *amd, time_t dataset_time)
+{
+	MemoryCache::iterator it = d_memoryCache.find(amd->getLocation());
+	if (it == d_memoryCache.end())
+		return false;
+
+	if (it->second.datasetTime != dataset_time) {
+		BESDEBUG("cache", "AggMemberDatasetDimensionCache - in-process entry is stale for " << amd->getLocation() << endl);
+		d_memoryCache.erase(it);
+		return false;
+	}
+
+	setDimensions(amd, it->second.dimensions);
+	return true;
+}
+
+/**
+ * Replace the dimension cache of amd with dims.
+ */
+void AggMemberDatasetDimensionCache::setDimensions(AggMemberDataset *amd, const std::vector<Dimension> &dims)
+{
+	amd->flushDimensionCache();
+	for (std::vector<Dimension>::const_iterator dimIt = dims.begin(); dimIt != dims.end(); ++dimIt)
+		amd->setDimensionCacheFor(*dimIt, false);
+}
+
+/**
+ * Remember the dimensions now in amd's dimension cache.
+ */
+void AggMemberDatasetDimensionCache::saveToMemoryCache(AggMemberDataset *amd, time_t dataset_time)
+{
+	if (d_maxMemoryEntries == 0)
+		return;
+
+	MemoryCache::iterator it = d_memoryCache.find(amd->getLocation());
+	if (it == d_memoryCache.end()) {
+		// Keep it bounded. We don't track use order, any entry will do.
+		if (d_memoryCache.size() >= d_maxMemoryEntries)
+			d_memoryCache.erase(d_memoryCache.begin());
+		it = d_memoryCache.insert(std::make_pair(amd->getLocation(), MemoryCacheEntry())).first;
+	}
+
+	it->second.datasetTime = dataset_time;
+	it->second.dimensions.clear();
+	amd->getCachedDimensions(it->second.dimensions);
 }
 
 /**
@@ -270,33 +404,44 @@ bool AggMemberDatasetDimensionCache::is_valid(const string &cache_file_name, con
 
 
 /**
- * Loads the dimensions of the passed  AggMemberDataset. If the dimensions are in the cache, and the cache file
- * is valid (length>0 and LMT < the LMT of the source dataset file) then the dimensions will be read from the
- * cache file. Otherwise the source data file will be used to build a DDS from which the dimension can be extracted
- * and subsequently cached.
+ * Try to load the dimensions of amd from the in-process layer or from its cache
+ * file. The cache file is valid if its length>0 and it is not older than the
+ * source dataset file; an invalid file is purged.
+ *
+ * @return true if amd was loaded, false if its dimensions have to be read from
+ * the source dataset.
  */
-void AggMemberDatasetDimensionCache::loadDimensionCache(AggMemberDataset *amd){
-    BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadDimensionCache() - BEGIN" << endl );
+bool AggMemberDatasetDimensionCache::loadCachedDimensions(AggMemberDataset *amd, time_t dataset_time)
+{
+    string local_id = amd->getLocation();
+
+    // Repeat requests in this process don't need to touch the cache files at all.
+    if (d_maxMemoryEntries > 0 && loadFromMemoryCache(amd, dataset_time)) {
+    	++d_memoryHits;
+        BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadCachedDimensions() - in-process hit, local_id=`"<< local_id << "'" << endl );
+    	return true;
+    }
+    ++d_memoryMisses;
 
     // Get the cache filename for this thing, mangle name.
-    string local_id = amd->getLocation();
-    BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadDimensionCache() - local resource id: "<< local_id << endl );
+    BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadCachedDimensions() - local resource id: "<< local_id << endl );
     string cache_file_name = get_cache_file_name(local_id, true);
-    BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadDimensionCache() - cache_file_name: "<< cache_file_name << endl );
+    BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadCachedDimensions() - cache_file_name: "<< cache_file_name << endl );
 
     int fd;
+    bool found = false;
     try {
         // If the object in the cache is not valid, remove it. The read_lock will
-        // then fail and the code will drop down to the create_and_lock() call.
+        // then fail and the caller will have to build the dimensions from the DDS.
         // is_valid() tests for a non-zero length cache file (cache_file_name) and
     	// for the source data file (local_id) with a newer LMT than the cache file.
         if (!is_valid(cache_file_name, local_id)){
-            BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadDimensionCache() - File is not valid. Purging file from cache. filename: " << cache_file_name << endl);
+            BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadCachedDimensions() - File is not valid. Purging file from cache. filename: " << cache_file_name << endl);
         	purge_file(cache_file_name);
         }
 
         if (get_read_lock(cache_file_name, fd)) {
-            BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadDimensionCache() - Dimension cache file exists. Loading dimension cache from file: " << cache_file_name << endl);
+            BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadCachedDimensions() - Dimension cache file exists. Loading dimension cache from file: " << cache_file_name << endl);
 
             ifstream istrm(cache_file_name.c_str());
             if (!istrm)
@@ -306,77 +451,449 @@ void AggMemberDatasetDimensionCache::loadDimensionCache(AggMemberDataset *amd){
 
             istrm.close();
 
-
-        }
-        else {
-			// If here, the cache_file_name could not be locked for read access, or it was out of date.
-        	// So we are going to (re)build the cache file.
-
-        	// We need to build the DDS object and extract the dimensions.
-        	// We do not lock before this operation because it may take a _long_ time and
-        	// we don't want to monopolize the cache while we do it.
-        	amd->fillDimensionCacheByUsingDDS();
-
-        	// Now, we try to make an empty cache file and get an exclusive lock on it.
-        	if (create_and_lock(cache_file_name, fd)) {
-        		// Woohoo! We got the exclusive lock on the new cache file.
-				BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadDimensionCache() - Created and locked cache file: " << cache_file_name << endl);
-
-				// Now we open it (again) using the more friendly ostream API.
-				ofstream ostrm(cache_file_name.c_str());
-				if (!ostrm)
-					throw libdap::InternalErr(__FILE__, __LINE__, "Could not open '" + cache_file_name + "' to write cached response.");
-
-				// Save the dimensions to the cache file.
-				amd->saveDimensionCache(ostrm);
-
-		        // And close the cache file;s ostream.
-				ostrm.close();
-
-				// Change the exclusive lock on the new file to a shared lock. This keeps
-				// other processes from purging the new file and ensures that the reading
-				// process can use it.
-				exclusive_to_shared_lock(fd);
-
-				// Now update the total cache size info and purge if needed. The new file's
-				// name is passed into the purge method because this process cannot detect its
-				// own lock on the file.
-				unsigned long long size = update_cache_info(cache_file_name);
-				if (cache_too_big(size))
-					update_and_purge(cache_file_name);
-			}
-			// get_read_lock() returns immediately if the file does not exist,
-			// but blocks waiting to get a shared lock if the file does exist.
-			else if (get_read_lock(cache_file_name, fd)) {
-				// If we got here then someone else rebuilt the cache file before we could do it.
-				// That's OK, and since we already built the DDS we have all of the cache info in memory
-				// from directly accessing the source dataset(s), so we need to do nothing more,
-				// Except send a debug statement so we can see that this happened.
-				BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadDimensionCache() - Couldn't create and lock cache file, But I got a read lock. "
-						"Cache file may have been rebuilt by another process. "
-						"Cache file: " << cache_file_name << endl);
-			}
-			else {
-				throw libdap::InternalErr(__FILE__, __LINE__, "AggMemberDatasetDimensionCache::loadDimensionCache() - Cache error during function invocation.");
-			}
+            unlock_and_close(cache_file_name);
+            found = true;
         }
+    }
+    catch (...) {
+        BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadCachedDimensions() - caught exception, unlocking cache and re-throw." << endl );
+        unlock_cache();
+        throw;
+    }
+
+    if (found)
+    	saveToMemoryCache(amd, dataset_time);
+
+    return found;
+}
+
+/**
+ * Write the dimensions of amd, which were just read from its source dataset,
+ * to its cache file and to the in-process layer.
+ */
+void AggMemberDatasetDimensionCache::saveDimensionCache(AggMemberDataset *amd, time_t dataset_time)
+{
+    string cache_file_name = get_cache_file_name(amd->getLocation(), true);
 
-        BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadDimensionCache() - unlocking and closing cache file "<< cache_file_name  << endl );
+    int fd;
+    try {
+    	// Now, we try to make an empty cache file and get an exclusive lock on it.
+    	if (create_and_lock(cache_file_name, fd)) {
+    		// Woohoo! We got the exclusive lock on the new cache file.
+			BESDEBUG("cache", "AggMemberDatasetDimensionCache::saveDimensionCache() - Created and locked cache file: " << cache_file_name << endl);
+
+			// Now we open it (again) using the more friendly ostream API.
+			ofstream ostrm(cache_file_name.c_str());
+			if (!ostrm)
+				throw libdap::InternalErr(__FILE__, __LINE__, "Could not open '" + cache_file_name + "' to write cached response.");
+
+			// Save the dimensions to the cache file.
+			amd->saveDimensionCache(ostrm);
+
+	        // And close the cache file;s ostream.
+			ostrm.close();
+
+			// Change the exclusive lock on the new file to a shared lock. This keeps
+			// other processes from purging the new file and ensures that the reading
+			// process can use it.
+			exclusive_to_shared_lock(fd);
+
+			// Now update the total cache size info and purge if needed. The new file's
+			// name is passed into the purge method because this process cannot detect its
+			// own lock on the file.
+			unsigned long long size = update_cache_info(cache_file_name);
+			if (cache_too_big(size))
+				update_and_purge(cache_file_name);
+		}
+		// get_read_lock() returns immediately if the file does not exist,
+		// but blocks waiting to get a shared lock if the file does exist.
+		else if (get_read_lock(cache_file_name, fd)) {
+			// If we got here then someone else rebuilt the cache file before we could do it.
+			// That's OK, and since we already built the DDS we have all of the cache info in memory
+			// from directly accessing the source dataset(s), so we need to do nothing more,
+			// Except send a debug statement so we can see that this happened.
+			BESDEBUG("cache", "AggMemberDatasetDimensionCache::saveDimensionCache() - Couldn't create and lock cache file, But I got a read lock. "
+					"Cache file may have been rebuilt by another process. "
+					"Cache file: " << cache_file_name << endl);
+		}
+		else {
+			throw libdap::InternalErr(__FILE__, __LINE__, "AggMemberDatasetDimensionCache::saveDimensionCache() - Cache error during function invocation.");
+		}
+
+        BESDEBUG("cache", "AggMemberDatasetDimensionCache::saveDimensionCache() - unlocking and closing cache file "<< cache_file_name  << endl );
 		unlock_and_close(cache_file_name);
     }
     catch (...) {
-        BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadDimensionCache() - caught exception, unlocking cache and re-throw." << endl );
+        BESDEBUG("cache", "AggMemberDatasetDimensionCache::saveDimensionCache() - caught exception, unlocking cache and re-throw." << endl );
         unlock_cache();
         throw;
     }
 
+    saveToMemoryCache(amd, dataset_time);
+}
+
+/**
+ * Fill the granules listed in misses (indices into granules, ascending) from
+ * their DDS, in that order, with a GranuleReadAhead pool paging in the
+ * start of the upcoming granule files while the current one is being built (see
+ * GranuleReadAhead.h for why the builds themselves stay on this thread).
+ *
+ * @param save_cache_files If true each granule is written to its own cache
+ * file, otherwise only to the in-process layer.
+ */
+void AggMemberDatasetDimensionCache::fillDimensionCacheMisses(const AMDList &granules,
+		const std::vector<unsigned int> &misses, const std::vector<time_t> &dataset_times, bool save_cache_files)
+{
+	if (misses.empty())
+		return;
+
+	BESDEBUG("cache", "AggMemberDatasetDimensionCache::fillDimensionCacheMisses() - Filling " << misses.size() << " of " << granules.size() << " granules from their DDS." << endl);
+
+	std::vector<string> missLocations;
+	unsigned int readThreads = GranuleReadAhead::getReadThreadsFromConfig();
+	if (readThreads > 0) {
+		missLocations.reserve(misses.size());
+		for (unsigned int k = 0; k < misses.size(); ++k)
+			missLocations.push_back(granules[misses[k]]->getLocation());
+	}
+	// Building a DDS only reads the file's metadata, so only page in the head of each file.
+	GranuleReadAhead readAhead(missLocations, readThreads, GranuleReadAhead::getReadAheadBytesFromConfig(),
+			GranuleReadAhead::HEADER_PREFETCH_BYTES);
+
+    // Filling a miss loads the granule's DDS, don't keep them all around.
+    LoadedGranuleLRU loadedGranules(LoadedGranuleLRU::getMaxLoadedGranulesFromConfig());
+
+	for (unsigned int k = 0; k < misses.size(); ++k) {
+		AggMemberDataset *amd = granules[misses[k]].get();
+		loadedGranules.touch(*amd);
+		amd->fillDimensionCacheByUsingDDS();
+		readAhead.setConsumed(k);
+
+		if (save_cache_files)
+			saveDimensionCache(amd, dataset_times[misses[k]]);
+		else
+			saveToMemoryCache(amd, dataset_times[misses[k]]);
+	}
+}
+
+/**
+ * Loads the dimensions of the passed  AggMemberDataset. If the dimensions are in the cache, and the cache file
+ * is valid (length>0 and LMT < the LMT of the source dataset file) then the dimensions will be read from the
+ * cache file. Otherwise the source data file will be used to build a DDS from which the dimension can be extracted
+ * and subsequently cached.
+ */
+void AggMemberDatasetDimensionCache::loadDimensionCache(AggMemberDataset *amd){
+    BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadDimensionCache() - BEGIN" << endl );
+
+    string local_id = amd->getLocation();
+    time_t dataset_time = getDatasetTime(local_id);
+    if (!loadCachedDimensions(amd, dataset_time)) {
+    	// We need to build the DDS object and extract the dimensions.
+    	// We do not lock before this operation because it may take a _long_ time and
+    	// we don't want to monopolize the cache while we do it.
+    	amd->fillDimensionCacheByUsingDDS();
+    	saveDimensionCache(amd, dataset_time);
+    }
+
     BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadDimensionCache() - END (local_id=`"<< local_id << "')" << endl );
+}
+
+/**
+ * Loads the dimensions of all the granules of an aggregation. Cache hits are
+ * resolved first; the misses are then filled together, in granule order, so
+ * a cold cache reads the granule files with read-ahead instead of strictly
+ * one after another.
+ */
+void AggMemberDatasetDimensionCache::loadDimensionCache(const AMDList &granules)
+{
+    BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadDimensionCache() - BEGIN (" << granules.size() << " granules)" << endl );
+
+    std::vector<time_t> dataset_times(granules.size());
+    std::vector<unsigned int> misses;
+    for (unsigned int i = 0; i < granules.size(); ++i) {
+    	dataset_times[i] = getDatasetTime(granules[i]->getLocation());
+    	if (!loadCachedDimensions(granules[i].get(), dataset_times[i]))
+    		misses.push_back(i);
+    }
+
+    fillDimensionCacheMisses(granules, misses, dataset_times, true);
+
+    BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadDimensionCache() - END (" << misses.size() << " misses)" << endl );
+}
+
+/**
+ * @return The name of the binary index file for the aggregation identified by
+ * aggregation_id. It lives in the dimension cache directory next to the
+ * per-granule files.
+ */
+string AggMemberDatasetDimensionCache::getIndexFileName(const string &aggregation_id)
+{
+	return get_cache_file_name(aggregation_id + INDEX_FILE_SUFFIX, true);
+}
+
+namespace {
+	// Bounds checked cursor over the mapped index file.
+	class IndexReader {
+	public:
+		IndexReader(const char *data, size_t size) : d_pos(data), d_end(data + size) {}
+
+		bool read(void *dest, size_t n) {
+			if (static_cast<size_t>(d_end - d_pos) < n)
+				return false;
+			memcpy(dest, d_pos, n);
+			d_pos += n;
+			return true;
+		}
+
+		bool readString(string &dest) {
+			uint32_t len;
+			if (!read(&len, sizeof(len)) || static_cast<size_t>(d_end - d_pos) < len)
+				return false;
+			dest.assign(d_pos, len);
+			d_pos += len;
+			return true;
+		}
+
+		const char *pos() const { return d_pos; }
+
+	private:
+		const char *d_pos;
+		const char *d_end;
+	};
+
+	template <typename T>
+	void writeValue(string &buf, T value) {
+		buf.append(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+
+	void writeString(string &buf, const string &s) {
+		writeValue<uint32_t>(buf, s.size());
+		buf.append(s);
+	}
 
+	bool writeFully(int fd, const char *data, size_t n) {
+		while (n > 0) {
+			ssize_t written = write(fd, data, n);
+			if (written < 0) {
+				if (errno == EINTR)
+					continue;
+				return false;
+			}
+			data += written;
+			n -= written;
+		}
+		return true;
+	}
 }
 
+/**
+ * Map the index file and decode it into entries. The whole file is read with a
+ * single mmap() rather than one open/read/parse per granule. Like the
+ * per-granule files it is read under a shared cache lock, so it can't be
+ * purged or rewritten while we look at it.
+ *
+ * @return false if the file is missing or isn't a well formed index. Entries
+ * decoded before a bad record are still returned.
+ */
+bool AggMemberDatasetDimensionCache::readIndexFile(const string &index_file_name, MemoryCache &entries)
+{
+	int fd;
+	bool ok = false;
+	try {
+		// get_read_lock() returns false right away if there's no such file.
+		if (!get_read_lock(index_file_name, fd))
+			return false;
+
+		struct stat buf;
+		void *data = MAP_FAILED;
+		size_t size = 0;
+		if (fstat(fd, &buf) == 0 && buf.st_size > 0) {
+			size = buf.st_size;
+			data = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		}
 
+		if (data != MAP_FAILED) {
+			IndexReader reader(static_cast<const char*>(data), size);
+			char magic[sizeof(INDEX_MAGIC)];
+			uint32_t version, byteOrder, numGranules;
+			if (reader.read(magic, sizeof(magic)) && memcmp(magic, INDEX_MAGIC, sizeof(magic)) == 0
+					&& reader.read(&version, sizeof(version)) && version == INDEX_VERSION
+					&& reader.read(&byteOrder, sizeof(byteOrder)) && byteOrder == INDEX_BYTE_ORDER
+					&& reader.read(&numGranules, sizeof(numGranules))) {
+				ok = true;
+				for (uint32_t i = 0; ok && i < numGranules; ++i) {
+					uint32_t recordSize;
+					string location;
+					int64_t mtime;
+					uint32_t numDims;
+					ok = reader.read(&recordSize, sizeof(recordSize));
+					const char *recordStart = reader.pos();
+					ok = ok && reader.readString(location) && reader.read(&mtime, sizeof(mtime))
+							&& reader.read(&numDims, sizeof(numDims));
+
+					MemoryCacheEntry entry;
+					entry.datasetTime = static_cast<time_t>(mtime);
+					for (uint32_t d = 0; ok && d < numDims; ++d) {
+						string name;
+						uint32_t dimSize;
+						ok = reader.readString(name) && reader.read(&dimSize, sizeof(dimSize));
+						if (ok)
+							entry.dimensions.push_back(Dimension(name, dimSize));
+					}
+
+					ok = ok && static_cast<uint32_t>(reader.pos() - recordStart) == recordSize;
+					if (ok)
+						entries[location] = entry;
+				}
+			}
 
+			munmap(data, size);
+		}
 
+		unlock_and_close(index_file_name);
+	}
+	catch (...) {
+		BESDEBUG("cache", "AggMemberDatasetDimensionCache::readIndexFile() - caught exception, unlocking cache and re-throw." << endl );
+		unlock_cache();
+		throw;
+	}
+
+	if (!ok)
+		BESDEBUG("cache", "AggMemberDatasetDimensionCache::readIndexFile() - Ignoring malformed index file: " << index_file_name << endl);
+
+	return ok;
+}
+
+/**
+ * Write the dimensions of all the granules to index_file_name. The old file is
+ * purged (which waits for its readers) and the new one is created and written
+ * under an exclusive cache lock, then counted in the cache size like the
+ * per-granule files. If another process recreates the file first we leave
+ * theirs in place.
+ */
+void AggMemberDatasetDimensionCache::writeIndexFile(const string &index_file_name, const AMDList &granules,
+		const std::vector<time_t> &dataset_times)
+{
+	string buf(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	writeValue<uint32_t>(buf, INDEX_VERSION);
+	writeValue<uint32_t>(buf, INDEX_BYTE_ORDER);
+	writeValue<uint32_t>(buf, granules.size());
+
+	std::vector<Dimension> dims;
+	string record;
+	for (unsigned int i = 0; i < granules.size(); ++i) {
+		record.clear();
+		writeString(record, granules[i]->getLocation());
+		writeValue<int64_t>(record, dataset_times[i]);
+
+		dims.clear();
+		granules[i]->getCachedDimensions(dims);
+		writeValue<uint32_t>(record, dims.size());
+		for (std::vector<Dimension>::const_iterator it = dims.begin(); it != dims.end(); ++it) {
+			writeString(record, it->name);
+			writeValue<uint32_t>(record, it->size);
+		}
+
+		writeValue<uint32_t>(buf, record.size());
+		buf.append(record);
+	}
+
+	int fd;
+	try {
+		purge_file(index_file_name);
+
+		if (create_and_lock(index_file_name, fd)) {
+			if (!writeFully(fd, buf.data(), buf.size())) {
+				// A short file fails the checks in readIndexFile() and gets rewritten.
+				BESDEBUG("cache", "AggMemberDatasetDimensionCache::writeIndexFile() - Failed to write " << index_file_name << ": " << strerror(errno) << endl);
+			}
+
+			// Same dance as saveDimensionCache().
+			exclusive_to_shared_lock(fd);
+			unsigned long long size = update_cache_info(index_file_name);
+			if (cache_too_big(size))
+				update_and_purge(index_file_name);
+			unlock_and_close(index_file_name);
+		}
+		else {
+			BESDEBUG("cache", "AggMemberDatasetDimensionCache::writeIndexFile() - " << index_file_name << " was recreated by another process, index not updated." << endl);
+		}
+	}
+	catch (...) {
+		BESDEBUG("cache", "AggMemberDatasetDimensionCache::writeIndexFile() - caught exception, unlocking cache and re-throw." << endl );
+		unlock_cache();
+		throw;
+	}
+}
+
+/**
+ * Load the dimensions of all the granules of one aggregation from a single
+ * binary index file rather than one cache file per granule. Granules that
+ * are missing from the index, or whose source dataset changed since it was
+ * written, are filled by loading their DDS and the index is rewritten.
+ *
+ * @param aggregation_id Names the aggregation; the NcML file and the join
+ * dimension are enough to keep indexes of different aggregations apart.
+ * @param granules The aggregation's datasets, in aggregation order.
+ */
+void AggMemberDatasetDimensionCache::loadDimensionIndex(const string &aggregation_id, const AMDList &granules)
+{
+    BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadDimensionIndex() - BEGIN (" << aggregation_id << ")" << endl );
+
+    std::vector<time_t> dataset_times(granules.size());
+    for (unsigned int i = 0; i < granules.size(); ++i)
+    	dataset_times[i] = getDatasetTime(granules[i]->getLocation());
+
+    // When every granule is in the in-process layer there's no need to look at the file.
+    unsigned int numMemoryHits = 0;
+    if (d_maxMemoryEntries > 0) {
+    	for (unsigned int i = 0; i < granules.size() && loadFromMemoryCache(granules[i].get(), dataset_times[i]); ++i)
+    		++numMemoryHits;
+    }
+    if (numMemoryHits == granules.size()) {
+    	d_memoryHits += numMemoryHits;
+        BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadDimensionIndex() - END (in-process hit)" << endl );
+    	return;
+    }
+
+    string index_file_name = getIndexFileName(aggregation_id);
+    MemoryCache index;
+    bool dirty = !readIndexFile(index_file_name, index) || index.size() != granules.size();
+
+    std::vector<unsigned int> misses;
+    for (unsigned int i = 0; i < granules.size(); ++i) {
+    	AggMemberDataset *amd = granules[i].get();
+    	if (i < numMemoryHits) {
+    		++d_memoryHits;
+    		continue;
+    	}
+    	++d_memoryMisses;
+
+    	MemoryCache::const_iterator it = index.find(amd->getLocation());
+    	if (it != index.end() && it->second.datasetTime == dataset_times[i]) {
+    		setDimensions(amd, it->second.dimensions);
+    	}
+    	else {
+    		BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadDimensionIndex() - No valid index entry for " << amd->getLocation() << endl);
+    		dirty = true;
+    		if (!loadFromMemoryCache(amd, dataset_times[i])) {
+    			misses.push_back(i);
+    			continue;
+    		}
+    	}
+
+    	saveToMemoryCache(amd, dataset_times[i]);
+    }
+
+    fillDimensionCacheMisses(granules, misses, dataset_times, false);
+
+    if (dirty) {
+        BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadDimensionIndex() - Rewriting index file: " << index_file_name << endl);
+    	writeIndexFile(index_file_name, granules, dataset_times);
+    }
+
+    BESDEBUG("cache", "AggMemberDatasetDimensionCache::loadDimensionIndex() - END (" << aggregation_id << ")" << endl );
+}
 
 
 } /* namespace agg_util */
@@ -8,7 +8,14 @@
 #ifndef MODULES_NCML_MODULE_AGGMEMBERDATASETDIMENSIONCACHE_H_
 #define MODULES_NCML_MODULE_AGGMEMBERDATASETDIMENSIONCACHE_H_
 
+#include <map>
+#include <string>
+#include <vector>
+#include <time.h>
+
 #include "BESFileLockingCache.h"
+#include "AggMemberDataset.h"
+#include "Dimension.h"
 
 namespace agg_util
 {
@@ -40,16 +47,49 @@ private:
     string d_dimCacheFilePrefix;
     unsigned long d_maxCacheSize;
 
+    // In-process layer in front of the cache files, keyed by dataset location.
+    // An entry is good as long as the source dataset's mtime hasn't changed.
+    struct MemoryCacheEntry {
+        time_t datasetTime;
+        std::vector<Dimension> dimensions;
+    };
+    typedef std::map<std::string, MemoryCacheEntry> MemoryCache;
+
+    MemoryCache d_memoryCache;
+    unsigned long d_maxMemoryEntries;
+    unsigned long long d_memoryHits;
+    unsigned long long d_memoryMisses;
+
+    // If true, joinExisting aggregations keep all their granules' dimensions
+    // in one binary index file instead of one text file per granule.
+    bool d_useAggregationIndex;
+
 	AggMemberDatasetDimensionCache();
 	AggMemberDatasetDimensionCache(const AggMemberDatasetDimensionCache &src);
 
 	bool is_valid(const std::string &cache_file_name, const std::string &dataset_file_name);
 
+	time_t getDatasetTime(const std::string &local_id);
+	bool loadFromMemoryCache(AggMemberDataset *amd, time_t dataset_time);
+	bool loadCachedDimensions(AggMemberDataset *amd, time_t dataset_time);
+	void saveDimensionCache(AggMemberDataset *amd, time_t dataset_time);
+	void fillDimensionCacheMisses(const AMDList &granules, const std::vector<unsigned int> &misses,
+			const std::vector<time_t> &dataset_times, bool save_cache_files);
+	void saveToMemoryCache(AggMemberDataset *amd, time_t dataset_time);
+
+	static void setDimensions(AggMemberDataset *amd, const std::vector<Dimension> &dims);
+
+	string getIndexFileName(const string &aggregation_id);
+	bool readIndexFile(const string &index_file_name, MemoryCache &entries);
+	void writeIndexFile(const string &index_file_name, const AMDList &granules, const std::vector<time_t> &dataset_times);
+
 
     static string getBesDataRootDirFromConfig();
     static string getCacheDirFromConfig();
     static string getDimCachePrefixFromConfig();
     static unsigned long getCacheSizeFromConfig();
+    static unsigned long getMemoryEntriesFromConfig();
+    static bool getUseAggregationIndexFromConfig();
 
 
 protected:
@@ -60,12 +100,26 @@ public:
 	static const string CACHE_DIR_KEY;
 	static const string PREFIX_KEY;
 	static const string SIZE_KEY;
+	static const string MEMORY_ENTRIES_KEY;
+	static const string STORAGE_KEY;
 	 // static const string CACHE_CONTROL_FILE;
 
     static AggMemberDatasetDimensionCache *get_instance(const string &bes_catalog_root_dir, const string &stored_results_subdir, const string &prefix, unsigned long long size);
     static AggMemberDatasetDimensionCache *get_instance();
 
     void loadDimensionCache(AggMemberDataset *amd);
+    void loadDimensionCache(const AMDList &granules);
+
+    /** @return true if STORAGE_KEY asks for one index file per aggregation */
+    bool useAggregationIndex() const { return d_useAggregationIndex; }
+
+    void loadDimensionIndex(const string &aggregation_id, const AMDList &granules);
+
+    /** Number of loadDimensionCache() calls answered from the in-process layer */
+    unsigned long long getMemoryCacheHits() const { return d_memoryHits; }
+
+    /** Number of loadDimensionCache() calls that had to go to the cache files (or the DDS) */
+    unsigned long long getMemoryCacheMisses() const { return d_memoryMisses; }
 
 	virtual ~AggMemberDatasetDimensionCache();
 };
@@ -37,6 +37,8 @@
 
 namespace agg_util {
 
+unsigned int AggMemberDatasetUsingLocationRef::_sNumLoaded = 0;
+
 AggMemberDatasetUsingLocationRef::AggMemberDatasetUsingLocationRef(const std::string& locationToLoad,
     const agg_util::DDSLoader& loaderToUse) :
     AggMemberDatasetWithDimensionCacheBase(locationToLoad), _loader(loaderToUse), _pDataResponse(0)
@@ -80,6 +82,15 @@ AggMemberDatasetUsingLocationRef::getDDS()
     return pDDSRet;
 }
 
+/* virtual */
+void AggMemberDatasetUsingLocationRef::releaseDDS()
+{
+    if (_pDataResponse) {
+        BESDEBUG("ncml", "Releasing loaded DDS for aggregation member location = " << getLocation() << endl);
+        cleanup();
+    }
+}
+
 /////////////////////////////// Private Helpers ////////////////////////////////////
 void AggMemberDatasetUsingLocationRef::loadDDS()
 {
@@ -106,11 +117,16 @@ void AggMemberDatasetUsingLocationRef::loadDDS()
     newResponse.release();
 
     BESDEBUG("ncml", "Loading loadDDS for aggregation member location = " << getLocation() << endl);
+    ++_sNumLoaded;
     _loader.loadInto(getLocation(), DDSLoader::eRT_RequestDataDDS, _pDataResponse);
+    BESDEBUG("ncml", "Loaded DDS for aggregation member location = " << getLocation() << " (" << _sNumLoaded << " member DDSs loaded)" << endl);
 }
 
 void AggMemberDatasetUsingLocationRef::cleanup() throw ()
 {
+    if (_pDataResponse) {
+        --_sNumLoaded;
+    }
     SAFE_DELETE(_pDataResponse);
 }
 
@@ -73,6 +73,16 @@ public:
      */
     virtual const libdap::DDS* getDDS();
 
+    /** Delete the loaded data response, if any.  getDDS() will reload it. */
+    virtual void releaseDDS();
+
+    /** @return how many instances hold a loaded DDS right now, which
+     * LoadedGranuleLRU keeps bounded while an aggregation is read. */
+    static unsigned int getNumLoaded()
+    {
+        return _sNumLoaded;
+    }
+
 private:
     // helpers
 
@@ -89,6 +99,8 @@ private:
     DDSLoader _loader; // for loading
     BESDataDDSResponse* _pDataResponse; // holds our loaded DDS
 
+    static unsigned int _sNumLoaded; // instances with a non-null _pDataResponse
+
 };
 // class AggMemberDatasetUsingLocationRef
 
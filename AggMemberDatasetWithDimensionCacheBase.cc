@@ -142,6 +142,12 @@ void AggMemberDatasetWithDimensionCacheBase::setDimensionCacheFor(const Dimensio
     }
 }
 
+/* virtual */
+void AggMemberDatasetWithDimensionCacheBase::getCachedDimensions(std::vector<Dimension>& dims) const
+{
+    dims.insert(dims.end(), _dimensionCache.begin(), _dimensionCache.end());
+}
+
 /* virtual */
 void AggMemberDatasetWithDimensionCacheBase::fillDimensionCacheByUsingDDS()
 {
@@ -54,6 +54,7 @@ public:
     virtual unsigned int getCachedDimensionSize(const std::string& dimName) const;
     virtual bool isDimensionCached(const std::string& dimName) const;
     virtual void setDimensionCacheFor(const Dimension& dim, bool throwIfFound);
+    virtual void getCachedDimensions(std::vector<Dimension>& dims) const;
     virtual void fillDimensionCacheByUsingDDS();
     virtual void flushDimensionCache();
 
@@ -0,0 +1,161 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+#include "config.h"
+
+#include "AggregationBatchReader.h"
+
+#include <sstream>
+
+#include <BaseType.h> // libdap
+#include <D4Group.h> // libdap
+#include <DDS.h> // libdap
+#include <DMR.h> // libdap
+#include <Grid.h> // libdap
+
+#include "BESDebug.h"
+#include "TheBESKeys.h"
+
+#include "ArrayAggregationBase.h"
+
+static const std::string DEBUG_CHANNEL("agg_util");
+
+namespace agg_util {
+
+const std::string AggregationBatchReader::BATCH_READ_SIZE_KEY = "NCML.Aggregation.BatchReadSize";
+
+unsigned long long AggregationBatchReader::getBatchReadBytesFromConfig()
+{
+    bool found = false;
+    std::string value;
+    TheBESKeys::TheKeys()->get_value(BATCH_READ_SIZE_KEY, value, found);
+    if (!found || value.empty()) {
+        return 0;
+    }
+
+    std::istringstream iss(value);
+    int megabytes = 0;
+    iss >> megabytes;
+    if (iss.fail() || megabytes < 0) {
+        BESDEBUG(DEBUG_CHANNEL,
+            "AggregationBatchReader: ignoring bad value for " << BATCH_READ_SIZE_KEY << "=\"" << value << "\"" << endl);
+        return 0;
+    }
+    return static_cast<unsigned long long>(megabytes) * 1024 * 1024;
+}
+
+AggregationBatchReader::AggregationBatchReader(ArrayAggregationBase& leader, libdap::DDS& dds) :
+    _leader(leader), _siblings(), _stagedBytes(0), _maxStagedBytes(getBatchReadBytesFromConfig())
+{
+    // A variable staged by someone else reads the rest of its own granules alone.
+    if (_maxStagedBytes == 0 || _leader.isBatchStaged()) {
+        return;
+    }
+
+    for (libdap::DDS::Vars_iter it = dds.var_begin(); it != dds.var_end(); ++it) {
+        addIfSibling(*it);
+    }
+    BESDEBUG(DEBUG_CHANNEL,
+        "AggregationBatchReader: " << _leader.name() << " is reading for " << _siblings.size() << " other variables" << endl);
+}
+
+AggregationBatchReader::AggregationBatchReader(ArrayAggregationBase& leader, libdap::DMR& dmr) :
+    _leader(leader), _siblings(), _stagedBytes(0), _maxStagedBytes(getBatchReadBytesFromConfig())
+{
+    if (_maxStagedBytes == 0 || _leader.isBatchStaged()) {
+        return;
+    }
+
+    libdap::D4Group* root = dmr.root();
+    for (libdap::Constructor::Vars_iter it = root->var_begin(); it != root->var_end(); ++it) {
+        addIfSibling(*it);
+    }
+    BESDEBUG(DEBUG_CHANNEL,
+        "AggregationBatchReader: " << _leader.name() << " is reading for " << _siblings.size() << " other variables" << endl);
+}
+
+AggregationBatchReader::~AggregationBatchReader()
+{
+    _siblings.clear();
+}
+
+void AggregationBatchReader::stageOthers(unsigned int datasetIndex)
+{
+    for (std::vector<ArrayAggregationBase*>::iterator it = _siblings.begin(); it != _siblings.end(); ++it) {
+        // Check before reading so a big slice can't take us past the limit.
+        unsigned long long sliceBytes = (*it)->granuleSliceBytes(datasetIndex);
+        if (_stagedBytes + sliceBytes > _maxStagedBytes) {
+            BESDEBUG(DEBUG_CHANNEL,
+                "AggregationBatchReader: staged " << _stagedBytes << " bytes, " << (*it)->name() << " needs " << sliceBytes
+                << " more, the rest will be read by each variable." << endl);
+            _siblings.clear();
+            return;
+        }
+        _stagedBytes += (*it)->stageGranuleSlice(datasetIndex);
+    }
+}
+
+void AggregationBatchReader::addIfSibling(libdap::BaseType* var)
+{
+    libdap::Grid* pGrid = dynamic_cast<libdap::Grid*>(var);
+    if (pGrid) {
+        addIfSibling(pGrid->array_var());
+        for (libdap::Grid::Map_iter it = pGrid->map_begin(); it != pGrid->map_end(); ++it) {
+            addIfSibling(*it);
+        }
+        return;
+    }
+
+    ArrayAggregationBase* pAgg = dynamic_cast<ArrayAggregationBase*>(var);
+    if (!pAgg || pAgg == &_leader || !pAgg->send_p() || pAgg->read_p() || pAgg->isBatchStaged()) {
+        return;
+    }
+
+    // Staged slices are raw value bytes, so only numeric types.
+    libdap::Type type = pAgg->var()->type();
+    if (type == libdap::dods_str_c || type == libdap::dods_url_c) {
+        return;
+    }
+
+    // Only worth it if we're walking the very same granules.
+    const AMDList& ours = _leader.getDatasetList();
+    const AMDList& theirs = pAgg->getDatasetList();
+    if (ours.size() != theirs.size()) {
+        return;
+    }
+    for (unsigned int i = 0; i < ours.size(); ++i) {
+        if (ours[i].get() != theirs[i].get()) {
+            return;
+        }
+    }
+
+    pAgg->beginBatchStaging();
+    _siblings.push_back(pAgg);
+}
+
+} // namespace agg_util
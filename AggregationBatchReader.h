@@ -0,0 +1,100 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef __AGG_UTIL__AGGREGATION_BATCH_READER_H__
+#define __AGG_UTIL__AGGREGATION_BATCH_READER_H__
+
+#include <string>
+#include <vector>
+
+namespace libdap {
+class BaseType;
+class DDS;
+class DMR;
+}
+
+namespace agg_util {
+class ArrayAggregationBase;
+
+/**
+ * Lets the first aggregated variable of a response that is serialized
+ * (the leader) read the slices of the other requested aggregated
+ * variables over the same granules (its siblings) while each granule is
+ * loaded, instead of every variable walking the granule list on its own
+ * and loading each granule's DDS again after LoadedGranuleLRU let it go.
+ *
+ * The siblings keep the slices staged (see
+ * ArrayAggregationBase::stageGranuleSlice()) until their own serialize()
+ * sends them.  The staged bytes are bounded by BATCH_READ_SIZE_KEY; past
+ * that the siblings just read the rest of their granules themselves.
+ *
+ * Meant to be used as a local in the leader's loop over granules, like
+ * LoadedGranuleLRU.  The response's DDS or DMR must outlive this object.
+ */
+class AggregationBatchReader {
+public:
+    /** The BES key for the max megabytes of sibling slices staged per response. */
+    static const std::string BATCH_READ_SIZE_KEY;
+
+    /** @return BATCH_READ_SIZE_KEY in bytes, or 0 (batching off) if not set. */
+    static unsigned long long getBatchReadBytesFromConfig();
+
+    /** Find the siblings of leader among the variables of dds. */
+    AggregationBatchReader(ArrayAggregationBase& leader, libdap::DDS& dds);
+
+    /** Find the siblings of leader among the variables of the root group of dmr. */
+    AggregationBatchReader(ArrayAggregationBase& leader, libdap::DMR& dmr);
+
+    ~AggregationBatchReader();
+
+    /** Call after the leader has read its slice of the granule at
+     * datasetIndex in its AMDList, while that granule is still loaded. */
+    void stageOthers(unsigned int datasetIndex);
+
+    /** @return number of siblings taking part */
+    unsigned int size() const
+    {
+        return _siblings.size();
+    }
+
+private:
+    AggregationBatchReader(const AggregationBatchReader&); // disallow
+    AggregationBatchReader& operator=(const AggregationBatchReader&); // disallow
+
+    /** Add var (or the arrays of a Grid) to _siblings if it can be batched with _leader. */
+    void addIfSibling(libdap::BaseType* var);
+
+    ArrayAggregationBase& _leader;
+    std::vector<ArrayAggregationBase*> _siblings;
+    unsigned long long _stagedBytes;
+    unsigned long long _maxStagedBytes;
+};
+
+} // namespace agg_util
+
+#endif /* __AGG_UTIL__AGGREGATION_BATCH_READER_H__ */
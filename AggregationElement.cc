@@ -38,6 +38,7 @@
 #include "ArrayJoinExistingAggregation.h" // agg_util
 #include "GridAggregateOnOuterDimension.h" // agg_util
 #include "GridJoinExistingAggregation.h" // agg_util
+#include "LoadedGranuleLRU.h" // agg_util
 #include "AggMemberDatasetDimensionCache.h"
 
 #include "config.h"
@@ -55,8 +56,11 @@
 #include "NCMLParser.h"
 #include "NetcdfElement.h"
 #include "ScanElement.h"
+#include "UnionVariableIndex.h"
+#include "DirectoryUtil.h" // agg_util
 #include "BESDebug.h"
 #include "BESStopWatch.h"
+#include "BESUtil.h"
 
 
 
@@ -366,13 +370,24 @@ void AggregationElement::processUnion()
 
     // Merge the attributes and variables in all the DDS's into our parent DDS....
     vector<const DDS*> datasetsInOrder;
+    // If the request names the variables it wants and we've seen this union
+    // before, only load the members providing them.  Otherwise,
     // NOTE WELL: this will LOAD ALL DDX's, but there's no choice for union.
     // This doesn't load data, just the metadata!
-    collectDatasetsInOrder(datasetsInOrder);
     DDS* pUnion = 0;
     if (getParentDataset()) {
         pUnion = getParentDataset()->getDDS();
     }
+    AttrTable memberAttrs;
+    if (collectUnionContributorsInOrder(datasetsInOrder, memberAttrs)) {
+        // The members we skipped still add their global attributes, in order.
+        VALID_PTR(pUnion);
+        AggregationUtil::unionAttrsInto(&(pUnion->get_attr_table()), memberAttrs);
+    }
+    else {
+        collectDatasetsInOrder(datasetsInOrder);
+        recordUnionVariableIndex(datasetsInOrder);
+    }
     AggregationUtil::performUnionAggregation(pUnion, datasetsInOrder);
 }
 
@@ -631,17 +646,27 @@ void AggregationElement::fillDimensionCacheForJoinExistingDimension(AMDList& gra
 
     	agg_util::AggMemberDatasetDimensionCache *aggDimCache = agg_util::AggMemberDatasetDimensionCache::get_instance();
 
-		AMDList::iterator endIt = granuleList.end();
-		for (AMDList::iterator it = granuleList.begin(); it != endIt; ++it) {
-			AggMemberDataset *amd = (*it).get();
-			if(aggDimCache) {
-				BESDEBUG("ncml", "AggregationElement::fillDimensionCacheForJoinExistingDimension() - Loading dimension cache for: " << (*it)->getLocation() << "..." << endl);
-				aggDimCache->loadDimensionCache(amd);
-			}
-			else {
+		// With index storage the whole aggregation comes from one file.
+		if (aggDimCache && aggDimCache->useAggregationIndex()) {
+			BESDEBUG("ncml", "AggregationElement::fillDimensionCacheForJoinExistingDimension() - Loading dimension index for: " << _parser->_filename << "..." << endl);
+			aggDimCache->loadDimensionIndex(_parser->_filename + "#" + _dimName, granuleList);
+		}
+		// Cache hits first, then the misses are filled together with granule read-ahead.
+		else if (aggDimCache) {
+			BESDEBUG("ncml", "AggregationElement::fillDimensionCacheForJoinExistingDimension() - Loading dimension cache for " << granuleList.size() << " datasets..." << endl);
+			aggDimCache->loadDimensionCache(granuleList);
+		}
+		else {
+			// Filling from the DDS loads it, don't keep them all around.
+			agg_util::LoadedGranuleLRU loadedGranules(agg_util::LoadedGranuleLRU::getMaxLoadedGranulesFromConfig());
+
+			AMDList::iterator endIt = granuleList.end();
+			for (AMDList::iterator it = granuleList.begin(); it != endIt; ++it) {
+				AggMemberDataset *amd = (*it).get();
 				BESDEBUG("ncml", "AggregationElement::fillDimensionCacheForJoinExistingDimension() - " <<
 						"WARNING NcML Dimension Caching is not configured or is not working! Loading dimensions from DDS for dataset: " <<
 						(*it)->getLocation() << "" << endl);
+				loadedGranules.touch(*amd);
 				amd->fillDimensionCacheByUsingDDS();
 			}
 		}
@@ -1416,6 +1441,98 @@ void AggregationElement::collectDatasetsInOrder(vector<const DDS*>& ddsList) con
     }
 }
 
+// 0 if path can't be stat'd, as in NCMLParser::addDependency()
+static time_t modificationTime(const string& path)
+{
+    struct stat statBuf;
+    return (stat(path.c_str(), &statBuf) == 0) ? statBuf.st_mtime : 0;
+}
+
+bool AggregationElement::collectUnionContributorsInOrder(vector<const DDS*>& ddsList, AttrTable& memberAttrs) const
+{
+    const std::set<string>& requested = _parser->getRequestedVariables();
+    UnionVariableIndex* pIndex = UnionVariableIndex::get_instance();
+    string key;
+    UnionVariableIndex::VariableMap variables;
+    if (requested.empty() || !pIndex || !makeUnionIndexKey(key) || !pIndex->get(key, variables, memberAttrs)) {
+        return false;
+    }
+
+    vector<bool> needed(_datasets.size(), false);
+    for (std::set<string>::const_iterator it = requested.begin(); it != requested.end(); ++it) {
+        UnionVariableIndex::VariableMap::const_iterator found = variables.find(*it);
+        // Might come from elsewhere in the NcML, or not exist at all.  Play it safe.
+        if (found == variables.end() || found->second >= _datasets.size()) {
+            BESDEBUG("ncml", "Union: no member is indexed as providing " << *it << ", loading all of them." << endl);
+            return false;
+        }
+        needed[found->second] = true;
+    }
+
+    ddsList.resize(0);
+    for (unsigned int i = 0; i < _datasets.size(); ++i) {
+        if (needed[i]) {
+            const DDS* pDDS = _datasets[i]->getDDS();
+            VALID_PTR(pDDS);
+            ddsList.push_back(pDDS);
+        }
+    }
+
+    BESDEBUG("ncml", "Union: loaded " << ddsList.size() << " of " << _datasets.size() << " members for the request." << endl);
+    if (ddsList.size() < _datasets.size()) {
+        _parser->setSkippedUnionMembers();
+        _parser->setResultUncacheable();
+    }
+    return true;
+}
+
+void AggregationElement::recordUnionVariableIndex(const vector<const DDS*>& ddsList) const
+{
+    UnionVariableIndex* pIndex = UnionVariableIndex::get_instance();
+    string key;
+    if (!pIndex || !makeUnionIndexKey(key)) {
+        return;
+    }
+
+    // The union takes each variable, and global attribute, from the first member that has it.
+    UnionVariableIndex::VariableMap variables;
+    AttrTable memberAttrs;
+    for (unsigned int i = 0; i < ddsList.size(); ++i) {
+        DDS* pDDS = const_cast<DDS*>(ddsList[i]);
+        AggregationUtil::unionAttrsInto(&memberAttrs, pDDS->get_attr_table());
+        for (DDS::Vars_iter it = pDDS->var_begin(); it != pDDS->var_end(); ++it) {
+            variables.insert(std::make_pair((*it)->name(), i));
+        }
+    }
+
+    // Valid until the NcML (which may rename things in the members) or a member changes.
+    UnionVariableIndex::DependencyList dependencies;
+    const string rootDir = agg_util::DirectoryUtil::getBESRootDir();
+    dependencies.push_back(std::make_pair(_parser->_filename, modificationTime(_parser->_filename)));
+    for (vector<NetcdfElement*>::const_iterator it = _datasets.begin(); it != _datasets.end(); ++it) {
+        string path = BESUtil::assemblePath(rootDir, (*it)->location(), true);
+        dependencies.push_back(std::make_pair(path, modificationTime(path)));
+    }
+
+    pIndex->put(key, variables, memberAttrs, dependencies);
+}
+
+bool AggregationElement::makeUnionIndexKey(string& key) const
+{
+    // Members without a location (e.g. nested aggregations) have no single file to check.
+    std::ostringstream oss;
+    oss << _parser->_filename;
+    for (vector<NetcdfElement*>::const_iterator it = _datasets.begin(); it != _datasets.end(); ++it) {
+        VALID_PTR(*it);
+        if ((*it)->location().empty()) {
+            return false;
+        }
+        oss << '\n' << (*it)->location();
+    }
+    key = oss.str();
+    return true;
+}
+
 void AggregationElement::collectAggMemberDatasets(AMDList& rMemberDatasets) const
 {
     rMemberDatasets.resize(0);
@@ -42,6 +42,7 @@ struct Dimension;
 
 namespace libdap {
 class Array;
+class AttrTable;
 class BaseType;
 class DDS;
 class Grid;
@@ -49,6 +50,7 @@ class Grid;
 
 using agg_util::AggMemberDataset;
 using libdap::Array;
+using libdap::AttrTable;
 using libdap::BaseType;
 using libdap::DDS;
 using libdap::Grid;
@@ -365,6 +367,23 @@ private:
      */
     void collectDatasetsInOrder(vector<const DDS*>& ddsList) const;
 
+    /**
+     * If the parser was given the variables the request wants and the
+     * UnionVariableIndex knows which members provide all of them, fill
+     * ddsList (in order) with just the DDS's of those members and
+     * memberAttrs with the global attributes of all of them.
+     * @return false if the union has to use all of its members.
+     */
+    bool collectUnionContributorsInOrder(vector<const DDS*>& ddsList, AttrTable& memberAttrs) const;
+
+    /** Record which of the (all loaded) members in ddsList provides each
+     * variable of the union in the UnionVariableIndex, if it's on. */
+    void recordUnionVariableIndex(const vector<const DDS*>& ddsList) const;
+
+    /** Make the UnionVariableIndex key for this union.
+     * @return false if a member has no location, in which case it can't be indexed */
+    bool makeUnionIndexKey(std::string& key) const;
+
     /**
      * Fill the argument list _rMemberDatasets_ with shared references to
      * AggMemberDataset concrete subclasses (i.e. RCPtr<AggMemberDataset>)
@@ -32,6 +32,7 @@
 #include "AggMemberDataset.h"
 #include "AggregationException.h"
 #include "Dimension.h"
+#include "GranuleDataCache.h"
 
 // libdap includes
 #include <Array.h> // libdap
@@ -42,6 +43,8 @@
 #include <Grid.h>
 #include "BESDebug.h"
 #include "BESStopWatch.h"
+#include "BESUtil.h"
+#include "TheBESKeys.h"
 
 // Outside includes (MINIMIZE THESE!)
 #include "NCMLDebug.h" // This the ONLY dependency on NCML Module I want in this class since the macros there are general it's ok...
@@ -139,8 +142,19 @@ TopLevelArrayGetter::readAndGetArray(const std::string& name, const libdap::DDS&
 /////////////////////////////////////////////////////////////////////////////
 // TopLevelGridDataArrayGetter impl
 
+const std::string TopLevelGridDataArrayGetter::READ_GRID_MAPS_KEY = "NCML.Aggregation.ReadGridMaps";
+
+bool TopLevelGridDataArrayGetter::getReadGridMapsFromConfig()
+{
+    bool found = false;
+    std::string value;
+    TheBESKeys::TheKeys()->get_value(READ_GRID_MAPS_KEY, value, found);
+    value = BESUtil::lowercase(value);
+    return found && (value == "true" || value == "yes");
+}
+
 TopLevelGridDataArrayGetter::TopLevelGridDataArrayGetter() :
-    ArrayGetterInterface()
+    ArrayGetterInterface(), _readMaps(getReadGridMapsFromConfig())
 {
 }
 
@@ -203,10 +217,24 @@ TopLevelGridDataArrayGetter::readAndGetArray(const std::string& name, const libd
     // cannot handle a read on a subobject unless read() is called
     // on the parent object.  We have given the constraints to the
     // data Array already.
-    // TODO make an option on whether to load the Grid's map
-    // vectors or not!  I think for these cases we do not want them ever!
     pDataGrid->set_send_p(true);
     pDataGrid->set_in_selection(true);
+
+    // set_send_p() on the Grid marked its maps too.  Unless asked to read
+    // them, unmark the ones not read yet: handlers that honor the flags on
+    // the parts of a Grid then read just the data Array.  The maps have the
+    // full (unconstrained) extent, so for a wide lat/lon Grid they can
+    // outweigh a small data slice.  Handlers that ignore the flags read
+    // them as before.
+    if (!_readMaps) {
+        for (Grid::Map_iter it = pDataGrid->map_begin(); it != pDataGrid->map_end(); ++it) {
+            if (!(*it)->read_p()) {
+                (*it)->set_send_p(false);
+                (*it)->set_in_selection(false);
+            }
+        }
+    }
+
     pDataGrid->read();
 
     // Also make sure the Array was read and if not call it as well.
@@ -873,6 +901,19 @@ Array* AggregationUtil::readDatasetArrayDataForAggregation(const Array& constrai
     BESStopWatch sw;
     if (BESISDEBUG(TIMING_LOG)) sw.start("AggregationUtil::readDatasetArrayDataForAggregation", "");
 
+    // On a hit the values go into the template itself, which has the
+    // constrained shape already, and the granule's DDS is never loaded.
+    // Callers clear_local_data() the returned array when done with it,
+    // which leaves the template as it was.
+    GranuleDataCache* pCache = GranuleDataCache::get_instance();
+    std::string cacheKey;
+    if (pCache && pCache->makeKey(dataset.getLocation(), varName, constrainedTemplateArray, cacheKey)) {
+        Array& templateArray = const_cast<Array&>(constrainedTemplateArray);
+        if (pCache->get(cacheKey, templateArray)) {
+            return &templateArray;
+        }
+    }
+
     const libdap::DDS* pDDS = dataset.getDDS();
     NCML_ASSERT_MSG(pDDS, "GridAggregateOnOuterDimension::read(): Got a null DataDDS "
         "while loading dataset = " + dataset.getLocation());
@@ -914,6 +955,10 @@ Array* AggregationUtil::readDatasetArrayDataForAggregation(const Array& constrai
                 "though their shapes matched. Logic problem.");
     }
 
+    if (!cacheKey.empty()) {
+        pCache->put(cacheKey, *pDatasetArray);
+    }
+
     return pDatasetArray;
 }
 
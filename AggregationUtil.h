@@ -109,6 +109,14 @@ struct TopLevelArrayGetter: public ArrayGetterInterface {
 // class TopLevelArrayGetter
 
 struct TopLevelGridDataArrayGetter: public ArrayGetterInterface {
+    /** The BES key that, if "true" or "yes", makes us read the map vectors
+     * of each granule's Grid along with its data Array. */
+    static const std::string READ_GRID_MAPS_KEY;
+
+    /** @return false unless READ_GRID_MAPS_KEY says to read the maps. */
+    static bool getReadGridMapsFromConfig();
+
+    /** Reads the maps only if getReadGridMapsFromConfig() says so. */
     TopLevelGridDataArrayGetter();
     virtual ~TopLevelGridDataArrayGetter();
 
@@ -127,6 +135,12 @@ struct TopLevelGridDataArrayGetter: public ArrayGetterInterface {
      */
     virtual libdap::Array* readAndGetArray(const std::string& name, const libdap::DDS& dds,
         const libdap::Array* const pConstraintTemplate, const std::string& debugChannel) const;
+
+    // Whether to read the granule Grid's (unconstrained) map vectors too.
+    // The aggregation serves its maps from its own sub grid template and
+    // any aggregated map is read through TopLevelGridMapArrayGetter, so
+    // they're only needed for handlers that can't read the data Array alone.
+    bool _readMaps;
 };
 // class TopLevelGridDataArrayGetter
 
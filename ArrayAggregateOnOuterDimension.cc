@@ -28,10 +28,14 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include "ArrayAggregateOnOuterDimension.h"
+#include "AggregationBatchReader.h"
 #include "AggregationException.h"
+#include "GranuleReadAhead.h"
+#include "LoadedGranuleLRU.h"
 
 #include <DataDDS.h> // libdap::DataDDS
 #include <Marshaller.h>
+#include <D4StreamMarshaller.h>
 
 // only NCML backlinks we want in this agg_util class.
 #include "NCMLDebug.h" // BESDEBUG and throw macros
@@ -139,102 +143,163 @@ bool ArrayAggregateOnOuterDimension::serialize(libdap::ConstraintEvaluator &eval
     bes_timing::elapsedTimeToReadStart = 0;
 
     if (!read_p()) {
+#if PIPELINING
+        // Prepare our output buffer for our constrained length
+        m.put_vector_start(length());
+        AggregationBatchReader batchReader(*this, dds);
+        streamConstrainedGranules(&m, 0, batchReader);
+        m.put_vector_end();
+        status = true;
+#else
+        read();
 
-        if (PRINT_CONSTRAINTS) {
-            BESDEBUG_FUNC(DEBUG_CHANNEL, "Constraints on this Array are:" << endl);
-            printConstraints(*this);
-        }
+        delete bes_timing::elapsedTimeToTransmitStart;
+        bes_timing::elapsedTimeToTransmitStart = 0;
+        status = libdap::Array::serialize(eval, dds, m, ce_eval);
+#endif
+    }
+    else {
+        status = libdap::Array::serialize(eval, dds, m, ce_eval);
+    }
 
-        // call subclass impl
-        transferOutputConstraintsIntoGranuleTemplateHook();
+    return status;
+}
 
-        if (PRINT_CONSTRAINTS) {
-            BESDEBUG_FUNC(DEBUG_CHANNEL, "After transfer, constraints on the member template Array are: " << endl);
-            printConstraints(getGranuleTemplateArray());
-        }
+/**
+ * The DAP4 version of the pipelined serialize() above: each granule's slice
+ * goes into the chunked response as soon as it is read.
+ *
+ * If this method is called and the variable has read_p set to true,
+ * then libdap::Array::serialize() will be called.
+ */
+void ArrayAggregateOnOuterDimension::serialize(libdap::D4StreamMarshaller &m, libdap::DMR &dmr, bool filter)
+{
+    BESStopWatch sw;
+    if (BESISDEBUG(TIMING_LOG)) sw.start("ArrayAggregateOnOuterDimension::serialize(D4)", "");
 
-        // outer one is the first in iteration
-        const Array::dimension& outerDim = *(dim_begin());
-        BESDEBUG(DEBUG_CHANNEL,
-            "Aggregating datasets array with outer dimension constraints: " << " start=" << outerDim.start << " stride=" << outerDim.stride << " stop=" << outerDim.stop << endl);
+    delete bes_timing::elapsedTimeToReadStart;
+    bes_timing::elapsedTimeToReadStart = 0;
 
-        // Be extra sure we have enough datasets for the given request
-        if (static_cast<unsigned int>(outerDim.size) != getDatasetList().size()) {
-            // Not sure whose fault it was, but tell the author
-            THROW_NCML_PARSE_ERROR(-1, "The new outer dimension of the joinNew aggregation doesn't "
-                " have the same size as the number of datasets in the aggregation!");
-        }
+    if (!read_p()) {
+        AggregationBatchReader batchReader(*this, dmr);
+        streamConstrainedGranules(0, &m, batchReader);
+    }
+    else {
+        libdap::Array::serialize(m, dmr, filter);
+    }
+}
 
-#if PIPELINING
-        // Prepare our output buffer for our constrained length
-        m.put_vector_start(length());
-#else
-        reserve_value_capacity();
-#endif
-        // this index pointing into the value buffer for where to write.
-        // The buffer has a stride equal to the _pSubArrayProto->length().
+/**
+ * Read the granules the constraints on this select, in order, and send each
+ * one's slice to whichever of m (DAP2, between put_vector_start() and
+ * put_vector_end()) and d4m (DAP4) is not null. Slices another variable
+ * already staged for us are sent without reading; batchReader stages the
+ * slices of the other variables while each granule we read is loaded.
+ */
+void ArrayAggregateOnOuterDimension::streamConstrainedGranules(libdap::Marshaller* m, libdap::D4StreamMarshaller* d4m,
+    AggregationBatchReader& batchReader)
+{
+    if (PRINT_CONSTRAINTS) {
+        BESDEBUG_FUNC(DEBUG_CHANNEL, "Constraints on this Array are:" << endl);
+        printConstraints(*this);
+    }
 
-        // Keep this to do some error checking
-        int nextElementIndex = 0;
+    // call subclass impl
+    transferOutputConstraintsIntoGranuleTemplateHook();
+
+    if (PRINT_CONSTRAINTS) {
+        BESDEBUG_FUNC(DEBUG_CHANNEL, "After transfer, constraints on the member template Array are: " << endl);
+        printConstraints(getGranuleTemplateArray());
+    }
+
+    // outer one is the first in iteration
+    const Array::dimension& outerDim = *(dim_begin());
+    BESDEBUG(DEBUG_CHANNEL,
+        "Aggregating datasets array with outer dimension constraints: " << " start=" << outerDim.start << " stride=" << outerDim.stride << " stop=" << outerDim.stop << endl);
+
+    // Be extra sure we have enough datasets for the given request
+    if (static_cast<unsigned int>(outerDim.size) != getDatasetList().size()) {
+        // Not sure whose fault it was, but tell the author
+        THROW_NCML_PARSE_ERROR(-1, "The new outer dimension of the joinNew aggregation doesn't "
+            " have the same size as the number of datasets in the aggregation!");
+    }
 
-        // Traverse the dataset array respecting hyperslab
+    // Keep this to do some error checking
+    int nextElementIndex = 0;
+
+    // Let the read-ahead workers (if configured) start paging in the granules
+    // we're going to hit while we read and stream them in order below.
+    std::vector<std::string> granuleLocations;
+    unsigned int readThreads = GranuleReadAhead::getReadThreadsFromConfig();
+    if (readThreads > 0) {
         for (int i = outerDim.start; i <= outerDim.stop && i < outerDim.size; i += outerDim.stride) {
-            AggMemberDataset& dataset = *((getDatasetList())[i]);
+            granuleLocations.push_back(getDatasetList()[i]->getLocation());
+        }
+    }
+    GranuleReadAhead readAhead(granuleLocations, readThreads, GranuleReadAhead::getReadAheadBytesFromConfig());
+    unsigned int granuleNum = 0;
 
-            try {
-#if USE_LOCAL_TIMEOUT_SCHEME
-                dds.timeout_on();
-#endif
-                Array* pDatasetArray = AggregationUtil::readDatasetArrayDataForAggregation(getGranuleTemplateArray(),
-                    name(), dataset, getArrayGetterInterface(), DEBUG_CHANNEL);
-#if USE_LOCAL_TIMEOUT_SCHEME
-                dds.timeout_off();
-#endif
-#if PIPELINING
-                delete bes_timing::elapsedTimeToTransmitStart;
-                bes_timing::elapsedTimeToTransmitStart = 0;
-                m.put_vector_part(pDatasetArray->get_buf(), getGranuleTemplateArray().length(), var()->width(),
-                    var()->type());
-#else
-                this->set_value_slice_from_row_major_vector(*pDatasetArray, nextElementIndex);
-#endif
+    // Don't hang onto every granule's DataDDS until the end of the request.
+    LoadedGranuleLRU loadedGranules(LoadedGranuleLRU::getMaxLoadedGranulesFromConfig());
 
-                pDatasetArray->clear_local_data();
-            }
-            catch (agg_util::AggregationException& ex) {
-                std::ostringstream oss;
-                oss << "Got AggregationException while streaming dataset index=" << i << " data for location=\""
-                    << dataset.getLocation() << "\" The error msg was: " << std::string(ex.what());
-                THROW_NCML_PARSE_ERROR(-1, oss.str());
+    std::vector<char> stagedSlice;
+
+    // Traverse the dataset array respecting hyperslab
+    for (int i = outerDim.start; i <= outerDim.stop && i < outerDim.size; i += outerDim.stride, ++granuleNum) {
+        AggMemberDataset& dataset = *((getDatasetList())[i]);
+
+        try {
+            if (takeStagedSlice(i, stagedSlice)) {
+                if (d4m) {
+                    putD4VectorPart(*d4m, &stagedSlice[0], getGranuleTemplateArray().length());
+                }
+                else {
+                    m->put_vector_part(&stagedSlice[0], getGranuleTemplateArray().length(), var()->width(),
+                        var()->type());
+                }
+                readAhead.setConsumed(granuleNum);
+                nextElementIndex += getGranuleTemplateArray().length();
+                continue;
             }
 
-            // Jump forward by the amount we added.
-            nextElementIndex += getGranuleTemplateArray().length();
-        }
+            loadedGranules.touch(dataset);
+            Array* pDatasetArray = AggregationUtil::readDatasetArrayDataForAggregation(getGranuleTemplateArray(),
+                name(), dataset, getArrayGetterInterface(), DEBUG_CHANNEL);
 
-        // If we succeeded, we are at the end of the array!
-        NCML_ASSERT_MSG(nextElementIndex == length(), "Logic error:\n"
-            "ArrayAggregateOnOuterDimension::read(): "
-            "At end of aggregating, expected the nextElementIndex to be the length of the "
-            "aggregated array, but it wasn't!");
+            delete bes_timing::elapsedTimeToTransmitStart;
+            bes_timing::elapsedTimeToTransmitStart = 0;
+            if (d4m) {
+                putD4VectorPart(*d4m, *pDatasetArray);
+            }
+            else {
+                m->put_vector_part(pDatasetArray->get_buf(), getGranuleTemplateArray().length(), var()->width(),
+                    var()->type());
+            }
 
-#if PIPELINING
-        m.put_vector_end();
-        status = true;
-#else
-        // Set the cache bit to avoid recomputing
-        set_read_p(true);
+            pDatasetArray->clear_local_data();
 
-        delete bes_timing::elapsedTimeToTransmitStart;
-        bes_timing::elapsedTimeToTransmitStart = 0;
-        status = libdap::Array::serialize(eval, dds, m, ce_eval);
-#endif
-    }
-    else {
-        status = libdap::Array::serialize(eval, dds, m, ce_eval);
+            // Read the other variables' slices while this granule is loaded.
+            batchReader.stageOthers(i);
+            readAhead.setConsumed(granuleNum);
+        }
+        catch (agg_util::AggregationException& ex) {
+            std::ostringstream oss;
+            oss << "Got AggregationException while streaming dataset index=" << i << " data for location=\""
+                << dataset.getLocation() << "\" The error msg was: " << std::string(ex.what());
+            THROW_NCML_PARSE_ERROR(-1, oss.str());
+        }
+
+        // Jump forward by the amount we added.
+        nextElementIndex += getGranuleTemplateArray().length();
     }
 
-    return status;
+    // If we succeeded, we are at the end of the array!
+    NCML_ASSERT_MSG(nextElementIndex == length(), "Logic error:\n"
+        "ArrayAggregateOnOuterDimension::serialize(): "
+        "At end of aggregating, expected the nextElementIndex to be the length of the "
+        "aggregated array, but it wasn't!");
+
+    endBatchStaging();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
@@ -262,6 +327,15 @@ void ArrayAggregateOnOuterDimension::transferOutputConstraintsIntoGranuleTemplat
         DEBUG_CHANNEL); // on this channel
 }
 
+/* virtual */
+bool ArrayAggregateOnOuterDimension::setGranuleTemplateConstraintsForDatasetHook(unsigned int datasetIndex)
+{
+    // The granule template has no outer dim, so it's just whether the hyperslab hits this granule.
+    const Array::dimension& outerDim = *(dim_begin());
+    int i = static_cast<int>(datasetIndex);
+    return i >= outerDim.start && i <= outerDim.stop && i < outerDim.size && (i - outerDim.start) % outerDim.stride == 0;
+}
+
 /* virtual */
 // In this version of the code, I broke apart the call to
 // agg_util::AggregationUtil::addDatasetArrayDataToAggregationOutputArray()
@@ -292,11 +366,14 @@ void ArrayAggregateOnOuterDimension::readConstrainedGranuleArraysAndAggregateDat
     // The buffer has a stride equal to the _pSubArrayProto->length().
     int nextElementIndex = 0;
 
+    LoadedGranuleLRU loadedGranules(LoadedGranuleLRU::getMaxLoadedGranulesFromConfig());
+
     // Traverse the dataset array respecting hyperslab
     for (int i = outerDim.start; i <= outerDim.stop && i < outerDim.size; i += outerDim.stride) {
         AggMemberDataset& dataset = *((getDatasetList())[i]);
 
         try {
+            loadedGranules.touch(dataset);
             agg_util::AggregationUtil::addDatasetArrayDataToAggregationOutputArray(*this, // into the output buffer of this object
                 nextElementIndex, // into the next open slice
                 getGranuleTemplateArray(), // constraints template
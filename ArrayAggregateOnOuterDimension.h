@@ -41,9 +41,12 @@ namespace libdap {
     class ConstraintEvaluator;
     class DDS;
     class Marshaller;
+    class D4StreamMarshaller;
+    class DMR;
 }
 
 namespace agg_util {
+class AggregationBatchReader;
 /**
  * class ArrayAggregateOnOuterDimension
  *
@@ -118,6 +121,7 @@ public:
     ArrayAggregateOnOuterDimension& operator=(const ArrayAggregateOnOuterDimension& rhs);
 
     virtual bool serialize(libdap::ConstraintEvaluator &eval, libdap::DDS &dds, libdap::Marshaller &m, bool ce_eval);
+    virtual void serialize(libdap::D4StreamMarshaller &m, libdap::DMR &dmr, bool filter = false);
 
 protected:
     // Subclass Interface
@@ -130,6 +134,9 @@ protected:
      */
     virtual void readConstrainedGranuleArraysAndAggregateDataHook();
 
+    /** Selects datasetIndex if the hyperslab on the new outer dim does. */
+    virtual bool setGranuleTemplateConstraintsForDatasetHook(unsigned int datasetIndex);
+
 private:
     // Helper interface
 
@@ -139,6 +146,10 @@ private:
     /** Clear out any used memory */
     void cleanup() throw ();
 
+    /** The read and stream loop shared by the DAP2 and DAP4 serialize() */
+    void streamConstrainedGranules(libdap::Marshaller* m, libdap::D4StreamMarshaller* d4m,
+        AggregationBatchReader& batchReader);
+
 private:
     // Data rep
 
@@ -32,6 +32,7 @@
 #include "BESDebug.h"
 #include "BESStopWatch.h"
 #include "Marshaller.h"
+#include "D4StreamMarshaller.h"
 #include "ConstraintEvaluator.h"
 
 // BES debug channel we output to
@@ -48,7 +49,7 @@ namespace agg_util {
 ArrayAggregationBase::ArrayAggregationBase(const libdap::Array& proto, const AMDList& aggMembers,
     std::auto_ptr<ArrayGetterInterface>& arrayGetter) :
     Array(proto), _pSubArrayProto(static_cast<Array*>(const_cast<Array&>(proto).ptr_duplicate())),
-    _pArrayGetter(arrayGetter), _datasetDescs(aggMembers)
+    _pArrayGetter(arrayGetter), _datasetDescs(aggMembers), _batchStaged(false), _stagedSlices()
 {
 }
 
@@ -56,6 +57,8 @@ ArrayAggregationBase::ArrayAggregationBase(const ArrayAggregationBase& rhs) :
     Array(rhs), _pSubArrayProto(0) // duplicate() handles this
         , _pArrayGetter(0) // duplicate() handles this
         , _datasetDescs()
+        , _batchStaged(false)
+        , _stagedSlices()
 {
     BESDEBUG(DEBUG_CHANNEL, "ArrayAggregationBase() copy ctor called!" << endl);
     duplicate(rhs);
@@ -127,6 +130,9 @@ bool ArrayAggregationBase::read()
     // and stream
     readConstrainedGranuleArraysAndAggregateDataHook();
 
+    // Anything staged for us by a batched read is redundant now.
+    endBatchStaging();
+
     // Set the cache bit to avoid recomputing
     set_read_p(true);
     return true;
@@ -138,6 +144,46 @@ ArrayAggregationBase::getDatasetList() const
     return _datasetDescs;
 }
 
+void ArrayAggregationBase::beginBatchStaging()
+{
+    // Our granule template needs the inner dim constraints before anyone reads for us.
+    transferOutputConstraintsIntoGranuleTemplateHook();
+    _batchStaged = true;
+}
+
+unsigned long long ArrayAggregationBase::granuleSliceBytes(unsigned int datasetIndex)
+{
+    NCML_ASSERT_MSG(_batchStaged, "ArrayAggregationBase::granuleSliceBytes() called before beginBatchStaging()!");
+    NCML_ASSERT(datasetIndex < _datasetDescs.size());
+
+    if (_stagedSlices.find(datasetIndex) != _stagedSlices.end()
+        || !setGranuleTemplateConstraintsForDatasetHook(datasetIndex)) {
+        return 0;
+    }
+    return static_cast<unsigned long long>(getGranuleTemplateArray().length()) * var()->width();
+}
+
+unsigned long long ArrayAggregationBase::stageGranuleSlice(unsigned int datasetIndex)
+{
+    // Also sets up the granule template's constraints for the read.
+    unsigned long long numBytes = granuleSliceBytes(datasetIndex);
+    if (numBytes == 0) {
+        return 0;
+    }
+
+    Array* pDatasetArray = AggregationUtil::readDatasetArrayDataForAggregation(getGranuleTemplateArray(), name(),
+        *(_datasetDescs[datasetIndex]), getArrayGetterInterface(), DEBUG_CHANNEL);
+
+    std::vector<char>& slice = _stagedSlices[datasetIndex];
+    const char* pBuf = pDatasetArray->get_buf();
+    slice.assign(pBuf, pBuf + numBytes);
+    pDatasetArray->clear_local_data();
+
+    BESDEBUG(DEBUG_CHANNEL,
+        "Staged " << numBytes << " bytes of " << name() << " from dataset index=" << datasetIndex << endl);
+    return numBytes;
+}
+
 ///////////////////////////// Non Public Helpers
 
 void ArrayAggregationBase::printConstraints(const Array& fromArray)
@@ -161,6 +207,70 @@ ArrayAggregationBase::getArrayGetterInterface() const
     return *(_pArrayGetter.get());
 }
 
+void ArrayAggregationBase::putD4VectorPart(D4StreamMarshaller& m, Array& granuleSlice)
+{
+    if (var()->type() == dods_str_c || var()->type() == dods_url_c) {
+        std::vector<std::string> values;
+        granuleSlice.value(values);
+        for (std::vector<std::string>::const_iterator it = values.begin(); it != values.end(); ++it) {
+            m.put_str(*it);
+        }
+    }
+    else {
+        putD4VectorPart(m, granuleSlice.get_buf(), granuleSlice.length());
+    }
+}
+
+void ArrayAggregationBase::putD4VectorPart(D4StreamMarshaller& m, char* values, int64_t num)
+{
+    switch (var()->type()) {
+    case dods_byte_c:
+    case dods_char_c:
+    case dods_int8_c:
+    case dods_uint8_c:
+        m.put_vector(values, num);
+        break;
+
+    case dods_int16_c:
+    case dods_uint16_c:
+    case dods_int32_c:
+    case dods_uint32_c:
+    case dods_int64_c:
+    case dods_uint64_c:
+        m.put_vector(values, num, var()->width());
+        break;
+
+    case dods_float32_c:
+        m.put_vector_float32(values, num);
+        break;
+
+    case dods_float64_c:
+        m.put_vector_float64(values, num);
+        break;
+
+    default:
+        THROW_NCML_INTERNAL_ERROR("ArrayAggregationBase::putD4VectorPart(): can't stream aggregated variable "
+            + name() + " of type " + var()->type_name());
+    }
+}
+
+bool ArrayAggregationBase::takeStagedSlice(unsigned int datasetIndex, std::vector<char>& values)
+{
+    std::map<unsigned int, std::vector<char> >::iterator it = _stagedSlices.find(datasetIndex);
+    if (it == _stagedSlices.end()) {
+        return false;
+    }
+    values.swap(it->second);
+    _stagedSlices.erase(it);
+    return true;
+}
+
+void ArrayAggregationBase::endBatchStaging()
+{
+    _batchStaged = false;
+    _stagedSlices.clear();
+}
+
 void ArrayAggregationBase::duplicate(const ArrayAggregationBase& rhs)
 {
     // Clone the template if it isn't null.
@@ -180,6 +290,7 @@ void ArrayAggregationBase::cleanup() throw ()
 {
     _datasetDescs.clear();
     _datasetDescs.resize(0);
+    endBatchStaging();
 }
 
 /* virtual */
@@ -198,4 +309,10 @@ void ArrayAggregationBase::readConstrainedGranuleArraysAndAggregateDataHook()
         "needs to be overridden and implemented in a base class.");
 }
 
+/* virtual */
+bool ArrayAggregationBase::setGranuleTemplateConstraintsForDatasetHook(unsigned int /* datasetIndex */)
+{
+    return false;
+}
+
 }
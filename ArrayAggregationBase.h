@@ -32,12 +32,15 @@
 #include "AggMemberDataset.h" // agg_util
 #include "AggregationUtil.h" // agg_util
 #include <Array.h> // libdap
+#include <map> // std
 #include <memory> // std
+#include <vector> // std
 
 namespace libdap {
     class ConstraintEvaluator;
     class DDS;
     class Marshaller;
+    class D4StreamMarshaller;
 }
 
 namespace agg_util
@@ -100,6 +103,26 @@ namespace agg_util
     */
     const AMDList& getDatasetList() const;
 
+    /**
+     * Batched reads (see AggregationBatchReader).
+     *
+     * beginBatchStaging() readies this variable to have its granule
+     * slices read on behalf of it by another variable's serialize();
+     * stageGranuleSlice() then reads and keeps the slice of the granule at
+     * datasetIndex of getDatasetList() if this variable's constraints
+     * select it, returning the bytes kept (0 if none). The staged slices
+     * are sent (and dropped) by this variable's own serialize().
+     * granuleSliceBytes() is the size stageGranuleSlice() would keep,
+     * without reading anything.
+     */
+    void beginBatchStaging();
+    bool isBatchStaged() const
+    {
+        return _batchStaged;
+    }
+    unsigned long long granuleSliceBytes(unsigned int datasetIndex);
+    unsigned long long stageGranuleSlice(unsigned int datasetIndex);
+
   protected:
 
 
@@ -118,6 +141,28 @@ namespace agg_util
     * but should not delete it, hence the reference. */
     const ArrayGetterInterface& getArrayGetterInterface() const;
 
+    /**
+     * Write the values of one granule's constrained slice (as returned by
+     * AggregationUtil::readDatasetArrayDataForAggregation()) to the DAP4
+     * stream as the next part of this array. DAP4 arrays have no count
+     * prefix and the marshaller updates the variable's checksum with each
+     * part, so the parts of all granules can go out as they are read.
+     */
+    void putD4VectorPart(libdap::D4StreamMarshaller& m, libdap::Array& granuleSlice);
+
+    /** As above, for num values of this variable's (numeric) type in values */
+    void putD4VectorPart(libdap::D4StreamMarshaller& m, char* values, int64_t num);
+
+    /**
+     * If the slice of granule datasetIndex was staged by stageGranuleSlice(),
+     * swap its bytes into values, forget it and return true.
+     */
+    bool takeStagedSlice(unsigned int datasetIndex, std::vector<char>& values);
+
+    /** Drop any staged slices left and stop staging. Call once the
+     * variable's data has been sent or read. */
+    void endBatchStaging();
+
   protected: // Subclass Interface
 
     /** subclass hook from read() to setup constraints on inner dims correctly */
@@ -130,6 +175,14 @@ namespace agg_util
      */
     virtual void readConstrainedGranuleArraysAndAggregateDataHook();
 
+    /**
+     * Subclass hook for stageGranuleSlice(): if the constraints on this
+     * select any of granule datasetIndex, set up the granule template's
+     * constraints to read just that part and return true.
+     * The default selects nothing, so the subclass isn't batched.
+     */
+    virtual bool setGranuleTemplateConstraintsForDatasetHook(unsigned int datasetIndex);
+
   private:
 
     /** Assign the state from rhs into this */
@@ -158,6 +211,12 @@ namespace agg_util
      */
     AMDList _datasetDescs;
 
+    /** Set by beginBatchStaging(). Not copied. */
+    bool _batchStaged;
+
+    /** The slices staged by stageGranuleSlice(), by dataset index. Not copied. */
+    std::map<unsigned int, std::vector<char> > _stagedSlices;
+
   };
 
 }
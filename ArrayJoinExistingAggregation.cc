@@ -30,14 +30,20 @@
 #include <sstream>
 
 #include <Marshaller.h>
+#include <D4StreamMarshaller.h>
 
 #include "BESDebug.h"
 #include "BESStopWatch.h"
 
 #include "ArrayJoinExistingAggregation.h"
 
+#include "AggregationBatchReader.h" // agg_util
 #include "AggregationException.h" // agg_util
 #include "AggregationUtil.h" // agg_util
+#include "GranuleDataCache.h" // agg_util
+#include "GranuleReadAhead.h" // agg_util
+#include "JoinExistingReadPlan.h" // agg_util
+#include "LoadedGranuleLRU.h" // agg_util
 #include "NCMLDebug.h"
 
 static const string DEBUG_CHANNEL(NCML_MODULE_DBG_CHANNEL_2);
@@ -51,7 +57,7 @@ namespace agg_util {
 
 ArrayJoinExistingAggregation::ArrayJoinExistingAggregation(const libdap::Array& granuleTemplate,
     const AMDList& memberDatasets, std::auto_ptr<ArrayGetterInterface>& arrayGetter, const Dimension& joinDim) :
-    ArrayAggregationBase(granuleTemplate, memberDatasets, arrayGetter), _joinDim(joinDim)
+    ArrayAggregationBase(granuleTemplate, memberDatasets, arrayGetter), _joinDim(joinDim), _granuleOffsets(), _batchReads(), _coordCacheKey(), _coordCacheKeyMade(false)
 {
     BESDEBUG_FUNC(DEBUG_CHANNEL, "Making the aggregated outer dimension be: " + joinDim.toString() + "\n");
 
@@ -76,7 +82,7 @@ ArrayJoinExistingAggregation::ArrayJoinExistingAggregation(const libdap::Array&
 }
 
 ArrayJoinExistingAggregation::ArrayJoinExistingAggregation(const ArrayJoinExistingAggregation& rhs) :
-    ArrayAggregationBase(rhs), _joinDim(rhs._joinDim)
+    ArrayAggregationBase(rhs), _joinDim(rhs._joinDim), _granuleOffsets(), _batchReads(), _coordCacheKey(), _coordCacheKeyMade(false)
 {
     duplicate(rhs);
 }
@@ -136,176 +142,319 @@ bool ArrayJoinExistingAggregation::serialize(libdap::ConstraintEvaluator &eval,
     bool status = false;
 
     if (!read_p()) {
-        // *** copy lines from AggregationBase::read() into here in place
-        // *** of the call to read()
+#if PIPELINING
+        // assumes the constraints are already set properly on this
+        m.put_vector_start(length());
+        AggregationBatchReader batchReader(*this, dds);
+        streamConstrainedGranules(&m, 0, batchReader);
+        m.put_vector_end();
+        status = true;
+#else
+        read();
+        status = libdap::Array::serialize(eval, dds, m, ce_eval);
+#endif
+    }
+    else {
+        status = libdap::Array::serialize(eval, dds, m, ce_eval);
+    }
+
+    return status;
+}
+
+/* virtual */
+// The DAP4 version of the pipelined serialize() above.
+void ArrayJoinExistingAggregation::serialize(libdap::D4StreamMarshaller &m, libdap::DMR &dmr, bool filter)
+{
+    BESStopWatch sw;
+    if (BESISDEBUG(TIMING_LOG)) sw.start("ArrayJoinExistingAggregation::serialize(D4)", "");
 
-        if (PRINT_CONSTRAINTS) {
-            BESDEBUG_FUNC(DEBUG_CHANNEL, "Constraints on this Array are:" << endl);
-            printConstraints(*this);
+    if (!read_p()) {
+        AggregationBatchReader batchReader(*this, dmr);
+        streamConstrainedGranules(0, &m, batchReader);
+    }
+    else {
+        libdap::Array::serialize(m, dmr, filter);
+    }
+}
+
+bool ArrayJoinExistingAggregation::fillCoordinateCache()
+{
+    std::vector<char> values;
+    std::string cacheKey;
+    if (getCoordinateValuesFromCache(values, cacheKey)) {
+        return true;
+    }
+    if (cacheKey.empty() || !isOuterDimUnconstrained()) {
+        return false;
+    }
+
+    // An unconstrained read puts it in the cache on the way out.
+    set_send_p(true);
+    read();
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Private Impl Below
+
+// *** These are the lines from AggregationBase::read() and
+// *** readConstrainedGranuleArraysAndAggregateDataHook, sending each granule's
+// *** slice to whichever of m (DAP2) or d4m (DAP4) isn't null as it is read.
+// *** Slices staged for us by another variable are sent without reading, and
+// *** batchReader stages the other variables' slices of each granule we read.
+void ArrayJoinExistingAggregation::streamConstrainedGranules(libdap::Marshaller* m, libdap::D4StreamMarshaller* d4m,
+    AggregationBatchReader& batchReader)
+{
+    if (PRINT_CONSTRAINTS) {
+        BESDEBUG_FUNC(DEBUG_CHANNEL, "Constraints on this Array are:" << endl);
+        printConstraints(*this);
+    }
+
+    // call subclass impl
+    transferOutputConstraintsIntoGranuleTemplateHook();
+
+    if (PRINT_CONSTRAINTS) {
+        BESDEBUG_FUNC(DEBUG_CHANNEL, "After transfer, constraints on the member template Array are: " << endl);
+        printConstraints(getGranuleTemplateArray());
+    }
+
+    // outer one is the first in iteration
+    const Array::dimension& outerDim = *(dim_begin());
+    BESDEBUG("ncml",
+        "Aggregating datasets array with outer dimension constraints: " << " start=" << outerDim.start << " stride=" << outerDim.stride << " stop=" << outerDim.stop << endl);
+
+    // The coordinate variable may not need any granule at all.
+    std::vector<char> coordValues;
+    std::string coordCacheKey;
+    if (getCoordinateValuesFromCache(coordValues, coordCacheKey)) {
+        if (d4m) {
+            putD4VectorPart(*d4m, &coordValues[0], length());
+        }
+        else {
+            m->put_vector_part(&coordValues[0], length(), var()->width(), var()->type());
         }
+        endBatchStaging();
+        return;
+    }
 
-        // call subclass impl
-        transferOutputConstraintsIntoGranuleTemplateHook();
+    // If we're sending all of it anyway, keep a copy for the cache.
+    bool fillCoordCache = !coordCacheKey.empty() && isOuterDimUnconstrained();
 
-        if (PRINT_CONSTRAINTS) {
-            BESDEBUG_FUNC(DEBUG_CHANNEL, "After transfer, constraints on the member template Array are: " << endl);
-            printConstraints(getGranuleTemplateArray());
+    try {
+        // Work out which granules we need and where in each of them.
+        const AMDList& datasets = getDatasetList(); // the list
+        NCML_ASSERT(!datasets.empty());
+        const JoinExistingReadPlan plan(getGranuleOffsets(), outerDim.start, outerDim.stride,
+            std::min(outerDim.stop, outerDim.size - 1));
+
+        // Start paging in the granules the plan touches while we
+        // read and send them in order below.
+        std::vector<std::string> granuleLocations;
+        unsigned int readThreads = GranuleReadAhead::getReadThreadsFromConfig();
+        if (readThreads > 0) {
+            for (JoinExistingReadPlan::const_iterator it = plan.begin(); it != plan.end(); ++it) {
+                granuleLocations.push_back(datasets[it->datasetIndex]->getLocation());
+            }
         }
+        GranuleReadAhead readAhead(granuleLocations, readThreads,
+            GranuleReadAhead::getReadAheadBytesFromConfig());
 
-        // *** Inserted code from readConstrainedGranuleArraysAndAggregateDataHook here
+        // Don't hang onto every granule's DataDDS until the end of the request.
+        LoadedGranuleLRU loadedGranules(LoadedGranuleLRU::getMaxLoadedGranulesFromConfig());
 
-        // outer one is the first in iteration
-        const Array::dimension& outerDim = *(dim_begin());
-        BESDEBUG("ncml",
-            "Aggregating datasets array with outer dimension constraints: " << " start=" << outerDim.start << " stride=" << outerDim.stride << " stop=" << outerDim.stop << endl);
+        std::vector<char> stagedSlice;
 
-        try {
-#if PIPELINING
-            // assumes the constraints are already set properly on this
-            m.put_vector_start(length());
-#else
-            reserve_value_capacity();
-#endif
+        for (unsigned int granuleNum = 0; granuleNum < plan.size(); ++granuleNum) {
+            const JoinExistingReadPlan::GranuleRead& granuleRead = plan[granuleNum];
+            const AggMemberDataset* pCurrDataset = datasets[granuleRead.datasetIndex].get();
 
-            // Start the iteration state for the granule.
-            const AMDList& datasets = getDatasetList(); // the list
-            NCML_ASSERT(!datasets.empty());
-            int currDatasetIndex = 0; // index into datasets
-            const AggMemberDataset* pCurrDataset = (datasets[currDatasetIndex]).get();
-
-            int outerDimIndexOfCurrDatasetHead = 0;
-            int currDatasetSize = int(pCurrDataset->getCachedDimensionSize(_joinDim.name));
-            bool currDatasetWasRead = false;
-
-            // where in this output array we are writing next
-            unsigned int nextOutputBufferElementIndex = 0;
-
-            // Traverse the outer dimension constraints,
-            // Keeping track of which dataset we need to
-            // be inside for the given values of the constraint.
-            for (int outerDimIndex = outerDim.start; outerDimIndex <= outerDim.stop && outerDimIndex < outerDim.size;
-                outerDimIndex += outerDim.stride) {
-                // Figure out where the given outer index maps into in local granule space
-                int localGranuleIndex = outerDimIndex - outerDimIndexOfCurrDatasetHead;
-
-                // if this is beyond the dataset end, move state to the next dataset
-                // and try again until we're in the proper interval, with proper dataset.
-                while (localGranuleIndex >= currDatasetSize) {
-                    localGranuleIndex -= currDatasetSize;
-                    outerDimIndexOfCurrDatasetHead += currDatasetSize;
-                    ++currDatasetIndex;
-                    NCML_ASSERT(currDatasetIndex < int(datasets.size()));
-                    pCurrDataset = datasets[currDatasetIndex].get();
-                    currDatasetSize = pCurrDataset->getCachedDimensionSize(_joinDim.name);
-                    currDatasetWasRead = false;
-
-                    BESDEBUG_FUNC(DEBUG_CHANNEL,
-                        "The constraint traversal passed a granule boundary " << "on the outer dimension and is stepping forward into " << "granule index=" << currDatasetIndex << endl);
+            BESDEBUG_FUNC(DEBUG_CHANNEL,
+                "Reading granule index=" << granuleRead.datasetIndex << " local start=" << granuleRead.localStart << " stride=" << granuleRead.localStride << " stop=" << granuleRead.localStop << endl);
+
+            // Set up the constraint template for the actual granule read
+            // so that it only loads the data values in which we are
+            // interested.
+            setGranuleTemplateOuterConstraint(granuleRead);
+
+            if (takeStagedSlice(granuleRead.datasetIndex, stagedSlice)) {
+                if (d4m) {
+                    putD4VectorPart(*d4m, &stagedSlice[0], getGranuleTemplateArray().length());
+                }
+                else {
+                    m->put_vector_part(&stagedSlice[0], getGranuleTemplateArray().length(), var()->width(),
+                        var()->type());
                 }
+                if (fillCoordCache) {
+                    coordValues.insert(coordValues.end(), stagedSlice.begin(), stagedSlice.end());
+                }
+                readAhead.setConsumed(granuleNum);
+                continue;
+            }
 
-                // If we haven't read in this granule yet (we passed a boundary)
-                // then do it now.  Map constraints into the local granule space.
-                if (!currDatasetWasRead) {
-                    BESDEBUG_FUNC(DEBUG_CHANNEL,
-                        " Current granule dataset was traversed but not yet " "read and copied into output.  Mapping constraints " "and calling read()..." << endl);
-
-                    // Set up a constraint object for the actual granule read
-                    // so that it only loads the data values in which we are
-                    // interested.
-                    Array& granuleConstraintTemplate = getGranuleTemplateArray();
-
-                    // The inner dim constraints were set up in the containing read() call.
-                    // The outer dim was left open for us to fix now...
-                    Array::Dim_iter outerDimIt = granuleConstraintTemplate.dim_begin();
-
-                    // modify the outerdim size to match the dataset we need to
-                    // load.  The inners MUST match so we can let those get
-                    //checked later...
-                    outerDimIt->size = currDatasetSize;
-                    outerDimIt->c_size = currDatasetSize; // this will get recalc below?
-
-                    // find the mapped endpoint
-                    // Basically, the fullspace endpoint mapped to local offset,
-                    // clamped into the local granule size.
-                    int granuleStopIndex = std::min(outerDim.stop - outerDimIndexOfCurrDatasetHead,
-                        currDatasetSize - 1);
-
-                    // we must clamp the stride to the interval of the
-                    // dataset in order to avoid an exception in
-                    // add_constraint on stride being larger than dataset.
-                    int clampedStride = std::min(outerDim.stride, currDatasetSize);
-                    // mapped endpoint clamped within this granule
-                    granuleConstraintTemplate.add_constraint(outerDimIt, localGranuleIndex, clampedStride,
-                        granuleStopIndex);
-#if USE_LOCAL_TIMEOUT_SCHEME
-                    dds.timeout_on();
-#endif
-#if 0
-                    // Do the constrained read and copy it into this output buffer
-                    agg_util::AggregationUtil::addDatasetArrayDataToAggregationOutputArray(*this,// into the output buffer of this object
-                        nextOutputBufferElementIndex,// into the next open slice
-                        getGranuleTemplateArray(),// constraints we just setup
-                        name(),// aggvar name
-                        const_cast<AggMemberDataset&>(*pCurrDataset),// Dataset who's DDS should be searched
-                        getArrayGetterInterface(), DEBUG_CHANNEL);
-#endif
+            loadedGranules.touch(const_cast<AggMemberDataset&>(*pCurrDataset));
+            Array* pDatasetArray = AggregationUtil::readDatasetArrayDataForAggregation(getGranuleTemplateArray(),
+                name(), const_cast<AggMemberDataset&>(*pCurrDataset), getArrayGetterInterface(), DEBUG_CHANNEL);
 
-                    Array* pDatasetArray = AggregationUtil::readDatasetArrayDataForAggregation(
-                        getGranuleTemplateArray(), name(), const_cast<AggMemberDataset&>(*pCurrDataset),
-                        getArrayGetterInterface(), DEBUG_CHANNEL);
-#if USE_LOCAL_TIMEOUT_SCHEME
-                    dds.timeout_off();
-#endif
+            if (d4m) {
+                putD4VectorPart(*d4m, *pDatasetArray);
+            }
+            else {
+                m->put_vector_part(pDatasetArray->get_buf(), getGranuleTemplateArray().length(), var()->width(),
+                    var()->type());
+            }
 
-#if PIPELINING
-                    m.put_vector_part(pDatasetArray->get_buf(), getGranuleTemplateArray().length(), var()->width(),
-                        var()->type());
-#else
-                    this->set_value_slice_from_row_major_vector(*pDatasetArray, nextOutputBufferElementIndex);
-#endif
+            if (fillCoordCache) {
+                const char* pBuf = pDatasetArray->get_buf();
+                coordValues.insert(coordValues.end(), pBuf,
+                    pBuf + getGranuleTemplateArray().length() * var()->width());
+            }
+
+            pDatasetArray->clear_local_data();
+
+            // Read the other variables' slices while this granule is loaded.
+            batchReader.stageOthers(granuleRead.datasetIndex);
+            readAhead.setConsumed(granuleNum);
+
+            BESDEBUG_FUNC(DEBUG_CHANNEL,
+                " The granule index " << granuleRead.datasetIndex << " was read with constraints and sent to the output." << endl);
+        } // for loop over plan
+    } // end of try
+    catch (AggregationException& ex) {
+        THROW_NCML_PARSE_ERROR(-1, ex.what());
+    }
 
-                    pDatasetArray->clear_local_data();
+    if (fillCoordCache && coordValues.size() == static_cast<unsigned int>(length()) * var()->width()) {
+        GranuleDataCache::get_instance()->put(coordCacheKey, &coordValues[0], coordValues.size());
+    }
 
-                    // Jump output buffer index forward by the amount we added.
-                    nextOutputBufferElementIndex += getGranuleTemplateArray().length();
-                    currDatasetWasRead = true;
+    endBatchStaging();
+    _batchReads.clear();
+}
+
+bool ArrayJoinExistingAggregation::getCoordinateValuesFromCache(std::vector<char>& constrainedValues,
+    std::string& cacheKey)
+{
+    cacheKey.clear();
 
-                    BESDEBUG_FUNC(DEBUG_CHANNEL,
-                        " The granule index " << currDatasetIndex << " was read with constraints and copied into the aggregation output." << endl);
-                } // !currDatasetWasRead
-            } // for loop over outerDim
-        } // end of try
-        catch (AggregationException& ex) {
-            THROW_NCML_PARSE_ERROR(-1, ex.what());
+    // Only the 1D coordinate variable (or Grid map) of the join dim.
+    if (dimensions() != 1 || name() != _joinDim.name) {
+        return false;
+    }
+
+    // Only a whole read fills the entry, and the key costs a stat of every granule.
+    // A constraint that skips some of them is cheaper to read than to look up.
+    const Array::dimension& outerDim = *(dim_begin());
+    if (!isOuterDimUnconstrained()) {
+        const JoinExistingReadPlan plan(getGranuleOffsets(), outerDim.start, outerDim.stride,
+            std::min(outerDim.stop, outerDim.size - 1));
+        if (plan.size() < getDatasetList().size()) {
+            return false;
         }
+    }
 
-        // *** end of code inserted from readConstrainedGranuleArraysAndAggregateDataHook
+    GranuleDataCache* pCache = GranuleDataCache::get_instance();
+    if (!pCache) {
+        return false;
+    }
 
-#if PIPELINING
-        m.put_vector_end();
-        status = true;
-#else
-        set_read_p(true);
-        status = libdap::Array::serialize(eval, dds, m, ce_eval);
-#endif
+    // Once per request is enough, the granules won't change under us.
+    if (!_coordCacheKeyMade) {
+        _coordCacheKeyMade = true;
+        if (!pCache->makeAggregationKey(getDatasetList(), name(), *this, _coordCacheKey)) {
+            _coordCacheKey.clear();
+        }
     }
-    else {
-        status = libdap::Array::serialize(eval, dds, m, ce_eval);
+    if (_coordCacheKey.empty()) {
+        return false;
     }
+    cacheKey = _coordCacheKey;
 
-    return status;
+    std::vector<char> allValues;
+    unsigned int width = var()->width();
+    if (!pCache->get(cacheKey, allValues) || allValues.size() != static_cast<unsigned int>(outerDim.size) * width) {
+        return false;
+    }
+
+    constrainedValues.clear();
+    constrainedValues.reserve(length() * width);
+    for (int i = outerDim.start; i <= outerDim.stop && i < outerDim.size; i += outerDim.stride) {
+        constrainedValues.insert(constrainedValues.end(), allValues.begin() + i * width,
+            allValues.begin() + (i + 1) * width);
+    }
+
+    BESDEBUG_FUNC(DEBUG_CHANNEL, "Coordinate variable " << name() << " came from the cache, no granules read." << endl);
+    return true;
+}
+
+bool ArrayJoinExistingAggregation::isOuterDimUnconstrained()
+{
+    const Array::dimension& outerDim = *(dim_begin());
+    return outerDim.start == 0 && outerDim.stride == 1 && outerDim.stop == outerDim.size - 1;
 }
 
-/////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Private Impl Below
 
 void ArrayJoinExistingAggregation::duplicate(const ArrayJoinExistingAggregation& rhs)
 {
     _joinDim = rhs._joinDim;
+    _granuleOffsets = rhs._granuleOffsets;
 }
 
 void ArrayJoinExistingAggregation::cleanup() throw ()
 {
+    _granuleOffsets.clear();
+    _batchReads.clear();
+    _coordCacheKey.clear();
+    _coordCacheKeyMade = false;
+}
+
+const std::vector<unsigned int>&
+ArrayJoinExistingAggregation::getGranuleOffsets()
+{
+    // Dimension cache is complete by the time we're read, so one pass is enough.
+    if (_granuleOffsets.empty()) {
+        JoinExistingReadPlan::buildGranuleOffsets(getDatasetList(), _joinDim.name, _granuleOffsets);
+    }
+    return _granuleOffsets;
+}
+
+void ArrayJoinExistingAggregation::setGranuleTemplateOuterConstraint(const JoinExistingReadPlan::GranuleRead& granuleRead)
+{
+    Array& granuleConstraintTemplate = getGranuleTemplateArray();
+
+    // The inner dim constraints were set up in the containing read() call.
+    // The outer dim was left open for us to fix now...
+    Array::Dim_iter outerDimIt = granuleConstraintTemplate.dim_begin();
+
+    // modify the outerdim size to match the dataset we need to
+    // load.  The inners MUST match so we can let those get
+    //checked later...
+    outerDimIt->size = granuleRead.granuleSize;
+    outerDimIt->c_size = granuleRead.granuleSize; // this will get recalc below
+
+    // The plan already clamped stride and stop into this granule.
+    granuleConstraintTemplate.add_constraint(outerDimIt, granuleRead.localStart, granuleRead.localStride,
+        granuleRead.localStop);
+}
+
+/* virtual */
+bool ArrayJoinExistingAggregation::setGranuleTemplateConstraintsForDatasetHook(unsigned int datasetIndex)
+{
+    // Planned once per batch, we get asked about every granule of the leader.
+    if (_batchReads.empty()) {
+        const Array::dimension& outerDim = *(dim_begin());
+        const JoinExistingReadPlan plan(getGranuleOffsets(), outerDim.start, outerDim.stride,
+            std::min(outerDim.stop, outerDim.size - 1));
+        for (JoinExistingReadPlan::const_iterator it = plan.begin(); it != plan.end(); ++it) {
+            _batchReads.insert(std::make_pair(it->datasetIndex, *it));
+        }
+    }
+
+    std::map<unsigned int, JoinExistingReadPlan::GranuleRead>::const_iterator found = _batchReads.find(datasetIndex);
+    if (found == _batchReads.end()) {
+        return false;
+    }
+    setGranuleTemplateOuterConstraint(found->second);
+    return true;
 }
 
 /* virtual */
@@ -333,101 +482,62 @@ void ArrayJoinExistingAggregation::readConstrainedGranuleArraysAndAggregateDataH
     BESDEBUG("ncml",
         "Aggregating datasets array with outer dimension constraints: " << " start=" << outerDim.start << " stride=" << outerDim.stride << " stop=" << outerDim.stop << endl);
 
+    std::vector<char> coordValues;
+    std::string coordCacheKey;
+    if (getCoordinateValuesFromCache(coordValues, coordCacheKey)) {
+        reserve_value_capacity();
+        val2buf(&coordValues[0]);
+        return;
+    }
+
     try {
         // assumes the constraints are already set properly on this
         reserve_value_capacity();
 
-        // Start the iteration state for the granule.
         const AMDList& datasets = getDatasetList(); // the list
         NCML_ASSERT(!datasets.empty());
-        int currDatasetIndex = 0; // index into datasets
-        const AggMemberDataset* pCurrDataset = (datasets[currDatasetIndex]).get();
-
-        int outerDimIndexOfCurrDatasetHead = 0;
-        int currDatasetSize = int(pCurrDataset->getCachedDimensionSize(_joinDim.name));
-        bool currDatasetWasRead = false;
+        const JoinExistingReadPlan plan(getGranuleOffsets(), outerDim.start, outerDim.stride,
+            std::min(outerDim.stop, outerDim.size - 1));
 
         // where in this output array we are writing next
         unsigned int nextOutputBufferElementIndex = 0;
 
-        // Traverse the outer dimension constraints,
-        // Keeping track of which dataset we need to
-        // be inside for the given values of the constraint.
-        for (int outerDimIndex = outerDim.start; outerDimIndex <= outerDim.stop && outerDimIndex < outerDim.size;
-            outerDimIndex += outerDim.stride) {
-            // Figure out where the given outer index maps into in local granule space
-            int localGranuleIndex = outerDimIndex - outerDimIndexOfCurrDatasetHead;
-
-            // if this is beyond the dataset end, move state to the next dataset
-            // and try again until we're in the proper interval, with proper dataset.
-            while (localGranuleIndex >= currDatasetSize) {
-                localGranuleIndex -= currDatasetSize;
-                outerDimIndexOfCurrDatasetHead += currDatasetSize;
-                ++currDatasetIndex;
-                NCML_ASSERT(currDatasetIndex < int(datasets.size()));
-                pCurrDataset = datasets[currDatasetIndex].get();
-                currDatasetSize = pCurrDataset->getCachedDimensionSize(_joinDim.name);
-                currDatasetWasRead = false;
-
-                BESDEBUG_FUNC(DEBUG_CHANNEL,
-                    "The constraint traversal passed a granule boundary " << "on the outer dimension and is stepping forward into " << "granule index=" << currDatasetIndex << endl);
-            }
+        LoadedGranuleLRU loadedGranules(LoadedGranuleLRU::getMaxLoadedGranulesFromConfig());
+
+        for (JoinExistingReadPlan::const_iterator it = plan.begin(); it != plan.end(); ++it) {
+            const AggMemberDataset* pCurrDataset = datasets[it->datasetIndex].get();
+
+            // Map constraints into the local granule space.
+            setGranuleTemplateOuterConstraint(*it);
 
-            // If we haven't read in this granule yet (we passed a boundary)
-            // then do it now.  Map constraints into the local granule space.
-            if (!currDatasetWasRead) {
-                BESDEBUG_FUNC(DEBUG_CHANNEL,
-                    " Current granule dataset was traversed but not yet " "read and copied into output.  Mapping constraints " "and calling read()..." << endl);
-
-                // Set up a constraint object for the actual granule read
-                // so that it only loads the data values in which we are
-                // interested.
-                Array& granuleConstraintTemplate = getGranuleTemplateArray();
-
-                // The inner dim constraints were set up in the containing read() call.
-                // The outer dim was left open for us to fix now...
-                Array::Dim_iter outerDimIt = granuleConstraintTemplate.dim_begin();
-
-                // modify the outerdim size to match the dataset we need to
-                // load.  The inners MUST match so we can let those get
-                //checked later...
-                outerDimIt->size = currDatasetSize;
-                outerDimIt->c_size = currDatasetSize; // this will get recalc below?
-
-                // find the mapped endpoint
-                // Basically, the fullspace endpoint mapped to local offset,
-                // clamped into the local granule size.
-                int granuleStopIndex = std::min(outerDim.stop - outerDimIndexOfCurrDatasetHead, currDatasetSize - 1);
-
-                // we must clamp the stride to the interval of the
-                // dataset in order to avoid an exception in
-                // add_constraint on stride being larger than dataset.
-                int clampedStride = std::min(outerDim.stride, currDatasetSize);
-                // mapped endpoint clamped within this granule
-                granuleConstraintTemplate.add_constraint(outerDimIt, localGranuleIndex, clampedStride, granuleStopIndex);
-
-                // Do the constrained read and copy it into this output buffer
-                agg_util::AggregationUtil::addDatasetArrayDataToAggregationOutputArray(*this, // into the output buffer of this object
-                    nextOutputBufferElementIndex, // into the next open slice
-                    getGranuleTemplateArray(), // constraints we just setup
-                    name(), // aggvar name
-                    const_cast<AggMemberDataset&>(*pCurrDataset), // Dataset who's DDS should be searched
-                    getArrayGetterInterface(), DEBUG_CHANNEL);
-
-                // Jump output buffer index forward by the amount we added.
-                nextOutputBufferElementIndex += getGranuleTemplateArray().length();
-                currDatasetWasRead = true;
-
-                BESDEBUG_FUNC(DEBUG_CHANNEL,
-                    " The granule index " << currDatasetIndex << " was read with constraints and copied into the aggregation output." << endl);
-            } // !currDatasetWasRead
-        } // for loop over outerDim
+            // Do the constrained read and copy it into this output buffer
+            loadedGranules.touch(const_cast<AggMemberDataset&>(*pCurrDataset));
+            agg_util::AggregationUtil::addDatasetArrayDataToAggregationOutputArray(*this, // into the output buffer of this object
+                nextOutputBufferElementIndex, // into the next open slice
+                getGranuleTemplateArray(), // constraints we just setup
+                name(), // aggvar name
+                const_cast<AggMemberDataset&>(*pCurrDataset), // Dataset who's DDS should be searched
+                getArrayGetterInterface(), DEBUG_CHANNEL);
+
+            // Jump output buffer index forward by the amount we added.
+            nextOutputBufferElementIndex += getGranuleTemplateArray().length();
+
+            BESDEBUG_FUNC(DEBUG_CHANNEL,
+                " The granule index " << it->datasetIndex << " was read with constraints and copied into the aggregation output." << endl);
+        } // for loop over plan
     } // try
 
     catch (AggregationException& ex) {
         THROW_NCML_PARSE_ERROR(-1, ex.what());
     }
 
+    // In case we were batch staged, that plan is done with.
+    _batchReads.clear();
+
+    if (!coordCacheKey.empty() && isOuterDimUnconstrained()) {
+        GranuleDataCache::get_instance()->put(coordCacheKey, get_buf(),
+            static_cast<unsigned long long>(length()) * var()->width());
+    }
 }
 
 } // namespace agg_util
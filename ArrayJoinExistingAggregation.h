@@ -32,14 +32,19 @@
 #include "AggMemberDataset.h" // agg_util
 #include "ArrayAggregationBase.h" // agg_util
 #include "Dimension.h" // agg_util
+#include "JoinExistingReadPlan.h" // agg_util
+#include <map> // std
 
 namespace libdap {
     class ConstraintEvaluator;
     class DDS;
     class Marshaller;
+    class D4StreamMarshaller;
+    class DMR;
 }
 
 namespace agg_util {
+class AggregationBatchReader;
 
 class ArrayJoinExistingAggregation: public ArrayAggregationBase {
 public:
@@ -77,6 +82,15 @@ public:
     virtual ArrayJoinExistingAggregation* ptr_duplicate();
 
     virtual bool serialize(libdap::ConstraintEvaluator &eval, libdap::DDS &dds, libdap::Marshaller &m, bool ce_eval);
+    virtual void serialize(libdap::D4StreamMarshaller &m, libdap::DMR &dmr, bool filter = false);
+
+    /**
+     * If this is the coordinate variable of the join dim and the
+     * GranuleDataCache is on, make sure the whole of it is in the cache,
+     * reading it from the granules if it isn't.  Used by cacheAgg.
+     * @return whether this variable is in the cache now.
+     */
+    bool fillCoordinateCache();
 
 protected:
     // Subclass Interface
@@ -90,6 +104,10 @@ protected:
      * and respecting constraints on the outer dimension */
     virtual void readConstrainedGranuleArraysAndAggregateDataHook();
 
+    /** Selects datasetIndex if the read plan for the constraints on the
+     * join dim touches it, setting the template's outer dim to match. */
+    virtual bool setGranuleTemplateConstraintsForDatasetHook(unsigned int datasetIndex);
+
 private:
     // helpers
 
@@ -99,12 +117,47 @@ private:
     /** Clear any state from this */
     void cleanup() throw ();
 
+    /** The prefix sum of the granule sizes on the join dim, built on first use.
+     * @see JoinExistingReadPlan::buildGranuleOffsets() */
+    const std::vector<unsigned int>& getGranuleOffsets();
+
+    /** Set the outer dim of the granule template to the size and local
+     * constraint of the given granule read. */
+    void setGranuleTemplateOuterConstraint(const JoinExistingReadPlan::GranuleRead& granuleRead);
+
+    /**
+     * If this is the coordinate variable of the join dim and the whole of
+     * it is in the GranuleDataCache, copy the part our constraint selects
+     * into constrainedValues and return true. Otherwise, if it could be
+     * cached, set cacheKey to its key. A constrained read that doesn't
+     * touch every granule skips the cache and leaves cacheKey empty.
+     */
+    bool getCoordinateValuesFromCache(std::vector<char>& constrainedValues, std::string& cacheKey);
+
+    /** Whether the constraint on the join dim selects all of it. */
+    bool isOuterDimUnconstrained();
+
+    /** The read and stream loop shared by the DAP2 and DAP4 serialize() */
+    void streamConstrainedGranules(libdap::Marshaller* m, libdap::D4StreamMarshaller* d4m,
+        AggregationBatchReader& batchReader);
+
     /////////////////////////////////////////////////////////////////////////////
     // Data Rep
 
     /** The (outer) dimension we will be joining along,
      *  with post-aggregation cardinality. */
     agg_util::Dimension _joinDim;
+
+    /** Cache of getGranuleOffsets() */
+    std::vector<unsigned int> _granuleOffsets;
+
+    /** The plan for our constraints by dataset index while being batch staged. Not copied. */
+    std::map<unsigned int, JoinExistingReadPlan::GranuleRead> _batchReads;
+
+    /** The GranuleDataCache key of this coordinate variable, made on first use.
+     * Not copied, so a DDS that outlives the request doesn't keep a stale one. */
+    std::string _coordCacheKey;
+    bool _coordCacheKeyMade;
 };
 
 }
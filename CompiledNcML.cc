@@ -0,0 +1,722 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+#include "config.h"
+
+#include "CompiledNcML.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "BESDebug.h"
+#include "BESInternalError.h"
+#include "BESStopWatch.h"
+#include "TheBESKeys.h"
+
+#include "NCMLDebug.h"
+#include "SaxParser.h"
+#include "SaxParserWrapper.h"
+#include "XMLHelpers.h"
+
+using namespace std;
+
+namespace ncml_module {
+
+const string CompiledNcML::CACHE_DIR_KEY = "NCML.CompiledCache.directory";
+const string CompiledNcML::SIZE_KEY = "NCML.CompiledCache.size";
+
+// Compiled file layout (native byte order, it never leaves the host):
+//   char[8] COMPILED_MAGIC
+//   int64   NcML file mtime, int64 size, int64 inode
+//   uint32  NcML file name length, name bytes
+//   events, each: uint8 EventType, varint line number, then
+//     START_ELEMENT_NS: localname, prefix, uri, varint attribute count,
+//                       per attribute: localname, prefix, uri, value
+//                       varint namespace count, per namespace: prefix, uri
+//     END_ELEMENT_NS:   localname, prefix, uri
+//     START_ELEMENT:    name, varint attribute count, per attribute: localname, value
+//     END_ELEMENT:      name
+//     CHARACTERS:       varint length, bytes
+//     WARNING:          varint length, bytes
+//   uint8 EV_END_OF_STREAM, which must be the last byte.
+//
+// Names and attribute values are interned: a varint id of a string seen before,
+// or the next unused id followed by varint length and bytes the first time.
+// Varints are unsigned LEB128.
+static const char COMPILED_MAGIC[8] = { 'N', 'C', 'M', 'L', 'S', 'A', 'X', '1' };
+static const string COMPILED_FILE_PREFIX = "ncml_";
+static const string COMPILED_FILE_SUFFIX = ".ncmlc";
+
+// Flattened NcML paths longer than this are shortened to a hash of the
+// whole path and its tail, leaving room under NAME_MAX for the prefix,
+// suffix and the ".tmp.<pid>" of the file being written.
+static const string::size_type MAX_FLAT_NAME_LENGTH = 200;
+static const string::size_type HASHED_NAME_TAIL_LENGTH = 100;
+
+// Default bound on the size of the compiled files, in megabytes
+static const unsigned long long DEFAULT_CACHE_SIZE_MB = 100;
+// A purge removes the least recently used files until they fit in this
+// fraction of the bound, so it doesn't run again on the next write.
+static const double PURGE_TO_FRACTION = 0.8;
+
+namespace {
+
+enum EventType {
+    EV_END_OF_STREAM = 0,
+    EV_START_DOCUMENT,
+    EV_END_DOCUMENT,
+    EV_START_ELEMENT,
+    EV_END_ELEMENT,
+    EV_START_ELEMENT_NS,
+    EV_END_ELEMENT_NS,
+    EV_CHARACTERS,
+    EV_WARNING
+};
+
+/** The header fields that tie a compiled file to its NcML file. */
+struct SourceStamp {
+    int64_t mtime;
+    int64_t size;
+    int64_t inode;
+};
+
+/**
+ * SaxParser that passes every call on to another one and appends it to
+ * the compiled form.
+ */
+class SaxEventRecorder: public SaxParser {
+public:
+    explicit SaxEventRecorder(SaxParser& target) :
+        _target(target), _line(-1)
+    {
+    }
+
+    virtual ~SaxEventRecorder()
+    {
+    }
+
+    const string& getEvents() const
+    {
+        return _events;
+    }
+
+    virtual void onStartDocument()
+    {
+        _target.onStartDocument();
+        beginEvent(EV_START_DOCUMENT);
+    }
+
+    virtual void onEndDocument()
+    {
+        _target.onEndDocument();
+        beginEvent(EV_END_DOCUMENT);
+    }
+
+    virtual void onStartElement(const string& name, const XMLAttributeMap& attrs)
+    {
+        _target.onStartElement(name, attrs);
+        beginEvent(EV_START_ELEMENT);
+        writeInterned(name);
+        writeVarint(std::distance(attrs.begin(), attrs.end()));
+        for (XMLAttributeMap::const_iterator it = attrs.begin(); it != attrs.end(); ++it) {
+            writeInterned(it->localname);
+            writeInterned(it->value);
+        }
+    }
+
+    virtual void onEndElement(const string& name)
+    {
+        _target.onEndElement(name);
+        beginEvent(EV_END_ELEMENT);
+        writeInterned(name);
+    }
+
+    virtual void onStartElementWithNamespace(const string& localname, const string& prefix, const string& uri,
+        const XMLAttributeMap& attributes, const XMLNamespaceMap& namespaces)
+    {
+        _target.onStartElementWithNamespace(localname, prefix, uri, attributes, namespaces);
+        beginEvent(EV_START_ELEMENT_NS);
+        writeInterned(localname);
+        writeInterned(prefix);
+        writeInterned(uri);
+        writeVarint(std::distance(attributes.begin(), attributes.end()));
+        for (XMLAttributeMap::const_iterator it = attributes.begin(); it != attributes.end(); ++it) {
+            writeInterned(it->localname);
+            writeInterned(it->prefix);
+            writeInterned(it->nsURI);
+            writeInterned(it->value);
+        }
+        writeVarint(std::distance(namespaces.begin(), namespaces.end()));
+        for (XMLNamespaceMap::const_iterator it = namespaces.begin(); it != namespaces.end(); ++it) {
+            writeInterned(it->prefix);
+            writeInterned(it->uri);
+        }
+    }
+
+    virtual void onEndElementWithNamespace(const string& localname, const string& prefix, const string& uri)
+    {
+        _target.onEndElementWithNamespace(localname, prefix, uri);
+        beginEvent(EV_END_ELEMENT_NS);
+        writeInterned(localname);
+        writeInterned(prefix);
+        writeInterned(uri);
+    }
+
+    virtual void onCharacters(const string& content)
+    {
+        _target.onCharacters(content);
+        beginEvent(EV_CHARACTERS);
+        writeRaw(content);
+    }
+
+    virtual void onParseWarning(string msg)
+    {
+        _target.onParseWarning(msg);
+        beginEvent(EV_WARNING);
+        writeRaw(msg);
+    }
+
+    virtual void onParseError(string msg)
+    {
+        // Always throws, and a failed parse is never saved.
+        _target.onParseError(msg);
+    }
+
+    virtual void setParseLineNumber(int line)
+    {
+        _target.setParseLineNumber(line);
+        _line = line;
+    }
+
+private:
+    void beginEvent(EventType type)
+    {
+        _events += static_cast<char>(type);
+        // Line is -1 until libxml reports one, store it off by one.
+        writeVarint(static_cast<uint32_t>(_line + 1));
+    }
+
+    void writeVarint(uint32_t value)
+    {
+        while (value >= 0x80) {
+            _events += static_cast<char>((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        _events += static_cast<char>(value);
+    }
+
+    void writeRaw(const string& s)
+    {
+        writeVarint(s.size());
+        _events.append(s);
+    }
+
+    void writeInterned(const string& s)
+    {
+        std::map<string, uint32_t>::const_iterator it = _stringIds.find(s);
+        if (it != _stringIds.end()) {
+            writeVarint(it->second);
+        }
+        else {
+            uint32_t id = _stringIds.size();
+            _stringIds.insert(std::make_pair(s, id));
+            writeVarint(id);
+            writeRaw(s);
+        }
+    }
+
+    SaxParser& _target;
+    int _line;
+    string _events;
+    std::map<string, uint32_t> _stringIds;
+};
+
+/**
+ * Decodes the events of a compiled file and issues them to a SaxParser.
+ */
+class SaxEventReplayer {
+public:
+    SaxEventReplayer(const char* data, size_t size) :
+        _pos(data), _end(data + size)
+    {
+    }
+
+    /** @return false if the data ran out or is malformed. Callbacks issued
+     * before that point have been issued. */
+    bool replay(SaxParser& parser)
+    {
+        XMLAttributeMap attrs;
+        XMLNamespaceMap namespaces;
+        string name, prefix, uri;
+
+        while (_pos < _end) {
+            EventType type = static_cast<EventType>(*_pos++);
+            if (type == EV_END_OF_STREAM) {
+                return _pos == _end;
+            }
+
+            uint32_t line;
+            if (!readVarint(line)) {
+                return false;
+            }
+            parser.setParseLineNumber(static_cast<int>(line) - 1);
+
+            switch (type) {
+            case EV_START_DOCUMENT:
+                parser.onStartDocument();
+                break;
+
+            case EV_END_DOCUMENT:
+                parser.onEndDocument();
+                break;
+
+            case EV_START_ELEMENT: {
+                uint32_t numAttrs;
+                if (!(readInterned(name) && readVarint(numAttrs))) return false;
+                attrs.clear();
+                for (uint32_t i = 0; i < numAttrs; ++i) {
+                    XMLAttribute attr;
+                    if (!(readInterned(attr.localname) && readInterned(attr.value))) return false;
+                    attrs.addAttribute(attr);
+                }
+                parser.onStartElement(name, attrs);
+                break;
+            }
+
+            case EV_END_ELEMENT:
+                if (!readInterned(name)) return false;
+                parser.onEndElement(name);
+                break;
+
+            case EV_START_ELEMENT_NS: {
+                uint32_t count;
+                if (!(readInterned(name) && readInterned(prefix) && readInterned(uri) && readVarint(count))) return false;
+                attrs.clear();
+                for (uint32_t i = 0; i < count; ++i) {
+                    XMLAttribute attr;
+                    if (!(readInterned(attr.localname) && readInterned(attr.prefix) && readInterned(attr.nsURI)
+                        && readInterned(attr.value))) return false;
+                    attrs.addAttribute(attr);
+                }
+                if (!readVarint(count)) return false;
+                namespaces.clear();
+                for (uint32_t i = 0; i < count; ++i) {
+                    XMLNamespace ns;
+                    if (!(readInterned(ns.prefix) && readInterned(ns.uri))) return false;
+                    namespaces.addNamespace(ns);
+                }
+                parser.onStartElementWithNamespace(name, prefix, uri, attrs, namespaces);
+                break;
+            }
+
+            case EV_END_ELEMENT_NS:
+                if (!(readInterned(name) && readInterned(prefix) && readInterned(uri))) return false;
+                parser.onEndElementWithNamespace(name, prefix, uri);
+                break;
+
+            case EV_CHARACTERS:
+                if (!readRaw(name)) return false;
+                parser.onCharacters(name);
+                break;
+
+            case EV_WARNING:
+                if (!readRaw(name)) return false;
+                parser.onParseWarning(name);
+                break;
+
+            default:
+                return false;
+            }
+        }
+
+        // Ran off the end without EV_END_OF_STREAM
+        return false;
+    }
+
+private:
+    bool readVarint(uint32_t& value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 35 && _pos < _end; shift += 7) {
+            unsigned char c = static_cast<unsigned char>(*_pos++);
+            value |= static_cast<uint32_t>(c & 0x7F) << shift;
+            if (!(c & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool readRaw(string& dest)
+    {
+        uint32_t len;
+        if (!readVarint(len) || static_cast<size_t>(_end - _pos) < len) {
+            return false;
+        }
+        dest.assign(_pos, len);
+        _pos += len;
+        return true;
+    }
+
+    bool readInterned(string& dest)
+    {
+        uint32_t id;
+        if (!readVarint(id)) {
+            return false;
+        }
+        if (id < _strings.size()) {
+            dest = _strings[id];
+            return true;
+        }
+        // A new string must take the next id.
+        if (id != _strings.size() || !readRaw(dest)) {
+            return false;
+        }
+        _strings.push_back(dest);
+        return true;
+    }
+
+    const char* _pos;
+    const char* _end;
+    vector<string> _strings;
+};
+
+void makeStamp(const struct stat& buf, SourceStamp& stamp)
+{
+    stamp.mtime = buf.st_mtime;
+    stamp.size = buf.st_size;
+    stamp.inode = buf.st_ino;
+}
+
+/**
+ * If compiledFileName was compiled from ncmlFilename as it is now (stamp),
+ * replay it into parser.
+ * @return false if the file is missing, out of date or malformed and no
+ * callbacks were issued.
+ * @throws BESInternalError if the events themselves turn out to be
+ * malformed after some were issued, or anything parser throws.
+ */
+bool replayCompiledFile(const string& compiledFileName, const string& ncmlFilename, const SourceStamp& stamp,
+    SaxParser& parser)
+{
+    int fd = open(compiledFileName.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat buf;
+    if (fstat(fd, &buf) != 0 || buf.st_size < static_cast<off_t>(sizeof(COMPILED_MAGIC) + sizeof(SourceStamp))) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = buf.st_size;
+    void* mapped = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+
+    const char* data = static_cast<const char*>(mapped);
+    const char* end = data + size;
+    const char* pos = data;
+
+    SourceStamp fileStamp;
+    uint32_t nameLen = 0;
+    bool current = memcmp(pos, COMPILED_MAGIC, sizeof(COMPILED_MAGIC)) == 0;
+    pos += sizeof(COMPILED_MAGIC);
+    if (current) {
+        memcpy(&fileStamp, pos, sizeof(fileStamp));
+        pos += sizeof(fileStamp);
+        current = fileStamp.mtime == stamp.mtime && fileStamp.size == stamp.size && fileStamp.inode == stamp.inode;
+    }
+    if (current && static_cast<size_t>(end - pos) >= sizeof(nameLen)) {
+        memcpy(&nameLen, pos, sizeof(nameLen));
+        pos += sizeof(nameLen);
+        current = static_cast<size_t>(end - pos) > nameLen && ncmlFilename.compare(0, string::npos, pos, nameLen) == 0
+            && *(end - 1) == EV_END_OF_STREAM;
+        pos += nameLen;
+    }
+    else {
+        current = false;
+    }
+
+    if (!current) {
+        munmap(mapped, size);
+        BESDEBUG("ncml", "CompiledNcML: " << compiledFileName << " is out of date, recompiling." << endl);
+        return false;
+    }
+
+    bool ok;
+    try {
+        SaxEventReplayer replayer(pos, end - pos);
+        ok = replayer.replay(parser);
+    }
+    catch (...) {
+        munmap(mapped, size);
+        throw;
+    }
+    munmap(mapped, size);
+
+    if (!ok) {
+        // Not much we can do once the parser has seen part of it.
+        unlink(compiledFileName.c_str());
+        THROW_NCML_INTERNAL_ERROR("CompiledNcML: malformed compiled file " + compiledFileName
+            + " was removed, please retry the request.");
+    }
+    BESDEBUG("ncml", "CompiledNcML: replayed " << compiledFileName << endl);
+    return true;
+}
+
+/**
+ * @return true if compiledFileName was written.
+ */
+bool writeCompiledFile(const string& compiledFileName, const string& ncmlFilename, const SourceStamp& stamp,
+    const string& events)
+{
+    std::ostringstream tmp;
+    tmp << compiledFileName << ".tmp." << getpid();
+    string tmpFileName = tmp.str();
+
+    ofstream ostrm(tmpFileName.c_str(), ios::out | ios::binary | ios::trunc);
+    if (!ostrm) {
+        BESDEBUG("ncml", "CompiledNcML: Could not open " << tmpFileName << ", not saving compiled form." << endl);
+        return false;
+    }
+
+    ostrm.write(COMPILED_MAGIC, sizeof(COMPILED_MAGIC));
+    ostrm.write(reinterpret_cast<const char*>(&stamp), sizeof(stamp));
+    uint32_t nameLen = ncmlFilename.size();
+    ostrm.write(reinterpret_cast<const char*>(&nameLen), sizeof(nameLen));
+    ostrm.write(ncmlFilename.data(), nameLen);
+    ostrm.write(events.data(), events.size());
+    ostrm.put(static_cast<char>(EV_END_OF_STREAM));
+
+    ostrm.close();
+    if (!ostrm || rename(tmpFileName.c_str(), compiledFileName.c_str()) != 0) {
+        BESDEBUG("ncml", "CompiledNcML: Failed to write " << compiledFileName << ": " << strerror(errno) << endl);
+        unlink(tmpFileName.c_str());
+        return false;
+    }
+    return true;
+}
+
+// FNV-1a, as GranuleDataCache uses for its file names.
+string hashName(const string& name)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (string::size_type i = 0; i < name.size(); ++i) {
+        hash ^= static_cast<unsigned char>(name[i]);
+        hash *= 1099511628211ULL;
+    }
+
+    std::ostringstream oss;
+    oss << std::hex << hash;
+    return oss.str();
+}
+
+struct CompiledFileInfo {
+    string path;
+    time_t lastUsed;
+    off_t size;
+
+    bool operator<(const CompiledFileInfo& rhs) const
+    {
+        return lastUsed < rhs.lastUsed;
+    }
+};
+
+} // namespace
+
+void CompiledNcML::parse(const string& ncmlFilename, SaxParser& parser)
+{
+    string cacheDir = getCacheDirFromConfig();
+    struct stat buf;
+    if (cacheDir.empty() || stat(ncmlFilename.c_str(), &buf) != 0) {
+        // Off, or let libxml report the missing file.
+        SaxParserWrapper wrapper(parser);
+        wrapper.parse(ncmlFilename);
+        return;
+    }
+
+    SourceStamp stamp;
+    makeStamp(buf, stamp);
+    string compiledFileName = getCompiledFileName(cacheDir, ncmlFilename);
+
+    {
+        BESStopWatch sw;
+        if (BESISDEBUG(TIMING_LOG)) sw.start("CompiledNcML::replay", compiledFileName);
+
+        if (replayCompiledFile(compiledFileName, ncmlFilename, stamp, parser)) {
+            return;
+        }
+    }
+
+    SaxEventRecorder recorder(parser);
+    SaxParserWrapper wrapper(recorder);
+    // Only keep it if libxml was happy with the whole document;
+    // a parser exception skips this too.
+    if (wrapper.parse(ncmlFilename) && writeCompiledFile(compiledFileName, ncmlFilename, stamp, recorder.getEvents())) {
+        purge(cacheDir, compiledFileName);
+    }
+}
+
+string CompiledNcML::getCacheDirFromConfig()
+{
+    bool found = false;
+    string dir;
+    TheBESKeys::TheKeys()->get_value(CACHE_DIR_KEY, dir, found);
+    if (!found) {
+        return "";
+    }
+
+    struct stat buf;
+    if (stat(dir.c_str(), &buf) != 0 || !S_ISDIR(buf.st_mode)) {
+        BESDEBUG("ncml", "CompiledNcML: " << CACHE_DIR_KEY << "=" << dir << " is not a directory, not compiling NcML." << endl);
+        return "";
+    }
+    return dir;
+}
+
+unsigned long long CompiledNcML::getCacheSizeFromConfig()
+{
+    bool found = false;
+    string value;
+    unsigned long long sizeInMegabytes = DEFAULT_CACHE_SIZE_MB;
+    TheBESKeys::TheKeys()->get_value(SIZE_KEY, value, found);
+    if (found) {
+        std::istringstream iss(value);
+        iss >> sizeInMegabytes;
+        if (iss.fail()) {
+            BESDEBUG("ncml", "CompiledNcML: ignoring bad value for " << SIZE_KEY << "=\"" << value << "\"" << endl);
+            sizeInMegabytes = DEFAULT_CACHE_SIZE_MB;
+        }
+    }
+    return sizeInMegabytes * 1024 * 1024;
+}
+
+string CompiledNcML::getCompiledFileName(const string& cacheDir, const string& ncmlFilename)
+{
+    // Same flattening of the path that BESFileLockingCache uses.
+    string name = ncmlFilename;
+    for (string::size_type i = 0; i < name.size(); ++i) {
+        if (name[i] == '/') {
+            name[i] = '#';
+        }
+    }
+
+    // Keep it a legal file name. The file records the NcML file name, so
+    // two paths with the same hash just recompile each other's file.
+    if (name.size() > MAX_FLAT_NAME_LENGTH) {
+        name = hashName(ncmlFilename) + "#" + name.substr(name.size() - HASHED_NAME_TAIL_LENGTH);
+    }
+
+    string path = cacheDir;
+    if (path.empty() || path[path.size() - 1] != '/') {
+        path += "/";
+    }
+    return path + COMPILED_FILE_PREFIX + name + COMPILED_FILE_SUFFIX;
+}
+
+void CompiledNcML::purge(const string& cacheDir, const string& keepFileName)
+{
+    unsigned long long maxBytes = getCacheSizeFromConfig();
+    if (maxBytes == 0) {
+        return;
+    }
+
+    DIR* dir = opendir(cacheDir.c_str());
+    if (!dir) {
+        return;
+    }
+
+    // Only our own, finished files: not another process's ".tmp.<pid>".
+    std::vector<CompiledFileInfo> files;
+    unsigned long long totalBytes = 0;
+    string dirPath = cacheDir;
+    if (dirPath.empty() || dirPath[dirPath.size() - 1] != '/') {
+        dirPath += "/";
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != 0) {
+        string name = entry->d_name;
+        if (name.size() <= COMPILED_FILE_PREFIX.size() + COMPILED_FILE_SUFFIX.size()
+            || name.compare(0, COMPILED_FILE_PREFIX.size(), COMPILED_FILE_PREFIX) != 0
+            || name.compare(name.size() - COMPILED_FILE_SUFFIX.size(), string::npos, COMPILED_FILE_SUFFIX) != 0) {
+            continue;
+        }
+
+        CompiledFileInfo info;
+        info.path = dirPath + name;
+        struct stat buf;
+        if (stat(info.path.c_str(), &buf) != 0 || !S_ISREG(buf.st_mode)) {
+            continue;
+        }
+        // Replaying a file reads it, so its access time is when it was last used.
+        info.lastUsed = std::max(buf.st_atime, buf.st_mtime);
+        info.size = buf.st_size;
+        totalBytes += buf.st_size;
+        files.push_back(info);
+    }
+    closedir(dir);
+
+    if (totalBytes <= maxBytes) {
+        return;
+    }
+
+    BESDEBUG("ncml", "CompiledNcML: " << totalBytes << " bytes of compiled files in " << cacheDir << " is over "
+        << SIZE_KEY << ", purging." << endl);
+
+    // A process replaying a file we remove keeps its mapping of it.
+    std::sort(files.begin(), files.end());
+    unsigned long long targetBytes = static_cast<unsigned long long>(maxBytes * PURGE_TO_FRACTION);
+    for (std::vector<CompiledFileInfo>::const_iterator it = files.begin(); it != files.end() && totalBytes > targetBytes;
+        ++it) {
+        if (it->path == keepFileName) {
+            continue;
+        }
+        if (unlink(it->path.c_str()) == 0) {
+            totalBytes -= it->size;
+        }
+    }
+}
+
+} // namespace ncml_module
@@ -0,0 +1,88 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef __NCML_MODULE__COMPILED_NCML_H__
+#define __NCML_MODULE__COMPILED_NCML_H__
+
+#include <string>
+
+namespace ncml_module {
+class SaxParser;
+}
+
+namespace ncml_module {
+
+/**
+ * @brief Compiled (binary SAX event stream) form of NcML files.
+ *
+ * The first parse of an NcML file runs libxml through SaxParserWrapper as
+ * always, but also records every callback the SaxParser gets (elements with
+ * their attributes and namespaces, characters, warnings, and the line number
+ * each was issued from) into a compact binary file in the directory named by
+ * CACHE_DIR_KEY. Later parses replay that file through the same callbacks,
+ * which skips libxml and the per-character string building entirely.
+ *
+ * The compiled file records the modification time, size and inode of the
+ * NcML file it came from, and is rebuilt when any of them changes.
+ * It is written to a temporary file and renamed into place, so concurrent
+ * BES processes never see a partial one. When the compiled files grow past
+ * SIZE_KEY the least recently used ones are removed.
+ *
+ * If CACHE_DIR_KEY is not set this is just SaxParserWrapper::parse().
+ */
+class CompiledNcML {
+public:
+    /** BES key for the directory of compiled NcML files. Unset turns them off. */
+    static const std::string CACHE_DIR_KEY;
+
+    /** BES key for the bound, in megabytes, on the size of the compiled files. 0 is no bound. */
+    static const std::string SIZE_KEY;
+
+    /**
+     * Issue the SAX callbacks for ncmlFilename to parser, from the compiled
+     * file if it is current and from libxml otherwise.
+     *
+     * @throws Whatever parser throws, as SaxParserWrapper::parse() does.
+     */
+    static void parse(const std::string& ncmlFilename, SaxParser& parser);
+
+private:
+    CompiledNcML(); // static class
+
+    static std::string getCacheDirFromConfig();
+    static unsigned long long getCacheSizeFromConfig();
+    static std::string getCompiledFileName(const std::string& cacheDir, const std::string& ncmlFilename);
+
+    /** Remove the least recently used compiled files, other than keepFileName,
+     * if they take up more than SIZE_KEY. */
+    static void purge(const std::string& cacheDir, const std::string& keepFileName);
+};
+
+}
+
+#endif /* __NCML_MODULE__COMPILED_NCML_H__ */
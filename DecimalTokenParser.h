@@ -0,0 +1,188 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2009 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef __NCML_MODULE__DECIMAL_TOKEN_PARSER_H__
+#define __NCML_MODULE__DECIMAL_TOKEN_PARSER_H__
+
+#include <cerrno>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <stdint.h>
+
+#include <dods-datatypes.h> // libdap
+
+// The in place parse ValuesElement uses for the numeric value tokens of
+// Arrays. Only tokens in plain decimal notation are read here; anything
+// else goes through the libdap check_*() and stream path, which decides
+// whether it is valid at all.
+
+namespace ncml_module {
+
+/** Parse a plain decimal integer [+-]?(0|[1-9][0-9]*) in [begin, end) into value
+ * if it is within the range of T.  Returns false for anything else, including leading
+ * zeros, which strtol() reads as octal in the libdap check_*() functions while
+ * operator>> reads them as decimal.
+ */
+template<typename T>
+bool parseDecimalInteger(const char* begin, const char* end, T& value)
+{
+    const char* c = begin;
+    bool negative = false;
+    if (c != end && (*c == '+' || *c == '-')) {
+        negative = (*c == '-');
+        ++c;
+    }
+    // Every type we handle fits in 10 digits, so more than that is left to the slow path
+    if (c == end || (end - c) > 10 || (*c == '0' && (c + 1) != end)) {
+        return false;
+    }
+
+    int64_t v = 0;
+    for (; c != end; ++c) {
+        if (*c < '0' || *c > '9') {
+            return false;
+        }
+        v = v * 10 + (*c - '0');
+    }
+    if (negative) {
+        v = -v;
+    }
+
+    if (v < static_cast<int64_t>(std::numeric_limits<T>::min())
+        || v > static_cast<int64_t>(std::numeric_limits<T>::max())) {
+        return false;
+    }
+    value = static_cast<T>(v);
+    return true;
+}
+
+/** Is [begin, end) a float in plain decimal notation: [+-]?digits[.digits][(e|E)[+-]?digits]
+ * with at least one mantissa digit?  This leaves nan, inf and hex floats to the slow path.
+ */
+inline bool isPlainDecimalFloat(const char* begin, const char* end)
+{
+    const char* c = begin;
+    if (c != end && (*c == '+' || *c == '-')) ++c;
+
+    int numDigits = 0;
+    for (; c != end && *c >= '0' && *c <= '9'; ++c)
+        ++numDigits;
+    if (c != end && *c == '.') {
+        for (++c; c != end && *c >= '0' && *c <= '9'; ++c)
+            ++numDigits;
+    }
+    if (numDigits == 0) {
+        return false;
+    }
+
+    if (c != end && (*c == 'e' || *c == 'E')) {
+        ++c;
+        if (c != end && (*c == '+' || *c == '-')) ++c;
+        if (c == end) {
+            return false;
+        }
+        for (; c != end && *c >= '0' && *c <= '9'; ++c)
+            ;
+    }
+    return c == end;
+}
+
+/** strtod() [begin, end), which must be followed by a character strtod() stops on,
+ * applying the same range test as libdap's check_float32() and check_float64().
+ */
+inline bool parseDecimalDouble(const char* begin, const char* end, double maxVal, double minVal, double& value)
+{
+    if (!isPlainDecimalFloat(begin, end)) {
+        return false;
+    }
+
+    char* parseEnd = 0;
+    errno = 0;
+    double v = strtod(begin, &parseEnd);
+    if (parseEnd != end || errno == ERANGE) {
+        return false;
+    }
+    double absVal = fabs(v);
+    if (absVal > maxVal || (absVal != 0.0 && absVal < minVal)) {
+        return false;
+    }
+    value = v;
+    return true;
+}
+
+/** Fast in place parse of a value token for each of the numeric types we stream.
+ * parse() returns false if the token has to go through the check and stream path instead.
+ */
+template<typename T> struct DecimalTokenParser {
+    static bool parse(const char* begin, const char* end, T& value)
+    {
+        return parseDecimalInteger(begin, end, value);
+    }
+};
+
+// The libdap unsigned checks reject a minus sign, even on zero.
+template<> struct DecimalTokenParser<libdap::dods_uint16> {
+    static bool parse(const char* begin, const char* end, libdap::dods_uint16& value)
+    {
+        return (*begin != '-') && parseDecimalInteger(begin, end, value);
+    }
+};
+
+template<> struct DecimalTokenParser<libdap::dods_uint32> {
+    static bool parse(const char* begin, const char* end, libdap::dods_uint32& value)
+    {
+        return (*begin != '-') && parseDecimalInteger(begin, end, value);
+    }
+};
+
+template<> struct DecimalTokenParser<libdap::dods_float32> {
+    static bool parse(const char* begin, const char* end, libdap::dods_float32& value)
+    {
+        // The range test is done on the double like check_float32(), but the value
+        // comes from strtof() like operator>>, so it is rounded just once.
+        double checked;
+        if (!parseDecimalDouble(begin, end, FLT_MAX, FLT_MIN, checked)) {
+            return false;
+        }
+        value = strtof(begin, 0);
+        return true;
+    }
+};
+
+template<> struct DecimalTokenParser<libdap::dods_float64> {
+    static bool parse(const char* begin, const char* end, libdap::dods_float64& value)
+    {
+        return parseDecimalDouble(begin, end, DBL_MAX, DBL_MIN, value);
+    }
+};
+
+} // namespace ncml_module
+
+#endif /* __NCML_MODULE__DECIMAL_TOKEN_PARSER_H__ */
@@ -0,0 +1,486 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+#include "config.h"
+
+#include "DecompressingReader.h"
+
+#include <bzlib.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdint.h>
+#include <vector>
+#include <zlib.h>
+
+#include "BESDebug.h"
+#include "BESSyntaxUserError.h"
+
+#include "NCMLDebug.h"
+
+using namespace std;
+
+namespace ncml_module {
+
+namespace {
+
+// The compressed side is read in chunks this big. The decompressed side is
+// whatever the caller asks read() for.
+const unsigned int COMPRESSED_BUFFER_SIZE = 64 * 1024;
+
+bool endsWith(const string& str, const string& suffix)
+{
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+void throwReadError(const string& filename, const string& why)
+{
+    THROW_NCML_PARSE_ERROR(-1, "Cannot parse: Unable to decompress " + filename + ": " + why);
+}
+
+FILE* openOrThrow(const string& filename)
+{
+    FILE* fp = fopen(filename.c_str(), "rb");
+    if (!fp) {
+        throwReadError(filename, strerror(errno));
+    }
+    return fp;
+}
+
+gzFile gzopenOrThrow(const string& filename)
+{
+    errno = 0;
+    gzFile file = gzopen(filename.c_str(), "rb");
+    if (!file) {
+        throwReadError(filename, errno ? strerror(errno) : "out of memory");
+    }
+    return file;
+}
+
+/** .gz, by way of zlib's gzFile, which also takes care of concatenated members. */
+class GzipReader: public DecompressingReader {
+public:
+    explicit GzipReader(const string& filename) :
+        DecompressingReader(filename), _file(gzopenOrThrow(filename))
+    {
+#if ZLIB_VERNUM >= 0x1240
+        gzbuffer(_file, COMPRESSED_BUFFER_SIZE);
+#endif
+    }
+
+    virtual ~GzipReader()
+    {
+        gzclose(_file);
+    }
+
+    virtual unsigned int read(char* buf, unsigned int len)
+    {
+        int bytesRead = gzread(_file, buf, len);
+        // gzread() reports a truncated file only through gzerror(), as Z_BUF_ERROR.
+        if (bytesRead < static_cast<int>(len)) {
+            int errnum = Z_OK;
+            const char* msg = gzerror(_file, &errnum);
+            if (errnum != Z_OK) {
+                // zlib puts the filename on the front of its messages, and so do we.
+                string why = (errnum == Z_ERRNO) ? strerror(errno) : msg;
+                const string prefix = _filename + ": ";
+                if (why.compare(0, prefix.size(), prefix) == 0) {
+                    why.erase(0, prefix.size());
+                }
+                throwReadError(_filename, why);
+            }
+        }
+        return static_cast<unsigned int>(bytesRead);
+    }
+
+private:
+    gzFile _file;
+};
+
+/** .bz2, by way of libbz2's stdio interface. Like bzip2 -d, it reads any
+ * streams concatenated after the first one as well. */
+class Bzip2Reader: public DecompressingReader {
+public:
+    explicit Bzip2Reader(const string& filename) :
+        DecompressingReader(filename), _fp(openOrThrow(filename)), _bz(0), _atEnd(false)
+    {
+        try {
+            openStream(0, 0);
+        }
+        catch (...) {
+            fclose(_fp);
+            throw;
+        }
+    }
+
+    virtual ~Bzip2Reader()
+    {
+        closeStream();
+        fclose(_fp);
+    }
+
+    virtual unsigned int read(char* buf, unsigned int len)
+    {
+        unsigned int total = 0;
+        while (total < len && !_atEnd) {
+            int bzerr = BZ_OK;
+            int bytesRead = BZ2_bzRead(&bzerr, _bz, buf + total, len - total);
+            if (bzerr != BZ_OK && bzerr != BZ_STREAM_END) {
+                throwError(bzerr);
+            }
+            total += bytesRead;
+            if (bzerr == BZ_STREAM_END) {
+                nextStream();
+            }
+        }
+        return total;
+    }
+
+private:
+    void openStream(void* unused, int nUnused)
+    {
+        int bzerr = BZ_OK;
+        _bz = BZ2_bzReadOpen(&bzerr, _fp, 0, 0, unused, nUnused);
+        if (bzerr != BZ_OK) {
+            closeStream();
+            throwError(bzerr);
+        }
+    }
+
+    void closeStream()
+    {
+        if (_bz) {
+            int bzerr = BZ_OK;
+            BZ2_bzReadClose(&bzerr, _bz);
+            _bz = 0;
+        }
+    }
+
+    // At the end of one stream, start on the next one if there's anything
+    // left, handing it the bytes the last one read past its end.
+    void nextStream()
+    {
+        int bzerr = BZ_OK;
+        void* unused = 0;
+        int nUnused = 0;
+        BZ2_bzReadGetUnused(&bzerr, _bz, &unused, &nUnused);
+        if (bzerr != BZ_OK) {
+            throwError(bzerr);
+        }
+        // The unused bytes live in _bz, which closeStream() frees.
+        char leftover[BZ_MAX_UNUSED];
+        memcpy(leftover, unused, nUnused);
+        closeStream();
+
+        if (nUnused == 0) {
+            int c = getc(_fp);
+            if (c == EOF) {
+                _atEnd = true;
+                return;
+            }
+            ungetc(c, _fp);
+        }
+        openStream(leftover, nUnused);
+    }
+
+    void throwError(int bzerr)
+    {
+        switch (bzerr) {
+        case BZ_IO_ERROR:
+            throwReadError(_filename, strerror(errno));
+            break;
+        case BZ_UNEXPECTED_EOF:
+            throwReadError(_filename, "the compressed data ends early");
+            break;
+        case BZ_MEM_ERROR:
+            throwReadError(_filename, "out of memory");
+            break;
+        default: {
+            std::ostringstream oss;
+            oss << "corrupt bzip2 data (libbz2 error " << bzerr << ")";
+            throwReadError(_filename, oss.str());
+        }
+        }
+    }
+
+    FILE* _fp;
+    BZFILE* _bz;
+    bool _atEnd;
+};
+
+/**
+ * .Z, the LZW format of the old Unix compress(1). No library we link has a
+ * decoder for it, so this is one after the one in ncompress and gzip's unlzw(),
+ * including their quirk of skipping the rest of the current group of eight
+ * codes whenever the code width changes.
+ */
+class LzwReader: public DecompressingReader {
+public:
+    explicit LzwReader(const string& filename) :
+        DecompressingReader(filename), _fp(openOrThrow(filename)), _in(COMPRESSED_BUFFER_SIZE), _inPos(0), _inEnd(0), _bitBuf(
+            0), _bitCount(0), _maxBits(0), _blockMode(false), _nBits(INIT_BITS), _maxCode(0), _maxMaxCode(0), _freeEnt(0), _codesRead(
+            0), _oldCode(-1), _finChar(0), _prefix(TABLE_SIZE), _suffix(TABLE_SIZE), _stack(TABLE_SIZE + 1), _stackPos(
+            _stack.size()), _atEnd(false)
+    {
+        try {
+            readHeader();
+        }
+        catch (...) {
+            fclose(_fp);
+            throw;
+        }
+    }
+
+    virtual ~LzwReader()
+    {
+        fclose(_fp);
+    }
+
+    virtual unsigned int read(char* buf, unsigned int len)
+    {
+        unsigned int total = 0;
+        while (total < len) {
+            if (_stackPos == _stack.size()) {
+                if (_atEnd || !decodeNext()) {
+                    break;
+                }
+            }
+            unsigned int n = min(len - total, static_cast<unsigned int>(_stack.size() - _stackPos));
+            memcpy(buf + total, &_stack[_stackPos], n);
+            _stackPos += n;
+            total += n;
+        }
+        return total;
+    }
+
+private:
+    static const int INIT_BITS = 9;
+    static const int MAX_BITS = 16;
+    static const unsigned int TABLE_SIZE = 1 << MAX_BITS;
+    static const int CLEAR = 256;
+    static const int FIRST = 257;
+
+    void readHeader()
+    {
+        int magic0 = nextByte();
+        int magic1 = nextByte();
+        int flags = nextByte();
+        if (magic0 != 0x1f || magic1 != 0x9d || flags < 0) {
+            throwReadError(_filename, "not in compress (.Z) format");
+        }
+        _maxBits = flags & 0x1f;
+        _blockMode = (flags & 0x80) != 0;
+        if (_maxBits < INIT_BITS || _maxBits > MAX_BITS) {
+            std::ostringstream oss;
+            oss << "compressed with " << _maxBits << " bits, but only " << INIT_BITS << " to " << MAX_BITS
+                << " are supported";
+            throwReadError(_filename, oss.str());
+        }
+        _maxMaxCode = 1 << _maxBits;
+        _maxCode = (1 << _nBits) - 1;
+        _freeEnt = _blockMode ? FIRST : 256;
+        for (int i = 0; i < 256; ++i) {
+            _prefix[i] = 0;
+            _suffix[i] = static_cast<unsigned char>(i);
+        }
+    }
+
+    /** @return the next compressed byte, or -1 at the end of the file */
+    int nextByte()
+    {
+        if (_inPos == _inEnd) {
+            _inEnd = fread(&_in[0], 1, _in.size(), _fp);
+            _inPos = 0;
+            if (_inEnd == 0) {
+                if (ferror(_fp)) {
+                    throwReadError(_filename, strerror(errno));
+                }
+                return -1;
+            }
+        }
+        return _in[_inPos++];
+    }
+
+    /** @return the next _nBits wide code, or -1 if there aren't that many bits left */
+    int nextCode()
+    {
+        while (_bitCount < _nBits) {
+            int c = nextByte();
+            if (c < 0) {
+                return -1;
+            }
+            _bitBuf |= static_cast<uint32_t>(c) << _bitCount;
+            _bitCount += 8;
+        }
+        int code = static_cast<int>(_bitBuf & ((1u << _nBits) - 1));
+        _bitBuf >>= _nBits;
+        _bitCount -= _nBits;
+        ++_codesRead;
+        return code;
+    }
+
+    // compress writes codes in groups of eight, so a group is _nBits bytes,
+    // and it starts a new group at each change of width.
+    void skipToNextGroup()
+    {
+        while (_codesRead % 8 != 0) {
+            if (nextCode() < 0) {
+                break;
+            }
+        }
+        _codesRead = 0;
+    }
+
+    /** Decode the next code into the pending output on _stack.
+     * @return false at the end of the data */
+    bool decodeNext()
+    {
+        for (;;) {
+            if (_freeEnt > _maxCode) {
+                skipToNextGroup();
+                ++_nBits;
+                _maxCode = (_nBits == _maxBits) ? _maxMaxCode : (1 << _nBits) - 1;
+            }
+
+            int code = nextCode();
+            if (code < 0) {
+                _atEnd = true;
+                return false;
+            }
+
+            if (_oldCode == -1) {
+                if (code >= 256) {
+                    throwReadError(_filename, "corrupt compress (.Z) data: bad first code");
+                }
+                _oldCode = code;
+                _finChar = code;
+                _stack[--_stackPos] = static_cast<unsigned char>(code);
+                return true;
+            }
+
+            if (code == CLEAR && _blockMode) {
+                skipToNextGroup();
+                _freeEnt = FIRST - 1;
+                _nBits = INIT_BITS;
+                _maxCode = (1 << _nBits) - 1;
+                continue;
+            }
+
+            int inCode = code;
+            if (code >= _freeEnt) {
+                // The KwKwK case: the code being defined right now.
+                if (code > _freeEnt) {
+                    throwReadError(_filename, "corrupt compress (.Z) data: code out of range");
+                }
+                _stack[--_stackPos] = static_cast<unsigned char>(_finChar);
+                code = _oldCode;
+            }
+            while (code >= 256) {
+                _stack[--_stackPos] = _suffix[code];
+                code = _prefix[code];
+            }
+            _finChar = _suffix[code];
+            _stack[--_stackPos] = static_cast<unsigned char>(_finChar);
+
+            if (_freeEnt < _maxMaxCode) {
+                _prefix[_freeEnt] = static_cast<uint16_t>(_oldCode);
+                _suffix[_freeEnt] = static_cast<unsigned char>(_finChar);
+                ++_freeEnt;
+            }
+            _oldCode = inCode;
+            return true;
+        }
+    }
+
+    FILE* _fp;
+
+    // Buffered compressed input and the bits of it not yet in a code.
+    vector<unsigned char> _in;
+    size_t _inPos;
+    size_t _inEnd;
+    uint32_t _bitBuf;
+    int _bitCount;
+
+    // Header settings and the state of the code table.
+    int _maxBits;
+    bool _blockMode;
+    int _nBits;
+    int _maxCode;
+    int _maxMaxCode;
+    int _freeEnt;
+    int _codesRead;
+    int _oldCode;
+    int _finChar;
+    vector<uint16_t> _prefix;
+    vector<unsigned char> _suffix;
+
+    // The last code's string is decoded backwards into the end of _stack and
+    // read() hands it out from _stackPos on.
+    vector<unsigned char> _stack;
+    size_t _stackPos;
+    bool _atEnd;
+};
+
+} // namespace
+
+DecompressingReader::DecompressingReader(const string& filename) :
+    _filename(filename)
+{
+}
+
+DecompressingReader::~DecompressingReader()
+{
+}
+
+bool DecompressingReader::isCompressedFilename(const string& filename)
+{
+    return endsWith(filename, ".gz") || endsWith(filename, ".bz2") || endsWith(filename, ".Z");
+}
+
+std::auto_ptr<DecompressingReader> DecompressingReader::open(const string& filename)
+{
+    BESDEBUG("ncml", "DecompressingReader::open() - streaming decompression of " << filename << endl);
+    std::auto_ptr<DecompressingReader> reader;
+    if (endsWith(filename, ".gz")) {
+        reader.reset(new GzipReader(filename));
+    }
+    else if (endsWith(filename, ".bz2")) {
+        reader.reset(new Bzip2Reader(filename));
+    }
+    else if (endsWith(filename, ".Z")) {
+        reader.reset(new LzwReader(filename));
+    }
+    else {
+        THROW_NCML_INTERNAL_ERROR("DecompressingReader::open() called on " + filename
+            + ", which isn't .gz, .bz2 or .Z");
+    }
+    return reader;
+}
+
+}
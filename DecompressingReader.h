@@ -0,0 +1,87 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef __NCML_MODULE__DECOMPRESSING_READER_H__
+#define __NCML_MODULE__DECOMPRESSING_READER_H__
+
+#include <memory>
+#include <string>
+
+namespace ncml_module {
+
+/**
+ * @brief Streaming reader for NcML files compressed with gzip (.gz), bzip2 (.bz2)
+ * or Unix compress (.Z).
+ *
+ * read() hands back the decompressed bytes a buffer at a time, so a compressed
+ * NcML file can be fed straight into libxml's push parser (see SaxParserWrapper)
+ * without uncompressing the whole thing into memory or a temporary file first.
+ * Only a fixed amount of decompressor state is ever held.
+ *
+ * Use open() to get the reader for a file by its extension.
+ */
+class DecompressingReader {
+private:
+    DecompressingReader(const DecompressingReader& proto); // disallow
+    DecompressingReader& operator=(const DecompressingReader& rhs); // disallow
+
+public:
+    /** @return whether filename ends in one of the compressed extensions we read: .gz, .bz2 or .Z */
+    static bool isCompressedFilename(const std::string& filename);
+
+    /**
+     * Open the compressed file for reading.
+     * @param filename must satisfy isCompressedFilename()
+     * @exception BESSyntaxUserError if the file can't be opened
+     */
+    static std::auto_ptr<DecompressingReader> open(const std::string& filename);
+
+    virtual ~DecompressingReader();
+
+    /**
+     * Decompress up to len bytes into buf.
+     * @return the number of bytes put in buf, which is only less than len at the end
+     * of the data and is 0 after it.
+     * @exception BESSyntaxUserError if the compressed data is corrupt or can't be read
+     */
+    virtual unsigned int read(char* buf, unsigned int len) = 0;
+
+    const std::string& filename() const
+    {
+        return _filename;
+    }
+
+protected:
+    explicit DecompressingReader(const std::string& filename);
+
+    std::string _filename;
+};
+
+}
+
+#endif /* __NCML_MODULE__DECOMPRESSING_READER_H__ */
@@ -30,8 +30,12 @@
 #include "config.h"
 #include "DirectoryUtil.h"
 
+#include <algorithm>
 #include <cstring>
 #include <cerrno>
+#include <deque>
+#include <fcntl.h>
+#include <pthread.h>
 #include <sstream>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -155,6 +159,34 @@ std::string FileInfo::toString() const
 /////////////////////// class DirectoryUtil ////////////////////////////////
 
 const string DirectoryUtil::_sDebugChannel = "agg_util";
+const string DirectoryUtil::SCAN_THREADS_KEY = "NCML.Aggregation.ScanThreads";
+
+// Upper bound on SCAN_THREADS_KEY
+static const unsigned int MAX_SCAN_THREADS = 32;
+
+unsigned int DirectoryUtil::getScanThreadsFromConfig()
+{
+    bool found = false;
+    string value;
+    TheBESKeys::TheKeys()->get_value(SCAN_THREADS_KEY, value, found);
+    if (!found || value.empty()) {
+        return 0;
+    }
+
+    std::istringstream iss(value);
+    int threads = 0;
+    iss >> threads;
+    if (iss.fail() || threads < 0) {
+        BESDEBUG(_sDebugChannel,
+            "DirectoryUtil: ignoring bad value for " << SCAN_THREADS_KEY << "=\"" << value << "\"" << endl);
+        return 0;
+    }
+
+    if (static_cast<unsigned int>(threads) > MAX_SCAN_THREADS) {
+        return MAX_SCAN_THREADS;
+    }
+    return static_cast<unsigned int>(threads);
+}
 
 DirectoryUtil::DirectoryUtil() :
     _rootDir("/"), _suffix("") // we start with no filter
@@ -230,17 +262,28 @@ void DirectoryUtil::setFilterModTimeOlderThan(time_t newestModTime)
 
 void DirectoryUtil::getListingForPath(const std::string& path, std::vector<FileInfo>* pRegularFiles,
     std::vector<FileInfo>* pDirectories)
+{
+    string fullPath;
+    BESDEBUG(_sDebugChannel, "Attempting to get dir listing for path=\"" << path << "\"" << endl);
+    if (listDirectory(path, pRegularFiles, pDirectories, fullPath) != 0) {
+        throwErrorForOpendirFail(fullPath);
+    }
+}
+
+int DirectoryUtil::listDirectory(const std::string& path, std::vector<FileInfo>* pRegularFiles,
+    std::vector<FileInfo>* pDirectories, std::string& fullPath) const
 {
     string pathToUse(path);
     removePrecedingSlashes(pathToUse);
     pathToUse = getRootDir() + "/" + pathToUse;
-    BESDEBUG(_sDebugChannel, "Attempting to get dir listing for path=\"" << pathToUse << "\"" << endl);
+    fullPath = pathToUse;
 
     // RAII, will closedir no matter how we leave function, including a throw
     DirWrapper pDir(pathToUse);
     if (pDir.fail()) {
-        throwErrorForOpendirFail(pathToUse);
+        return errno;
     }
+    int dirFd = dirfd(pDir.get());
 
     // Go through each entry and see if it's a directory or regular file and
     // add it to the list.
@@ -252,34 +295,68 @@ void DirectoryUtil::getListingForPath(const std::string& path, std::vector<FileI
             continue;
         }
 
-        // Figure out if it's a regular file or directory
-        string pathToEntry = pathToUse + "/" + entryName;
+        // Use d_type, when the filesystem fills it in, to tell the
+        // regular files from the directories without a stat().
+        bool isDir = false;
+        bool isReg = false;
+#ifdef _DIRENT_HAVE_D_TYPE
+        isDir = (pDirEnt->d_type == DT_DIR);
+        isReg = (pDirEnt->d_type == DT_REG);
+#endif
+        // Anything else (DT_UNKNOWN, or a symlink, which we follow) gets a stat() below.
+
+        // Use the passed in path for the entry since we
+        // want to make the locations be relative to the root
+        // for loading later.
+        if (isReg) {
+            if (!pRegularFiles) {
+                continue;
+            }
+            FileInfo theFile(path, entryName, false, 0);
+            // match against the relative passed in path, not root full path
+            if (!matchesNameFilters(theFile.getFullPath())) {
+                continue;
+            }
+            // Only the olderThan filter needs the mtime.
+            if (!_filteringModTimes) {
+                pRegularFiles->push_back(theFile);
+                continue;
+            }
+        }
+        else if (isDir && !pDirectories) {
+            continue;
+        }
+
         struct stat statBuf;
-        int statResult = stat(pathToEntry.c_str(), &statBuf);
+        int statResult = fstatat(dirFd, entryName.c_str(), &statBuf, 0);
         if (statResult != 0) {
             // If we can't stat the file for some reason, then ignore it
             continue;
         }
 
-        // Use the passed in path for the entry since we
-        // want to make the locations be relative to the root
-        // for loading later.
         if (pDirectories && S_ISDIR(statBuf.st_mode)) {
             pDirectories->push_back(FileInfo(path, entryName, true, statBuf.st_mtime));
         }
         else if (pRegularFiles && S_ISREG(statBuf.st_mode)) {
             FileInfo theFile(path, entryName, false, statBuf.st_mtime);
-            // match against the relative passed in path, not root full path
             if (matchesAllFilters(theFile.getFullPath(), statBuf.st_mtime)) {
                 pRegularFiles->push_back(theFile);
             }
         }
     }
+
+    return 0;
 }
 
 void DirectoryUtil::getListingForPathRecursive(const std::string& path, std::vector<FileInfo>* pRegularFiles,
     std::vector<FileInfo>* pDirectories)
 {
+    unsigned int numThreads = getScanThreadsFromConfig();
+    if (numThreads > 1) {
+        getListingForPathRecursiveParallel(path, pRegularFiles, pDirectories, numThreads);
+        return;
+    }
+
     // Remove trailing slash to make it canonical
     string canonicalPath = path;
     removeTrailingSlashes(canonicalPath);
@@ -310,6 +387,133 @@ void DirectoryUtil::getListingForPathRecursive(const std::string& path, std::vec
 
 }
 
+/**
+ * State shared by the threads of a parallel recursive listing. Each thread
+ * takes a directory off the queue, lists it, and puts its subdirectories
+ * back on the queue. The listing is done when the queue is empty and no
+ * thread is still listing (and so might add more).
+ */
+struct ParallelListing {
+    ParallelListing(const DirectoryUtil& util, bool wantFiles) :
+        util(util), wantFiles(wantFiles), queue(), numBusy(0), error(0), errorPath(), files(), dirs()
+    {
+        pthread_mutex_init(&mutex, 0);
+        pthread_cond_init(&cond, 0);
+    }
+
+    ~ParallelListing()
+    {
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&mutex);
+    }
+
+    static void* workerMain(void* pThis)
+    {
+        static_cast<ParallelListing*>(pThis)->runWorker();
+        return 0;
+    }
+
+    void runWorker();
+
+    const DirectoryUtil& util;
+    bool wantFiles;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    std::deque<string> queue; // directories still to list
+    unsigned int numBusy; // threads listing a directory right now
+    int error; // errno of the first failure, 0 if none
+    string errorPath;
+    vector<FileInfo> files;
+    vector<FileInfo> dirs;
+};
+
+void DirectoryUtil::getListingForPathRecursiveParallel(const std::string& path, std::vector<FileInfo>* pRegularFiles,
+    std::vector<FileInfo>* pDirectories, unsigned int numThreads)
+{
+    BESDEBUG(_sDebugChannel, "DirectoryUtil: listing \"" << path << "\" recursively with " << numThreads << " threads" << endl);
+
+    string canonicalPath = path;
+    removeTrailingSlashes(canonicalPath);
+
+    ParallelListing listing(*this, pRegularFiles != 0);
+    listing.queue.push_back(canonicalPath);
+
+    vector<pthread_t> threads;
+    threads.reserve(numThreads);
+    for (unsigned int i = 0; i < numThreads; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, 0, ParallelListing::workerMain, &listing) != 0) {
+            break;
+        }
+        threads.push_back(thread);
+    }
+    // If no thread could be started we do the work here.
+    if (threads.empty()) {
+        listing.runWorker();
+    }
+    for (vector<pthread_t>::iterator it = threads.begin(); it != threads.end(); ++it) {
+        pthread_join(*it, 0);
+    }
+
+    if (listing.error != 0) {
+        errno = listing.error;
+        throwErrorForOpendirFail(listing.errorPath);
+    }
+
+    // The threads finish in any order, sort so the result doesn't depend on it.
+    if (pRegularFiles) {
+        std::sort(listing.files.begin(), listing.files.end());
+        pRegularFiles->insert(pRegularFiles->end(), listing.files.begin(), listing.files.end());
+    }
+    if (pDirectories) {
+        std::sort(listing.dirs.begin(), listing.dirs.end());
+        pDirectories->insert(pDirectories->end(), listing.dirs.begin(), listing.dirs.end());
+    }
+}
+
+void ParallelListing::runWorker()
+{
+    pthread_mutex_lock(&mutex);
+    while (true) {
+        while (queue.empty() && numBusy > 0 && error == 0) {
+            pthread_cond_wait(&cond, &mutex);
+        }
+        if (queue.empty() || error != 0) {
+            break;
+        }
+
+        string path = queue.front();
+        queue.pop_front();
+        ++numBusy;
+        pthread_mutex_unlock(&mutex);
+
+        vector<FileInfo> dirFiles;
+        vector<FileInfo> subDirs;
+        string fullPath;
+        int result = util.listDirectory(path, wantFiles ? &dirFiles : 0, &subDirs, fullPath);
+
+        pthread_mutex_lock(&mutex);
+        --numBusy;
+        if (result != 0) {
+            if (error == 0) {
+                error = result;
+                errorPath = fullPath;
+            }
+        }
+        else {
+            files.insert(files.end(), dirFiles.begin(), dirFiles.end());
+            dirs.insert(dirs.end(), subDirs.begin(), subDirs.end());
+            for (vector<FileInfo>::const_iterator it = subDirs.begin(); it != subDirs.end(); ++it) {
+                queue.push_back(path + "/" + it->basename());
+            }
+        }
+        pthread_cond_broadcast(&cond);
+    }
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+}
+
 void DirectoryUtil::getListingOfRegularFilesRecursive(const std::string& path, std::vector<FileInfo>& rRegularFiles)
 {
     // call the other one, not accumulated the directories, only recursing into them.
@@ -362,21 +566,27 @@ void DirectoryUtil::throwErrorForOpendirFail(const string& fullPath)
     }
 }
 
-bool DirectoryUtil::matchesAllFilters(const std::string& path, time_t modTime) const
+bool DirectoryUtil::matchesNameFilters(const std::string& path) const
 {
-    bool matches = true;
     // Do the suffix first since it's fast
     if (!_suffix.empty() && !matchesSuffix(path, _suffix)) {
-        matches = false;
+        return false;
     }
 
     // Suffix matches and we have a regexp, check that
-    if (matches && _pRegExp) {
+    if (_pRegExp) {
         // match the full string, -1 on fail, num chars matching otherwise
         int numCharsMatching = _pRegExp->match(path.c_str(), path.size(), 0);
-        matches = (numCharsMatching > 0); // TODO do we want to match the size()?
+        return (numCharsMatching > 0); // TODO do we want to match the size()?
     }
 
+    return true;
+}
+
+bool DirectoryUtil::matchesAllFilters(const std::string& path, time_t modTime) const
+{
+    bool matches = matchesNameFilters(path);
+
     if (matches && _filteringModTimes) {
         matches = (modTime < _newestModTime);
     }
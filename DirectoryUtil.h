@@ -53,6 +53,10 @@ public:
     const std::string& path() const;
     const std::string& basename() const;
     bool isDir() const;
+
+    /** Last modification time. For regular files this is only filled
+     * in if the listing had a modification time filter, since otherwise
+     * it's not worth a stat() per file; it's 0 then. */
     time_t modTime() const;
 
     /** Get a human readable string for the modTime() */
@@ -81,6 +85,8 @@ private:
     time_t _modTime; // last modification time
 };
 
+struct ParallelListing;
+
 /** Helper classes for using dirent.h, dir.h, stat.h, etc. to make
  * directory listings.
  * */
@@ -156,6 +162,9 @@ public:
     /**
      * Get the listing for the path recursing into every directory found
      * until it bottoms out.
+     * If SCAN_THREADS_KEY asks for more than one thread the subdirectories
+     * are listed concurrently and both vectors come back sorted by full path
+     * so the result doesn't depend on the thread timing.
      * NOTE: a symlink loop will cause an exception.
      * @see getListingForPath()
      * @param path top directory to begin recursive search
@@ -199,7 +208,15 @@ public:
 
     static bool matchesSuffix(const std::string& filename, const std::string& suffix);
 
+    /** BES key for the number of threads used by getListingForPathRecursive() */
+    static const std::string SCAN_THREADS_KEY;
+
+    /** @return the SCAN_THREADS_KEY setting, 0 (list serially) if not set */
+    static unsigned int getScanThreadsFromConfig();
+
 private:
+    friend struct ParallelListing;
+
     // helper methods
 
     /** If opendir() fails, this uses errno to throw a BESForbiddenError,
@@ -207,6 +224,22 @@ private:
      */
     void throwErrorForOpendirFail(const std::string& fullPath);
 
+    /** The guts of getListingForPath(). Safe to call from several threads
+     * at once since it doesn't log or throw.
+     * @param fullPath set to the directory that was opened.
+     * @return 0 or the errno from a failed opendir().
+     */
+    int listDirectory(const std::string& path, std::vector<FileInfo>* pRegularFiles,
+        std::vector<FileInfo>* pDirectories, std::string& fullPath) const;
+
+    /** getListingForPathRecursive() with numThreads threads working
+     * off a shared queue of directories. */
+    void getListingForPathRecursiveParallel(const std::string& path, std::vector<FileInfo>* pRegularFiles,
+        std::vector<FileInfo>* pDirectories, unsigned int numThreads);
+
+    /** The suffix and regexp filters alone, which don't need a stat(). */
+    bool matchesNameFilters(const std::string& path) const;
+
     /**
      * If there is a suffix filter, the path must match it.
      * If there is a regexp filter, the path must ALSO match it.
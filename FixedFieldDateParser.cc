@@ -0,0 +1,182 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+
+#include "FixedFieldDateParser.h"
+
+#include <cstdio>
+
+using std::string;
+
+namespace agg_util {
+
+// ICU uses the Julian calendar before the Gregorian cutover, leave those to it.
+static const int FIRST_GREGORIAN_YEAR = 1583;
+
+// The last year "%04d" writes as four digits.
+static const int LAST_FOUR_DIGIT_YEAR = 9999;
+
+// ICU's default for a pattern without a year field
+static const int DEFAULT_YEAR = 1970;
+
+FixedFieldDateParser::FixedFieldDateParser() :
+    _fields(), _length(0), _hasDayOfYear(false), _compiled(false)
+{
+}
+
+FixedFieldDateParser::~FixedFieldDateParser()
+{
+}
+
+bool FixedFieldDateParser::compile(const std::string& pattern)
+{
+    _fields.clear();
+    _length = pattern.size();
+    _hasDayOfYear = false;
+    _compiled = false;
+
+    bool seen[eLiteral] = { false, false, false, false, false, false, false };
+    string::size_type pos = 0;
+    while (pos < pattern.size()) {
+        char c = pattern[pos];
+        bool isLetter = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+        if (!isLetter) {
+            // Quotes and digits in the pattern are ICU's business.
+            if (c == '\'' || (c >= '0' && c <= '9')) {
+                return false;
+            }
+            _fields.push_back(Field(eLiteral, pos, 1, c));
+            ++pos;
+            continue;
+        }
+
+        string::size_type len = pattern.find_first_not_of(c, pos);
+        len = ((len == string::npos) ? pattern.size() : len) - pos;
+
+        FieldType type;
+        if (c == 'y' && len == 4) type = eYear;
+        else if (c == 'M' && len == 2) type = eMonth;
+        else if (c == 'd' && len == 2) type = eDay;
+        else if (c == 'H' && len == 2) type = eHour;
+        else if (c == 'm' && len == 2) type = eMinute;
+        else if (c == 's' && len == 2) type = eSecond;
+        else if (c == 'D' && len == 3) type = eDayOfYear;
+        else return false;
+
+        if (seen[type]) {
+            return false;
+        }
+        seen[type] = true;
+
+        _fields.push_back(Field(type, pos, len, 0));
+        pos += len;
+    }
+
+    // How ICU resolves a day of year against a month or day isn't worth copying.
+    if (seen[eDayOfYear] && (seen[eMonth] || seen[eDay])) {
+        return false;
+    }
+
+    _hasDayOfYear = seen[eDayOfYear];
+    _compiled = true;
+    return true;
+}
+
+bool FixedFieldDateParser::parseToISO8601(const std::string& text, std::string& iso) const
+{
+    if (!_compiled || text.size() < _length) {
+        return false;
+    }
+
+    int values[eLiteral] = { DEFAULT_YEAR, 1, 1, 0, 0, 0, 0 };
+    for (std::vector<Field>::const_iterator it = _fields.begin(); it != _fields.end(); ++it) {
+        if (it->type == eLiteral) {
+            if (text[it->pos] != it->literal) {
+                return false;
+            }
+            continue;
+        }
+
+        int value = 0;
+        for (string::size_type i = it->pos; i < it->pos + it->len; ++i) {
+            char c = text[i];
+            // Too many digits to be valid for any field, and to fit an int.
+            if (c < '0' || c > '9' || value > 99999999) {
+                return false;
+            }
+            value = value * 10 + (c - '0');
+        }
+        values[it->type] = value;
+    }
+
+    int year = values[eYear];
+    int month = values[eMonth];
+    int day = values[eDay];
+    // Leave 5+ digit years to ICU, and keep every field to its ISO 8601 width.
+    if (year < FIRST_GREGORIAN_YEAR || year > LAST_FOUR_DIGIT_YEAR || month < 1 || month > 12 || values[eHour] < 0
+        || values[eHour] > 23 || values[eMinute] < 0 || values[eMinute] > 59 || values[eSecond] < 0
+        || values[eSecond] > 59) {
+        return false;
+    }
+
+    if (_hasDayOfYear) {
+        int dayOfYear = values[eDayOfYear];
+        if (dayOfYear < 1 || dayOfYear > (isLeapYear(year) ? 366 : 365)) {
+            return false;
+        }
+        month = 1;
+        while (dayOfYear > daysInMonth(year, month)) {
+            dayOfYear -= daysInMonth(year, month);
+            ++month;
+        }
+        day = dayOfYear;
+    }
+    else if (day < 1 || day > daysInMonth(year, month)) {
+        return false;
+    }
+
+    // Room for six full ints, although the checks above hold it to 20 chars.
+    char buf[80];
+    snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02dZ", year, month, day, values[eHour], values[eMinute],
+        values[eSecond]);
+    iso = buf;
+    return true;
+}
+
+bool FixedFieldDateParser::isLeapYear(int year)
+{
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+int FixedFieldDateParser::daysInMonth(int year, int month)
+{
+    static const int days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    return (month == 2 && isLeapYear(year)) ? 29 : days[month - 1];
+}
+
+}
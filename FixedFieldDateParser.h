@@ -0,0 +1,103 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __AGG_UTIL__FIXED_FIELD_DATE_PARSER_H__
+#define __AGG_UTIL__FIXED_FIELD_DATE_PARSER_H__
+
+#include <string>
+#include <vector>
+
+namespace agg_util {
+
+/**
+ * Parser for the fixed width, all numeric SimpleDateFormat patterns that
+ * make up nearly every scan@dateFormatMark, e.g. "yyyyMMdd_HHmm" or
+ * "yyyy.DDD", writing the ISO 8601 string directly.
+ *
+ * Only these fields are handled:
+ *
+ * yyyy MM dd HH mm ss DDD
+ *
+ * plus literal (non letter, non digit, unquoted) characters between them.
+ * compile() refuses any other pattern and parseToISO8601() refuses any
+ * text that isn't exactly digits where the fields are, the literals in
+ * between, and a valid Gregorian date. The caller should then use ICU,
+ * which gives the lenient parse (or the error) it always has, so this is
+ * purely a shortcut for the text ICU would parse the same way.
+ */
+class FixedFieldDateParser {
+public:
+    FixedFieldDateParser();
+    ~FixedFieldDateParser();
+
+    /** Compile pattern.
+     * @return true if the pattern can be handled by parseToISO8601() */
+    bool compile(const std::string& pattern);
+
+    /** Did the last compile() succeed? */
+    bool isCompiled() const
+    {
+        return _compiled;
+    }
+
+    /** Parse text with the compiled pattern.
+     * @param iso set to the time as "yyyy-MM-ddTHH:mm:ssZ" on success
+     * @return false if the text isn't a plain match for the pattern.
+     */
+    bool parseToISO8601(const std::string& text, std::string& iso) const;
+
+private:
+    enum FieldType {
+        eYear, eMonth, eDay, eHour, eMinute, eSecond, eDayOfYear, eLiteral
+    };
+
+    struct Field {
+        Field(FieldType typeArg, std::string::size_type posArg, std::string::size_type lenArg, char literalArg) :
+            type(typeArg), pos(posArg), len(lenArg), literal(literalArg)
+        {
+        }
+
+        FieldType type;
+        std::string::size_type pos;
+        std::string::size_type len;
+        char literal; // only for eLiteral
+    };
+
+    static bool isLeapYear(int year);
+    static int daysInMonth(int year, int month);
+
+    std::vector<Field> _fields;
+    std::string::size_type _length; // of the pattern, and so the text
+    bool _hasDayOfYear;
+    bool _compiled;
+};
+
+}
+
+#endif /* __AGG_UTIL__FIXED_FIELD_DATE_PARSER_H__ */
@@ -0,0 +1,468 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+#include "config.h"
+
+#include "GranuleDataCache.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <Array.h> // libdap
+
+#include "DecompressingReader.h" // ncml_module
+
+#include "BESDebug.h"
+#include "BESInternalError.h"
+#include "BESUtil.h"
+#include "TheBESKeys.h"
+
+using namespace std;
+
+static const string DEBUG_CHANNEL("cache");
+
+static const string BES_DATA_ROOT("BES.Data.RootDirectory");
+static const string BES_CATALOG_ROOT("BES.Catalog.catalog.RootDirectory");
+
+// Disk tier file layout (native byte order, it never leaves the host):
+//   char[8] DISK_MAGIC
+//   uint32  key length, key bytes
+//   uint64  value byte count, value bytes
+// The file name is a hash of the key, so the key is stored to catch collisions.
+static const char DISK_MAGIC[8] = { 'N', 'C', 'M', 'L', 'G', 'D', 'C', '1' };
+
+static const string DEFAULT_PREFIX = "ncml_granule";
+static const unsigned long DEFAULT_DISK_SIZE_MB = 2000;
+
+namespace agg_util {
+
+const string GranuleDataCache::MEMORY_SIZE_KEY = "NCML.GranuleDataCache.memorySize";
+const string GranuleDataCache::DIRECTORY_KEY = "NCML.GranuleDataCache.directory";
+const string GranuleDataCache::PREFIX_KEY = "NCML.GranuleDataCache.prefix";
+const string GranuleDataCache::SIZE_KEY = "NCML.GranuleDataCache.size";
+
+GranuleDataCache* GranuleDataCache::d_instance = 0;
+bool GranuleDataCache::d_configured = false;
+
+static unsigned long getMegabytesFromConfig(const string& key, unsigned long defaultValue)
+{
+    bool found = false;
+    string value;
+    TheBESKeys::TheKeys()->get_value(key, value, found);
+    if (!found || value.empty()) {
+        return defaultValue;
+    }
+
+    std::istringstream iss(value);
+    unsigned long megabytes = 0;
+    iss >> megabytes;
+    if (iss.fail()) {
+        BESDEBUG(DEBUG_CHANNEL, "GranuleDataCache: ignoring bad value for " << key << ": " << value << endl);
+        return defaultValue;
+    }
+    return megabytes;
+}
+
+static string getStringFromConfig(const string& key)
+{
+    bool found = false;
+    string value;
+    TheBESKeys::TheKeys()->get_value(key, value, found);
+    return found ? value : "";
+}
+
+// 64 bit FNV-1a, only used to name the disk tier files.
+static string hashKey(const string& key)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (string::size_type i = 0; i < key.size(); ++i) {
+        hash ^= static_cast<unsigned char>(key[i]);
+        hash *= 1099511628211ULL;
+    }
+
+    std::ostringstream oss;
+    oss << std::hex << hash;
+    return oss.str();
+}
+
+static bool readFully(int fd, void* dest, size_t n)
+{
+    char* p = static_cast<char*>(dest);
+    while (n > 0) {
+        ssize_t got = read(fd, p, n);
+        if (got <= 0) {
+            if (got < 0 && errno == EINTR) continue;
+            return false;
+        }
+        p += got;
+        n -= got;
+    }
+    return true;
+}
+
+static bool writeFully(int fd, const void* src, size_t n)
+{
+    const char* p = static_cast<const char*>(src);
+    while (n > 0) {
+        ssize_t put = write(fd, p, n);
+        if (put < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += put;
+        n -= put;
+    }
+    return true;
+}
+
+GranuleDataCache*
+GranuleDataCache::get_instance()
+{
+    if (d_configured) {
+        return d_instance;
+    }
+    d_configured = true;
+
+    unsigned long long maxMemoryBytes = static_cast<unsigned long long>(getMegabytesFromConfig(MEMORY_SIZE_KEY, 0))
+        * 1024 * 1024;
+    string cacheDir = getStringFromConfig(DIRECTORY_KEY);
+    if (maxMemoryBytes == 0 && cacheDir.empty()) {
+        return 0;
+    }
+
+    // Entries are only good as long as the granule is unchanged, which we can't tell
+    // without knowing where the granules live.
+    string dataRootDir = getStringFromConfig(BES_CATALOG_ROOT);
+    if (dataRootDir.empty()) {
+        dataRootDir = getStringFromConfig(BES_DATA_ROOT);
+    }
+    if (dataRootDir.empty()) {
+        BESDEBUG(DEBUG_CHANNEL, "GranuleDataCache: Neither " << BES_CATALOG_ROOT << " nor " << BES_DATA_ROOT
+            << " is set, the granule data cache is off." << endl);
+        return 0;
+    }
+
+    string prefix = getStringFromConfig(PREFIX_KEY);
+    if (prefix.empty()) {
+        prefix = DEFAULT_PREFIX;
+    }
+
+    try {
+        d_instance = new GranuleDataCache(maxMemoryBytes, dataRootDir, cacheDir, prefix,
+            getMegabytesFromConfig(SIZE_KEY, DEFAULT_DISK_SIZE_MB));
+#ifdef HAVE_ATEXIT
+        atexit(delete_instance);
+#endif
+    }
+    catch (BESInternalError &bie) {
+        BESDEBUG(DEBUG_CHANNEL, "[ERROR] GranuleDataCache::get_instance(): Failed to obtain cache! msg: " << bie.get_message() << endl);
+    }
+
+    return d_instance;
+}
+
+void GranuleDataCache::delete_instance()
+{
+    delete d_instance;
+    d_instance = 0;
+}
+
+GranuleDataCache::GranuleDataCache(unsigned long long maxMemoryBytes, const string& dataRootDir,
+    const string& cacheDir, const string& prefix, unsigned long long maxCacheSize) :
+    d_memoryBytes(0), d_maxMemoryBytes(maxMemoryBytes), d_dataRootDir(dataRootDir), d_useDisk(!cacheDir.empty())
+{
+    if (d_useDisk) {
+        initialize(cacheDir, BESUtil::lowercase(prefix), maxCacheSize);
+    }
+    BESDEBUG(DEBUG_CHANNEL, "GranuleDataCache: memory tier " << d_maxMemoryBytes << " bytes, disk tier "
+        << (d_useDisk ? cacheDir : "off") << endl);
+}
+
+GranuleDataCache::~GranuleDataCache()
+{
+}
+
+bool GranuleDataCache::isCacheableType(libdap::BaseType* proto)
+{
+    if (!proto) {
+        return false;
+    }
+    switch (proto->type()) {
+    case libdap::dods_byte_c:
+    case libdap::dods_int16_c:
+    case libdap::dods_uint16_c:
+    case libdap::dods_int32_c:
+    case libdap::dods_uint32_c:
+    case libdap::dods_float32_c:
+    case libdap::dods_float64_c:
+        return true;
+    default:
+        // Strings and constructors don't live in the Vector's buffer.
+        return false;
+    }
+}
+
+bool GranuleDataCache::isNcMLLocation(const string& location)
+{
+    string name = location;
+    if (ncml_module::DecompressingReader::isCompressedFilename(name)) {
+        name = name.substr(0, name.rfind('.'));
+    }
+    const string suffix = ".ncml";
+    return name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool GranuleDataCache::statGranule(const string& location, struct stat& buf)
+{
+    // A nested NcML granule can change without its file changing.
+    if (location.empty() || isNcMLLocation(location)) {
+        return false;
+    }
+    string path = BESUtil::assemblePath(d_dataRootDir, location, true);
+    return stat(path.c_str(), &buf) == 0 && S_ISREG(buf.st_mode);
+}
+
+bool GranuleDataCache::makeKey(const string& location, const string& varName, const libdap::Array& constrainedArrayC,
+    string& key)
+{
+    // calls used are semantically const, but not syntactically.
+    libdap::Array& constrainedArray = const_cast<libdap::Array&>(constrainedArrayC);
+
+    libdap::BaseType* proto = constrainedArray.var();
+    struct stat buf;
+    if (!isCacheableType(proto) || !statGranule(location, buf)) {
+        return false;
+    }
+
+    std::ostringstream oss;
+    oss << location << '#' << buf.st_mtime << '#' << buf.st_size << '#' << varName << '#' << proto->type_name();
+    for (libdap::Array::Dim_iter it = constrainedArray.dim_begin(); it != constrainedArray.dim_end(); ++it) {
+        oss << '[' << it->start << ':' << it->stride << ':' << it->stop << '/' << it->size << ']';
+    }
+    key = oss.str();
+    return true;
+}
+
+bool GranuleDataCache::makeAggregationKey(const AMDList& datasets, const string& varName,
+    const libdap::Array& aggArrayC, string& key)
+{
+    libdap::Array& aggArray = const_cast<libdap::Array&>(aggArrayC);
+
+    libdap::BaseType* proto = aggArray.var();
+    if (!isCacheableType(proto) || datasets.empty()) {
+        return false;
+    }
+
+    // Thousands of granules would make an unwieldy key, so it carries a hash of them.
+    std::ostringstream granules;
+    for (AMDList::const_iterator it = datasets.begin(); it != datasets.end(); ++it) {
+        struct stat buf;
+        const string& location = (*it)->getLocation();
+        if (!statGranule(location, buf)) {
+            return false;
+        }
+        granules << location << '#' << buf.st_mtime << '#' << buf.st_size << '\n';
+    }
+
+    std::ostringstream oss;
+    oss << "aggregation#" << hashKey(granules.str()) << '#' << datasets.size() << '#' << varName << '#'
+        << proto->type_name();
+    for (libdap::Array::Dim_iter it = aggArray.dim_begin(); it != aggArray.dim_end(); ++it) {
+        oss << '[' << it->size << ']';
+    }
+    key = oss.str();
+    return true;
+}
+
+bool GranuleDataCache::get(const string& key, libdap::Array& constrainedArray)
+{
+    std::vector<char> values;
+    if (!get(key, values)) {
+        return false;
+    }
+
+    unsigned long long expected = static_cast<unsigned long long>(constrainedArray.length())
+        * constrainedArray.var()->width();
+    if (values.size() != expected || values.empty()) {
+        BESDEBUG(DEBUG_CHANNEL, "GranuleDataCache: entry size doesn't match the array, ignoring it. key=" << key << endl);
+        return false;
+    }
+
+    constrainedArray.val2buf(&values[0]);
+    constrainedArray.set_read_p(true);
+    return true;
+}
+
+void GranuleDataCache::put(const string& key, libdap::Array& granuleArray)
+{
+    put(key, granuleArray.get_buf(),
+        static_cast<unsigned long long>(granuleArray.length()) * granuleArray.var()->width());
+}
+
+bool GranuleDataCache::get(const string& key, std::vector<char>& values)
+{
+    bool hit = getFromMemory(key, values);
+    if (!hit && d_useDisk && getFromDisk(key, values)) {
+        putInMemory(key, &values[0], values.size());
+        hit = true;
+    }
+    if (hit) {
+        BESDEBUG(DEBUG_CHANNEL, "GranuleDataCache: hit for key=" << key << endl);
+    }
+    return hit;
+}
+
+void GranuleDataCache::put(const string& key, const char* values, unsigned long long numBytes)
+{
+    if (!values || numBytes == 0) {
+        return;
+    }
+
+    putInMemory(key, values, numBytes);
+    if (d_useDisk) {
+        putOnDisk(key, values, numBytes);
+    }
+}
+
+bool GranuleDataCache::getFromMemory(const string& key, std::vector<char>& values)
+{
+    MemoryCache::iterator it = d_memoryCache.find(key);
+    if (it == d_memoryCache.end()) {
+        return false;
+    }
+
+    d_lru.splice(d_lru.begin(), d_lru, it->second.lruPos);
+    values = it->second.values;
+    return true;
+}
+
+void GranuleDataCache::putInMemory(const string& key, const char* values, unsigned long long numBytes)
+{
+    // One slice bigger than the whole budget would just flush everything else.
+    if (numBytes > d_maxMemoryBytes || d_memoryCache.find(key) != d_memoryCache.end()) {
+        return;
+    }
+
+    while (d_memoryBytes + numBytes > d_maxMemoryBytes && !d_lru.empty()) {
+        MemoryCache::iterator oldest = d_memoryCache.find(d_lru.back());
+        d_memoryBytes -= oldest->second.values.size();
+        d_memoryCache.erase(oldest);
+        d_lru.pop_back();
+    }
+
+    d_lru.push_front(key);
+    MemoryEntry& entry = d_memoryCache[key];
+    entry.values.assign(values, values + numBytes);
+    entry.lruPos = d_lru.begin();
+    d_memoryBytes += numBytes;
+}
+
+string GranuleDataCache::getDiskFileName(const string& key)
+{
+    return get_cache_file_name(hashKey(key), false);
+}
+
+bool GranuleDataCache::getFromDisk(const string& key, std::vector<char>& values)
+{
+    string cacheFileName = getDiskFileName(key);
+
+    int fd;
+    bool found = false;
+    try {
+        // get_read_lock() returns false right away if there's no such file.
+        if (get_read_lock(cacheFileName, fd)) {
+            char magic[sizeof(DISK_MAGIC)];
+            uint32_t keyLen = 0;
+            uint64_t numBytes = 0;
+            string fileKey;
+            if (lseek(fd, 0, SEEK_SET) == 0 && readFully(fd, magic, sizeof(magic))
+                && memcmp(magic, DISK_MAGIC, sizeof(magic)) == 0 && readFully(fd, &keyLen, sizeof(keyLen))
+                && keyLen == key.size()) {
+                fileKey.resize(keyLen);
+                if (readFully(fd, &fileKey[0], keyLen) && fileKey == key && readFully(fd, &numBytes, sizeof(numBytes))
+                    && numBytes > 0) {
+                    values.resize(numBytes);
+                    found = readFully(fd, &values[0], numBytes);
+                }
+            }
+            unlock_and_close(cacheFileName);
+
+            if (!found) {
+                BESDEBUG(DEBUG_CHANNEL, "GranuleDataCache: " << cacheFileName << " isn't the entry for key=" << key << endl);
+            }
+        }
+    }
+    catch (...) {
+        BESDEBUG(DEBUG_CHANNEL, "GranuleDataCache::getFromDisk() - caught exception, unlocking cache and re-throw." << endl);
+        unlock_cache();
+        throw;
+    }
+
+    return found;
+}
+
+void GranuleDataCache::putOnDisk(const string& key, const char* values, unsigned long long numBytes)
+{
+    string cacheFileName = getDiskFileName(key);
+
+    int fd;
+    try {
+        // If another process (or a key with the same hash) got there first, leave it be.
+        if (create_and_lock(cacheFileName, fd)) {
+            uint32_t keyLen = key.size();
+            uint64_t numBytes64 = numBytes;
+            bool ok = writeFully(fd, DISK_MAGIC, sizeof(DISK_MAGIC)) && writeFully(fd, &keyLen, sizeof(keyLen))
+                && writeFully(fd, key.data(), keyLen) && writeFully(fd, &numBytes64, sizeof(numBytes64))
+                && writeFully(fd, values, numBytes);
+            if (!ok) {
+                // A short file fails the checks in getFromDisk(), the purge will get it.
+                BESDEBUG(DEBUG_CHANNEL, "GranuleDataCache: Failed to write " << cacheFileName << ": " << strerror(errno) << endl);
+            }
+
+            // Same dance as AggMemberDatasetDimensionCache::saveDimensionCache().
+            exclusive_to_shared_lock(fd);
+            unsigned long long size = update_cache_info(cacheFileName);
+            if (cache_too_big(size)) {
+                update_and_purge(cacheFileName);
+            }
+            unlock_and_close(cacheFileName);
+        }
+    }
+    catch (...) {
+        BESDEBUG(DEBUG_CHANNEL, "GranuleDataCache::putOnDisk() - caught exception, unlocking cache and re-throw." << endl);
+        unlock_cache();
+        throw;
+    }
+}
+
+} // namespace agg_util
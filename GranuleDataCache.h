@@ -0,0 +1,161 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef __AGG_UTIL__GRANULE_DATA_CACHE_H__
+#define __AGG_UTIL__GRANULE_DATA_CACHE_H__
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "AggMemberDataset.h" // agg_util
+#include "BESFileLockingCache.h"
+
+struct stat;
+
+namespace libdap {
+class Array;
+class BaseType;
+}
+
+namespace agg_util {
+
+/**
+ * Cache of the decoded values of granule array slices, shared by all the
+ * requests a BES process serves, so aggregations that are asked for the same
+ * (or the same parts of) granules over and over don't go back through the
+ * format handler every time.
+ *
+ * An entry is keyed by the granule's location and modification time, the
+ * variable name and the constraint on the granule's array, so a granule that
+ * changes simply stops matching its old entries. Only granules we can stat
+ * under the BES data root and arrays of numeric types are cached. NcML
+ * granules are never cached: their values depend on the files they refer
+ * to, which their own modification time says nothing about.
+ *
+ * There are two tiers:
+ *  - an in-process LRU, limited to MEMORY_SIZE_KEY megabytes.
+ *  - optionally, files in DIRECTORY_KEY managed by BESFileLockingCache,
+ *    so all the besd processes on a host share the slices any of them read.
+ *    A disk hit is also put in the memory tier.
+ *
+ * Both are off by default; get_instance() returns null unless one is set.
+ *
+ * It also holds the whole aggregated coordinate variable of joinExisting
+ * aggregations (see makeAggregationKey()), so the requests for it clients
+ * start with are answered without opening any granule.
+ */
+class GranuleDataCache: public BESFileLockingCache {
+public:
+    static const std::string MEMORY_SIZE_KEY;
+    static const std::string DIRECTORY_KEY;
+    static const std::string PREFIX_KEY;
+    static const std::string SIZE_KEY;
+
+    /** @return the cache, or null if both tiers are turned off */
+    static GranuleDataCache* get_instance();
+
+    /**
+     * Make the key for the slice of varName that constrainedArray's
+     * constraints select from the granule at location.
+     * @return false if that slice can't be cached (see class doc)
+     */
+    bool makeKey(const std::string& location, const std::string& varName, const libdap::Array& constrainedArray,
+        std::string& key);
+
+    /**
+     * On a hit, copy the cached values into constrainedArray's buffer and
+     * set its read_p, just as if it had been read.
+     * @return true on a hit
+     */
+    bool get(const std::string& key, libdap::Array& constrainedArray);
+
+    /** Store the values of the slice granuleArray, which was just read for key. */
+    void put(const std::string& key, libdap::Array& granuleArray);
+
+    /**
+     * Make the key for all of the values of varName (of aggArray's type and
+     * unconstrained size) aggregated over datasets, from the location and
+     * modification time of every granule.
+     * @return false if that can't be cached (see class doc)
+     */
+    bool makeAggregationKey(const AMDList& datasets, const std::string& varName, const libdap::Array& aggArray,
+        std::string& key);
+
+    /** The raw byte versions of get() and put(), used with makeAggregationKey(). */
+    bool get(const std::string& key, std::vector<char>& values);
+    void put(const std::string& key, const char* values, unsigned long long numBytes);
+
+    virtual ~GranuleDataCache();
+
+private:
+    struct MemoryEntry {
+        std::vector<char> values;
+        std::list<std::string>::iterator lruPos;
+    };
+    typedef std::map<std::string, MemoryEntry> MemoryCache;
+
+    GranuleDataCache(unsigned long long maxMemoryBytes, const std::string& dataRootDir, const std::string& cacheDir,
+        const std::string& prefix, unsigned long long maxCacheSize);
+    GranuleDataCache(const GranuleDataCache&); // disallow
+    GranuleDataCache& operator=(const GranuleDataCache&); // disallow
+
+    static void delete_instance();
+
+    /** Whether values of proto's type live in the Vector's buffer. */
+    static bool isCacheableType(libdap::BaseType* proto);
+
+    /** Whether location names an NcML file, compressed or not. */
+    static bool isNcMLLocation(const std::string& location);
+
+    /** stat() location under the data root, false if not a regular file
+     * there or if it is an NcML file (see isNcMLLocation()). */
+    bool statGranule(const std::string& location, struct stat& buf);
+
+    bool getFromMemory(const std::string& key, std::vector<char>& values);
+    void putInMemory(const std::string& key, const char* values, unsigned long long numBytes);
+    bool getFromDisk(const std::string& key, std::vector<char>& values);
+    void putOnDisk(const std::string& key, const char* values, unsigned long long numBytes);
+    std::string getDiskFileName(const std::string& key);
+
+    static GranuleDataCache* d_instance;
+    static bool d_configured;
+
+    MemoryCache d_memoryCache;
+    std::list<std::string> d_lru; // front is most recently used
+    unsigned long long d_memoryBytes;
+    unsigned long long d_maxMemoryBytes;
+
+    std::string d_dataRootDir;
+    bool d_useDisk;
+};
+
+} // namespace agg_util
+
+#endif /* __AGG_UTIL__GRANULE_DATA_CACHE_H__ */
@@ -0,0 +1,260 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+
+#include "config.h"
+#include "GranuleReadAhead.h"
+
+#include <fcntl.h>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "BESDebug.h"
+#include "BESUtil.h"
+#include "TheBESKeys.h"
+
+#include "DirectoryUtil.h"
+
+static const std::string DEBUG_CHANNEL("agg_util");
+
+namespace agg_util {
+
+const std::string GranuleReadAhead::READ_THREADS_KEY = "NCML.Aggregation.ReadThreads";
+const std::string GranuleReadAhead::READ_AHEAD_SIZE_KEY = "NCML.Aggregation.ReadAheadSize";
+const unsigned int GranuleReadAhead::MAX_READ_THREADS = 32;
+const unsigned long GranuleReadAhead::DEFAULT_READ_AHEAD_SIZE = 256;
+const unsigned long long GranuleReadAhead::HEADER_PREFETCH_BYTES = 256 * 1024;
+
+// How many granules per worker we allow ahead of the consumer.
+static const unsigned int WINDOW_PER_THREAD = 2;
+
+unsigned int GranuleReadAhead::getReadThreadsFromConfig()
+{
+    bool found = false;
+    std::string value;
+    TheBESKeys::TheKeys()->get_value(READ_THREADS_KEY, value, found);
+    if (!found || value.empty()) {
+        return 0;
+    }
+
+    std::istringstream iss(value);
+    int threads = 0;
+    iss >> threads;
+    if (iss.fail() || threads < 0) {
+        BESDEBUG(DEBUG_CHANNEL,
+            "GranuleReadAhead: ignoring bad value for " << READ_THREADS_KEY << "=\"" << value << "\"" << endl);
+        return 0;
+    }
+
+    if (static_cast<unsigned int>(threads) > MAX_READ_THREADS) {
+        return MAX_READ_THREADS;
+    }
+    return static_cast<unsigned int>(threads);
+}
+
+unsigned long long GranuleReadAhead::getReadAheadBytesFromConfig()
+{
+    bool found = false;
+    std::string value;
+    unsigned long megabytes = DEFAULT_READ_AHEAD_SIZE;
+    TheBESKeys::TheKeys()->get_value(READ_AHEAD_SIZE_KEY, value, found);
+    if (found && !value.empty()) {
+        std::istringstream iss(value);
+        iss >> megabytes;
+        if (iss.fail()) {
+            BESDEBUG(DEBUG_CHANNEL,
+                "GranuleReadAhead: ignoring bad value for " << READ_AHEAD_SIZE_KEY << "=\"" << value << "\"" << endl);
+            megabytes = DEFAULT_READ_AHEAD_SIZE;
+        }
+    }
+    return static_cast<unsigned long long>(megabytes) * 1024 * 1024;
+}
+
+GranuleReadAhead::GranuleReadAhead(const std::vector<std::string>& locations, unsigned int numThreads,
+    unsigned long long maxBytesAhead /* = 0 */, unsigned long long maxBytesPerFile /* = 0 */) :
+    _paths(), _threads(), _next(0), _consumed(0), _window(numThreads * WINDOW_PER_THREAD), _maxBytesAhead(
+        maxBytesAhead), _maxBytesPerFile(maxBytesPerFile), _bytesAhead(0), _bytesCharged(), _stop(false)
+{
+    pthread_mutex_init(&_mutex, 0);
+    pthread_cond_init(&_cond, 0);
+
+    if (numThreads == 0 || locations.empty()) {
+        return;
+    }
+
+    // Resolve everything here, the workers must not touch TheBESKeys.
+    const std::string rootDir = DirectoryUtil::getBESRootDir();
+    _paths.reserve(locations.size());
+    for (std::vector<std::string>::const_iterator it = locations.begin(); it != locations.end(); ++it) {
+        if (it->empty()) {
+            _paths.push_back("");
+        }
+        else {
+            _paths.push_back(BESUtil::assemblePath(rootDir, *it, true));
+        }
+    }
+
+    _bytesCharged.resize(_paths.size(), 0);
+
+    if (numThreads > _paths.size()) {
+        numThreads = _paths.size();
+    }
+
+    _threads.reserve(numThreads);
+    for (unsigned int i = 0; i < numThreads; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, 0, &GranuleReadAhead::workerMain, this) != 0) {
+            // Not fatal, we just get less read-ahead.
+            BESDEBUG(DEBUG_CHANNEL, "GranuleReadAhead: pthread_create failed, running with " << _threads.size()
+                << " threads." << endl);
+            break;
+        }
+        _threads.push_back(thread);
+    }
+
+    BESDEBUG(DEBUG_CHANNEL, "GranuleReadAhead: started " << _threads.size() << " threads for "
+        << _paths.size() << " granules." << endl);
+}
+
+GranuleReadAhead::~GranuleReadAhead()
+{
+    stopAndJoin();
+    pthread_cond_destroy(&_cond);
+    pthread_mutex_destroy(&_mutex);
+}
+
+void GranuleReadAhead::setConsumed(unsigned int index)
+{
+    if (_threads.empty()) {
+        return;
+    }
+
+    pthread_mutex_lock(&_mutex);
+    if (index + 1 > _consumed) {
+        // Give back the budget held by everything up to index.
+        for (unsigned int i = _consumed; i <= index && i < _bytesCharged.size(); ++i) {
+            _bytesAhead -= _bytesCharged[i];
+            _bytesCharged[i] = 0;
+        }
+        _consumed = index + 1;
+        pthread_cond_broadcast(&_cond);
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+void*
+GranuleReadAhead::workerMain(void* pThis)
+{
+    static_cast<GranuleReadAhead*>(pThis)->runWorker();
+    return 0;
+}
+
+void GranuleReadAhead::runWorker()
+{
+    unsigned int index = 0;
+    while (claimNext(index)) {
+        if (!_paths[index].empty()) {
+            prefetchFile(index);
+        }
+    }
+}
+
+bool GranuleReadAhead::claimNext(unsigned int& index)
+{
+    bool ret = false;
+    pthread_mutex_lock(&_mutex);
+    while (!_stop && _next < _paths.size() && _next >= _consumed + _window) {
+        pthread_cond_wait(&_cond, &_mutex);
+    }
+    if (!_stop && _next < _paths.size()) {
+        index = _next++;
+        ret = true;
+    }
+    pthread_mutex_unlock(&_mutex);
+    return ret;
+}
+
+bool GranuleReadAhead::reserveBytes(unsigned int index, unsigned long long size)
+{
+    bool ret = false;
+    pthread_mutex_lock(&_mutex);
+    // The granule the caller is waiting on (index == _consumed) always goes.
+    while (!_stop && index > _consumed && _maxBytesAhead > 0 && _bytesAhead + size > _maxBytesAhead) {
+        pthread_cond_wait(&_cond, &_mutex);
+    }
+    if (!_stop && index >= _consumed) {
+        _bytesCharged[index] = size;
+        _bytesAhead += size;
+        ret = true;
+    }
+    pthread_mutex_unlock(&_mutex);
+    return ret;
+}
+
+void GranuleReadAhead::prefetchFile(unsigned int index)
+{
+    int fd = open(_paths[index].c_str(), O_RDONLY);
+    if (fd < 0) {
+        // The real read will report it.
+        return;
+    }
+
+    struct stat buf;
+    unsigned long long size = 0;
+    if (fstat(fd, &buf) == 0 && buf.st_size > 0) {
+        size = static_cast<unsigned long long>(buf.st_size);
+    }
+    if (_maxBytesPerFile > 0 && size > _maxBytesPerFile) {
+        size = _maxBytesPerFile;
+    }
+
+    if (reserveBytes(index, size)) {
+#ifdef POSIX_FADV_WILLNEED
+        // A length of 0 means to the end of the file.
+        (void) posix_fadvise(fd, 0, static_cast<off_t>(_maxBytesPerFile), POSIX_FADV_WILLNEED);
+#endif
+    }
+    close(fd);
+}
+
+void GranuleReadAhead::stopAndJoin()
+{
+    pthread_mutex_lock(&_mutex);
+    _stop = true;
+    pthread_cond_broadcast(&_cond);
+    pthread_mutex_unlock(&_mutex);
+
+    for (std::vector<pthread_t>::iterator it = _threads.begin(); it != _threads.end(); ++it) {
+        pthread_join(*it, 0);
+    }
+    _threads.clear();
+}
+
+} // namespace agg_util
@@ -0,0 +1,163 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef __AGG_UTIL__GRANULE_READ_AHEAD_H__
+#define __AGG_UTIL__GRANULE_READ_AHEAD_H__
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+namespace agg_util {
+
+/**
+ * Small worker pool that walks a list of granule locations ahead of a
+ * loop that loads them one at a time (an aggregation's serialize(), or
+ * filling the joinExisting dimension cache) and asks the kernel to start
+ * paging the granule files in (open() + posix_fadvise(WILLNEED)), or just
+ * the start of each file when the caller only reads the metadata.
+ *
+ * The granules themselves are still loaded, read and marshalled by the
+ * calling thread, one at a time and in dataset order: the DDSLoader borrows
+ * the request's BESDataHandlerInterface and the format handlers it calls
+ * are not reentrant, so the actual reads cannot be farmed out to threads.
+ * What we CAN overlap is the disk (or network filesystem) latency of the
+ * next few granules with the load + read of the current one, which is
+ * where the time goes on large aggregations.
+ *
+ * Workers never run more than a fixed window ahead of the last granule
+ * the caller reported via setConsumed(), so a slow client does not cause
+ * the whole aggregation to be pulled into the page cache at once.  If a
+ * byte budget is given, the total size of the granule files prefetched
+ * but not yet consumed is also kept under it (the granule the caller
+ * needs next is always allowed through, however big it is).
+ *
+ * Workers do not touch BES state (no TheBESKeys, no BESDEBUG); all the
+ * location to path resolution happens in the ctor on the calling thread.
+ */
+class GranuleReadAhead {
+public:
+    /** The BES key giving the number of read-ahead worker threads. */
+    static const std::string READ_THREADS_KEY;
+
+    /** The BES key giving the read-ahead byte budget, in megabytes. */
+    static const std::string READ_AHEAD_SIZE_KEY;
+
+    /** Upper limit on the number of threads we'll start no matter what the key says. */
+    static const unsigned int MAX_READ_THREADS;
+
+    /** Budget used if READ_AHEAD_SIZE_KEY is not set, in megabytes. */
+    static const unsigned long DEFAULT_READ_AHEAD_SIZE;
+
+    /** How much of the start of each file to prefetch when the caller only
+     * needs the granule metadata, e.g. to fill the dimension cache. */
+    static const unsigned long long HEADER_PREFETCH_BYTES;
+
+    /**
+     * @return the value of READ_THREADS_KEY, or 0 (read-ahead disabled)
+     * if the key isn't set or can't be parsed.  Clamped to MAX_READ_THREADS.
+     */
+    static unsigned int getReadThreadsFromConfig();
+
+    /**
+     * @return the value of READ_AHEAD_SIZE_KEY converted to bytes, or
+     * DEFAULT_READ_AHEAD_SIZE in bytes if not set.  0 means no byte limit.
+     */
+    static unsigned long long getReadAheadBytesFromConfig();
+
+    /**
+     * Start numThreads workers prefetching the given locations in order.
+     * Empty locations (virtual datasets) are skipped.
+     * If numThreads == 0 or there is nothing to prefetch no threads are started.
+     *
+     * @param locations the granule locations, relative to the BES root dir,
+     *        in the order the caller will read them.
+     * @param numThreads number of worker threads to start.
+     * @param maxBytesAhead the most granule file bytes to have prefetched
+     *        past the caller at once, 0 for no limit.
+     * @param maxBytesPerFile prefetch only this much of the start of each
+     *        file, 0 for the whole file.
+     */
+    GranuleReadAhead(const std::vector<std::string>& locations, unsigned int numThreads,
+        unsigned long long maxBytesAhead = 0, unsigned long long maxBytesPerFile = 0);
+
+    /** Stops and joins the workers.  Unfinished prefetches are abandoned. */
+    ~GranuleReadAhead();
+
+    /**
+     * Tell the workers the caller has finished with the granule at index
+     * (into the ctor's locations list) so they can move the window forward.
+     */
+    void setConsumed(unsigned int index);
+
+    /** @return number of worker threads actually running. */
+    unsigned int getNumThreads() const
+    {
+        return _threads.size();
+    }
+
+private:
+    // Disallow copies, we own threads.
+    GranuleReadAhead(const GranuleReadAhead&);
+    GranuleReadAhead& operator=(const GranuleReadAhead&);
+
+    static void* workerMain(void* pThis);
+    void runWorker();
+
+    /** Block until there's a granule inside the window to prefetch.
+     * @return false if the workers should exit. */
+    bool claimNext(unsigned int& index);
+
+    /** Block until size more bytes fit into the budget, then charge them to index.
+     * @return false if the caller has already gone past index or we're stopping. */
+    bool reserveBytes(unsigned int index, unsigned long long size);
+
+    /** Open the file, charge its size (up to _maxBytesPerFile) against the
+     * budget for index and hint the kernel to read that much in.  Errors are ignored. */
+    void prefetchFile(unsigned int index);
+
+    void stopAndJoin();
+
+private:
+    std::vector<std::string> _paths; // absolute paths, "" to skip
+    std::vector<pthread_t> _threads;
+    pthread_mutex_t _mutex;
+    pthread_cond_t _cond;
+    unsigned int _next; // next index a worker will claim
+    unsigned int _consumed; // one past the last index the caller finished with
+    unsigned int _window; // max number of granules ahead of _consumed we prefetch
+    unsigned long long _maxBytesAhead; // 0 for no limit
+    unsigned long long _maxBytesPerFile; // 0 for the whole file
+    unsigned long long _bytesAhead; // sum of _bytesCharged
+    std::vector<unsigned long long> _bytesCharged; // per index, cleared when consumed
+    bool _stop;
+};
+
+} // namespace agg_util
+
+#endif /* __AGG_UTIL__GRANULE_READ_AHEAD_H__ */
@@ -110,19 +110,25 @@ GridAggregationBase::transform_to_dap4(D4Group *root, Constructor *container)
     // the latter only on the condition that they are not already there.
 
     for (Map_iter i = map_begin(), e = map_end(); i != e; ++i) {
-        btp = (*i)->transform_to_dap4(root, container);
-        Array *map = static_cast<Array*>(btp);
-        if (!map) throw InternalErr(__FILE__, __LINE__, "Expected an Array while transforming a Grid (map)");
+        // Only add the map/array if it not already present; given the scoping rules
+        // for DAP2 and the assumption the DDS is valid, testing for the same name
+        // is good enough. Grids of an aggregation share their maps, so bind to the
+        // one already there rather than transforming (and copying the values of)
+        // the same map for every Grid.
+        Array *map = dynamic_cast<Array*>(root->var((*i)->name()));
+        if (!map) {
+            btp = (*i)->transform_to_dap4(root, container);
+            map = static_cast<Array*>(btp);
+            if (!map) throw InternalErr(__FILE__, __LINE__, "Expected an Array while transforming a Grid (map)");
 
-        // map must be non-null (Grids cannot contain Grids in DAP2)
-        if (map) {
-            // Only add the map/array if it not already present; given the scoping rules
-            // for DAP2 and the assumption the DDS is valid, testing for the same name
-            // is good enough.
             if (!root->var(map->name())) {
                 map->set_parent(container);
                 container->add_var_nocopy(map);	// this adds the array to the container
             }
+        }
+
+        // map must be non-null (Grids cannot contain Grids in DAP2)
+        if (map) {
             D4Map *dap4_map = new D4Map(map->name(), map, coverage);	// bind the 'map' to the coverage
             coverage->maps()->add_map(dap4_map);	// bind the coverage to the map
         }
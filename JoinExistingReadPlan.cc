@@ -0,0 +1,97 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+
+#include "JoinExistingReadPlan.h"
+
+#include <algorithm>
+
+#include "NCMLDebug.h"
+
+namespace agg_util {
+
+void JoinExistingReadPlan::buildGranuleOffsets(const AMDList& datasets, const std::string& dimName,
+    std::vector<unsigned int>& offsets)
+{
+    offsets.clear();
+    offsets.reserve(datasets.size() + 1);
+    unsigned int sum = 0;
+    offsets.push_back(sum);
+    for (AMDList::const_iterator it = datasets.begin(); it != datasets.end(); ++it) {
+        sum += (*it)->getCachedDimensionSize(dimName);
+        offsets.push_back(sum);
+    }
+}
+
+unsigned int JoinExistingReadPlan::findGranuleForIndex(const std::vector<unsigned int>& offsets, unsigned int index)
+{
+    NCML_ASSERT(!offsets.empty());
+    // First granule whose end (the next granule's head) is past index.
+    // Empty granules have head == end so they are skipped over for free.
+    std::vector<unsigned int>::const_iterator it = std::upper_bound(offsets.begin() + 1, offsets.end(), index);
+    return static_cast<unsigned int>(it - (offsets.begin() + 1));
+}
+
+JoinExistingReadPlan::JoinExistingReadPlan(const std::vector<unsigned int>& offsets, int start, int stride,
+    int stop) :
+    _reads()
+{
+    NCML_ASSERT(!offsets.empty());
+    NCML_ASSERT_MSG(stride > 0, "JoinExistingReadPlan: stride must be positive!");
+
+    const int total = static_cast<int>(offsets.back());
+    const int lastIndex = std::min(stop, total - 1);
+
+    int index = start;
+    while (index >= 0 && index <= lastIndex) {
+        unsigned int granule = findGranuleForIndex(offsets, index);
+        NCML_ASSERT(granule + 1 < offsets.size());
+
+        const int head = static_cast<int>(offsets[granule]);
+        const int granuleSize = static_cast<int>(offsets[granule + 1]) - head;
+
+        GranuleRead read;
+        read.datasetIndex = granule;
+        read.granuleSize = granuleSize;
+        read.localStart = index - head;
+        // Clamp the stride into the granule or add_constraint() will complain.
+        read.localStride = std::min(stride, granuleSize);
+        read.localStop = std::min(stop - head, granuleSize - 1);
+        _reads.push_back(read);
+
+        // Step past the last index the constraint hits in this granule.
+        const int lastInGranule = std::min(lastIndex, head + granuleSize - 1);
+        index += ((lastInGranule - index) / stride + 1) * stride;
+    }
+}
+
+JoinExistingReadPlan::~JoinExistingReadPlan()
+{
+}
+
+} // namespace agg_util
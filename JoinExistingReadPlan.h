@@ -0,0 +1,126 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef __AGG_UTIL__JOIN_EXISTING_READ_PLAN_H__
+#define __AGG_UTIL__JOIN_EXISTING_READ_PLAN_H__
+
+#include <string>
+#include <vector>
+
+#include "AggMemberDataset.h" // agg_util
+
+namespace agg_util {
+
+/**
+ * Maps a start/stride/stop constraint on the outer (join) dimension of a
+ * joinExisting aggregation into the list of granules that actually need
+ * to be read and the local hyperslab on the outer dimension of each.
+ *
+ * The mapping is done against a prefix sum of the granule sizes on the
+ * join dimension (see buildGranuleOffsets()), so finding the granule for
+ * an index is a binary search rather than a walk over every granule
+ * before it, and granules a large stride steps right over never appear
+ * in the plan at all.
+ *
+ * Used by ArrayJoinExistingAggregation, which means both the Array and the
+ * Grid (data array and outer map) joinExisting paths.
+ */
+class JoinExistingReadPlan {
+public:
+
+    /** One granule's worth of a read: which dataset and the constraint
+     * to put on its outer dimension (in granule-local indices). */
+    struct GranuleRead {
+        unsigned int datasetIndex; // index into the AMDList
+        int granuleSize; // size of the join dim in this granule
+        int localStart;
+        int localStride;
+        int localStop;
+    };
+
+    typedef std::vector<GranuleRead>::const_iterator const_iterator;
+
+    /**
+     * Fill offsets with the prefix sum of the dimName cardinality of each
+     * dataset: offsets[i] is the aggregated index of the first element of
+     * datasets[i] and offsets[datasets.size()] is the aggregated size.
+     * ASSUMES the dimension cache of every dataset has dimName in it.
+     */
+    static void buildGranuleOffsets(const AMDList& datasets, const std::string& dimName,
+        std::vector<unsigned int>& offsets);
+
+    /**
+     * @return the index of the dataset holding aggregated index, or
+     * offsets.size() - 1 if index is past the end.  O(log N).
+     */
+    static unsigned int findGranuleForIndex(const std::vector<unsigned int>& offsets, unsigned int index);
+
+    /**
+     * Make the plan for the given outer dimension constraint.
+     * @param offsets the result of buildGranuleOffsets().
+     * @param start constraint start in aggregated space
+     * @param stride constraint stride, > 0
+     * @param stop constraint stop (inclusive) in aggregated space.
+     *        Clamped to the aggregated size.
+     */
+    JoinExistingReadPlan(const std::vector<unsigned int>& offsets, int start, int stride, int stop);
+
+    ~JoinExistingReadPlan();
+
+    const_iterator begin() const
+    {
+        return _reads.begin();
+    }
+
+    const_iterator end() const
+    {
+        return _reads.end();
+    }
+
+    unsigned int size() const
+    {
+        return _reads.size();
+    }
+
+    bool empty() const
+    {
+        return _reads.empty();
+    }
+
+    const GranuleRead& operator[](unsigned int i) const
+    {
+        return _reads[i];
+    }
+
+private:
+    std::vector<GranuleRead> _reads;
+};
+
+} // namespace agg_util
+
+#endif /* __AGG_UTIL__JOIN_EXISTING_READ_PLAN_H__ */
@@ -0,0 +1,103 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+
+#include "LoadedGranuleLRU.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include "BESDebug.h"
+#include "TheBESKeys.h"
+
+#include "AggMemberDataset.h"
+
+static const std::string DEBUG_CHANNEL("agg_util");
+
+namespace agg_util {
+
+const std::string LoadedGranuleLRU::MAX_LOADED_GRANULES_KEY = "NCML.Aggregation.MaxLoadedGranules";
+const unsigned int LoadedGranuleLRU::DEFAULT_MAX_LOADED_GRANULES = 0;
+
+unsigned int LoadedGranuleLRU::getMaxLoadedGranulesFromConfig()
+{
+    bool found = false;
+    std::string value;
+    TheBESKeys::TheKeys()->get_value(MAX_LOADED_GRANULES_KEY, value, found);
+    if (!found || value.empty()) {
+        return DEFAULT_MAX_LOADED_GRANULES;
+    }
+
+    std::istringstream iss(value);
+    int maxLoaded = 0;
+    iss >> maxLoaded;
+    if (iss.fail() || maxLoaded < 0) {
+        BESDEBUG(DEBUG_CHANNEL,
+            "LoadedGranuleLRU: ignoring bad value for " << MAX_LOADED_GRANULES_KEY << "=\"" << value << "\"" << endl);
+        return DEFAULT_MAX_LOADED_GRANULES;
+    }
+    return static_cast<unsigned int>(maxLoaded);
+}
+
+LoadedGranuleLRU::LoadedGranuleLRU(unsigned int maxLoaded) :
+    _lru(), _size(0), _maxLoaded(maxLoaded)
+{
+}
+
+LoadedGranuleLRU::~LoadedGranuleLRU()
+{
+    _lru.clear();
+    _size = 0;
+}
+
+void LoadedGranuleLRU::touch(AggMemberDataset& dataset)
+{
+    if (_maxLoaded == 0) {
+        return;
+    }
+
+    // Small list, linear search is fine.
+    std::list<AggMemberDataset*>::iterator it = std::find(_lru.begin(), _lru.end(), &dataset);
+    if (it != _lru.end()) {
+        _lru.splice(_lru.begin(), _lru, it);
+        return;
+    }
+
+    _lru.push_front(&dataset);
+    ++_size;
+
+    while (_size > _maxLoaded) {
+        AggMemberDataset* pOldest = _lru.back();
+        _lru.pop_back();
+        --_size;
+        BESDEBUG(DEBUG_CHANNEL, "LoadedGranuleLRU: releasing DDS for location=" << pOldest->getLocation() << endl);
+        pOldest->releaseDDS();
+    }
+}
+
+} // namespace agg_util
@@ -0,0 +1,91 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef __AGG_UTIL__LOADED_GRANULE_LRU_H__
+#define __AGG_UTIL__LOADED_GRANULE_LRU_H__
+
+#include <list>
+#include <string>
+
+namespace agg_util {
+class AggMemberDataset;
+
+/**
+ * Keeps at most a fixed number of aggregation member datasets holding a
+ * loaded DDS while code walks an AMDList, calling releaseDDS() on the
+ * least recently used one when a new granule pushes it over the limit.
+ *
+ * Meant to be used as a local in a loop over granules: call touch() on
+ * each AggMemberDataset just before reading from it (never while still
+ * holding a ptr into the DDS of another granule that might get evicted).
+ * Since the eviction happens before the new granule is loaded, at most
+ * maxLoaded granules the loop visits are ever loaded at once.  The
+ * datasets are not ref'd, so the AMDList being walked must outlive this
+ * object.  Nothing is released on destruction, the last maxLoaded
+ * granules stay loaded for whoever reads them next.
+ */
+class LoadedGranuleLRU {
+public:
+    /** The BES key for the max number of loaded granules per aggregation read. */
+    static const std::string MAX_LOADED_GRANULES_KEY;
+
+    /** Used if MAX_LOADED_GRANULES_KEY is not set: 0, no limit.  Each
+     * projected variable makes its own pass over the granules, so with a
+     * limit below the granule count every variable reloads them. */
+    static const unsigned int DEFAULT_MAX_LOADED_GRANULES;
+
+    /** @return MAX_LOADED_GRANULES_KEY or the default.  0 means no limit. */
+    static unsigned int getMaxLoadedGranulesFromConfig();
+
+    /** @param maxLoaded max granules left loaded, 0 means never release any. */
+    explicit LoadedGranuleLRU(unsigned int maxLoaded);
+
+    ~LoadedGranuleLRU();
+
+    /** Mark dataset as most recently used, releasing the DDS of the
+     * least recently used one if we're over the limit. */
+    void touch(AggMemberDataset& dataset);
+
+    /** @return number of datasets currently tracked as loaded */
+    unsigned int size() const
+    {
+        return _size;
+    }
+
+private:
+    LoadedGranuleLRU(const LoadedGranuleLRU&); // disallow
+    LoadedGranuleLRU& operator=(const LoadedGranuleLRU&); // disallow
+
+    std::list<AggMemberDataset*> _lru; // front is most recently used
+    unsigned int _size; // _lru.size() is O(n) in C++98
+    unsigned int _maxLoaded;
+};
+
+} // namespace agg_util
+
+#endif /* __AGG_UTIL__LOADED_GRANULE_LRU_H__ */
@@ -32,11 +32,16 @@
 #include <dods-datatypes.h>
 #include <Array.h>
 #include <BaseType.h>
+#include <ConstraintEvaluator.h>
+#include <D4StreamMarshaller.h>
+#include <DDS.h>
+#include <Marshaller.h>
 #include <Vector.h>
 #include <memory>
 // #include "MyBaseTypeFactory.h"
 #include "NCMLBaseArray.h"
 #include "NCMLDebug.h"
+#include "RCObject.h"
 #include "Shape.h"
 #include <sstream>
 #include <string>
@@ -58,6 +63,41 @@ using std::vector;
 namespace ncml_module {
 class Shape;
 
+/**
+ * @brief The values of the whole unconstrained space of an NCMLArray<T>.
+ *
+ * These never change once made, so an NCMLArray<T> and all its ptr_duplicate()
+ * copies (e.g. in the copies of the DDS) share one, reference counted, rather
+ * than each holding their own.
+ */
+template<typename T>
+class NCMLArrayValues: public agg_util::RCObject {
+private:
+    NCMLArrayValues(const NCMLArrayValues<T>& proto); // disallow
+    NCMLArrayValues<T>& operator=(const NCMLArrayValues<T>& rhs); // disallow
+
+public:
+    /** Take the contents of values, leaving it empty. */
+    explicit NCMLArrayValues(std::vector<T>& values) :
+        agg_util::RCObjectInterface(), agg_util::RCObject(), _values()
+    {
+        _values.swap(values);
+    }
+
+    virtual ~NCMLArrayValues()
+    {
+    }
+
+    const std::vector<T>& values() const
+    {
+        return _values;
+    }
+
+private:
+    std::vector<T> _values;
+};
+// class NCMLArrayValues<T>
+
 /**
  * @brief A parameterized subclass of libdap::Array that allows us to apply constraints on
  * NcML-specified data prior to serialization.  All the code is in the .h, so no .cc is defined.
@@ -75,6 +115,11 @@ class Shape;
  * the current Vector._buf so that on subsequent read() calls it can check to see if the constraints
  * have changed and if so recompute Vector._buf.
  *
+ * The full set of data is held in an NCMLArrayValues<T> shared with every copy made with
+ * ptr_duplicate(), and once it is cached the Vector buffer is released, so between
+ * read() calls the values exist once no matter how many copies of the DDS there are.
+ * The Vector buffer only ever holds the constrained values made for the last read().
+ *
  * We use a template on the underlying data type stored, such as dods_byte, dods_int32, etc.
  * Note that this can ALSO be std::string, in which case Vector does special processing.  We
  * need to be aware of this in processing data.
@@ -93,17 +138,17 @@ public:
 public:
     // Instance methods
     NCMLArray() :
-        NCMLBaseArray(""), _allValues(0)
+        NCMLBaseArray(""), _allValues()
     {
     }
 
     explicit NCMLArray(const string& name) :
-        NCMLBaseArray(name), _allValues(0)
+        NCMLBaseArray(name), _allValues()
     {
     }
 
     explicit NCMLArray(const NCMLArray<T>& proto) :
-        NCMLBaseArray(proto), _allValues(0)
+        NCMLBaseArray(proto), _allValues()
     {
         copyLocalRepFrom(proto);
     }
@@ -164,18 +209,84 @@ public:
         }
 
         // Finally, copy the data.
-        // Initialize with length() values so the storage and size of _allValues is correct.
-        _allValues = new std::vector<T>(from.length());
-        NCML_ASSERT(_allValues->size() == static_cast<unsigned int>(from.length()));
+        // Initialize with length() values so the storage and size of the values is correct.
+        std::vector<T> values(from.length());
+        NCML_ASSERT(values.size() == static_cast<unsigned int>(from.length()));
 
         // Copy the values in from._buf into our cache!
-        T* pFirst = &((*_allValues)[0]);
+        T* pFirst = &(values[0]);
         from.buf2val(reinterpret_cast<void**>(&pFirst));
+        _allValues = agg_util::RCPtr<NCMLArrayValues<T> >(new NCMLArrayValues<T>(values));
     }
 
     virtual bool isDataCached() const
     {
-        return _allValues;
+        return _allValues.get();
+    }
+
+    /** With no constraints, send the shared values as they are rather than
+     * having read() copy them all into the Vector buffer first.  Strings and
+     * hyperslabs go through read() and libdap as usual.
+     */
+    virtual bool serialize(libdap::ConstraintEvaluator& eval, libdap::DDS& dds, libdap::Marshaller& m, bool ce_eval)
+    {
+        if (!canSerializeFromValues()) {
+            return NCMLBaseArray::serialize(eval, dds, m, ce_eval);
+        }
+
+        // Same as libdap::Vector::serialize(), less the read().
+        dds.timeout_on();
+        if (ce_eval && !eval.eval_selection(dds, dataset())) {
+            dds.timeout_off();
+            return true;
+        }
+        dds.timeout_off();
+
+        char* pValues = reinterpret_cast<char*>(const_cast<T*>(&(_allValues->values()[0])));
+        switch (var()->type()) {
+        case libdap::dods_byte_c:
+        case libdap::dods_char_c:
+        case libdap::dods_int8_c:
+        case libdap::dods_uint8_c:
+            m.put_vector(pValues, length(), *this);
+            break;
+
+        default:
+            m.put_vector(pValues, length(), var()->width(), *this);
+            break;
+        }
+        return true;
+    }
+
+    /** The DAP4 version of serialize() above. */
+    virtual void serialize(libdap::D4StreamMarshaller& m, libdap::DMR& dmr, bool filter = false)
+    {
+        if (!canSerializeFromValues()) {
+            NCMLBaseArray::serialize(m, dmr, filter);
+            return;
+        }
+
+        char* pValues = reinterpret_cast<char*>(const_cast<T*>(&(_allValues->values()[0])));
+        switch (var()->type()) {
+        case libdap::dods_byte_c:
+        case libdap::dods_char_c:
+        case libdap::dods_int8_c:
+        case libdap::dods_uint8_c:
+            m.put_vector(pValues, length());
+            break;
+
+        case libdap::dods_float32_c:
+            m.put_vector_float32(pValues, length());
+            break;
+
+        case libdap::dods_float64_c:
+            m.put_vector_float64(pValues, length());
+            break;
+
+        default:
+            m.put_vector(pValues, length(), var()->width());
+            break;
+        }
     }
 
     /////////////////////////////////////////////////////////////
@@ -299,14 +410,14 @@ protected:
      */
     virtual void cacheValuesIfNeeded()
     {
-        // If the super Vector has no capacity, it's not set up correctly, so don't call this or we get exception.
-        if (get_value_capacity() == 0) {
-            BESDEBUG("ncml", "cacheValuesIfNeeded: the superclass Vector has no data so not copying...");
-        }
-
         // If we haven't gotten this yet, go get it,
         // assuming the super Vector contains all values
-        if (!_allValues) {
+        if (!_allValues.get()) {
+            // If the super Vector has no capacity, it's not set up correctly, so don't call this or we get exception.
+            if (get_value_capacity() == 0) {
+                BESDEBUG("ncml", "cacheValuesIfNeeded: the superclass Vector has no data so not copying...");
+            }
+
             BESDEBUG("ncml",
                 "NCMLArray<T>:: we don't have unconstrained values cached, caching from Vector now..." << endl);
             unsigned int spaceSize = _noConstraints->getUnconstrainedSpaceSize();
@@ -321,16 +432,20 @@ protected:
                 "NCMLArray expected superclass Vector length() to be the same as unconstrained space size, but it wasn't!");
 #endif
             // Make new default storage with enough space for all the data.
-            _allValues = new vector<T>(spaceSize);
-            NCML_ASSERT(_allValues->size() == spaceSize); // the values should all be default for T().
+            vector<T> values(spaceSize);
+            NCML_ASSERT(values.size() == spaceSize); // the values should all be default for T().
             // Grab the address of the start of the vector memory block.
             // This is safe since vector memory is required to be contiguous
-            T* pFirstElt = &((*_allValues)[0]);
+            T* pFirstElt = &(values[0]);
             // Now overwrite the defaults in from the buffer.
             unsigned int stored = buf2val(reinterpret_cast<void**>(&pFirstElt));
 
             NCML_ASSERT((stored / sizeof(T)) == spaceSize); // make sure it did what it was supposed to do.
-            // OK, we have our copy now!
+            _allValues = agg_util::RCPtr<NCMLArrayValues<T> >(new NCMLArrayValues<T>(values));
+
+            // OK, we have our copy now, so drop the one in Vector.  read() makes
+            // the constrained values it needs, and ptr_duplicate() won't copy these.
+            clear_local_data();
         }
 
         // We ignore the current constraints since we don't worry about them until later in read().
@@ -343,63 +458,72 @@ protected:
      * with the proper constrained data.
      * ASSUMES: cacheSuperclassStateIfNeeded() has already been called once so
      * that this instance's state contains all the unconstrained data values and shape.
+     * An unconstrained serialize() skips this and sends _allValues itself, so the
+     * unconstrained copy here is only made for other read() callers.
      */
     virtual void createAndSetConstrainedValueBuffer()
     {
         BESDEBUG("ncml", "NCMLArray<T>::createAndSetConstrainedValueBuffer() called!" << endl);
 
-        // Whether to validate, depending on debug build or not.
-#ifdef NDEBUG
-        const bool validateBounds = false;
-#else
-        const bool validateBounds = true;
-#endif
-
         // These need to exist or caller goofed.
         VALID_PTR(_noConstraints);
-        VALID_PTR(_allValues);
-
-        // This reflects the current constraints, so is what we want.
-        unsigned int numVals = length();
-        vector<T> values; // Exceptions may wind through and I want this storage cleaned, so vector<T> rather than T*.
-        values.reserve(numVals);
+        VALID_PTR(_allValues.get());
+        const vector<T>& allValues = _allValues->values();
 
         // Our current space, with constraints
         const Shape shape = getSuperShape();
-        Shape::IndexIterator endIt = shape.endSpaceEnumeration();
-        Shape::IndexIterator it;
-        unsigned int count = 0;  // just a counter for number of points for sanity checking
-        for (it = shape.beginSpaceEnumeration(); it != endIt; ++it, ++count) {
-            // Take the current point in constrained space, look it up in cached 3values, set it as next elt in output
-            values.push_back((*_allValues)[_noConstraints->getRowMajorIndex(*it, validateBounds)]);
-        }
-
-        // Sanity check the number of points we added.  They need to match or something is wrong.
-        if (count != static_cast<unsigned int>(length())) {
+        if (allValues.size() < shape.getUnconstrainedSpaceSize()) {
             stringstream msg;
-            msg << "While adding points to hyperslab buffer we got differing number of points "
-                "from Shape space enumeration as expected from the constraints! "
-                "Shape::IndexIterator produced " << count << " points but we expected " << length();
+            msg << "While making the hyperslab buffer we found " << allValues.size()
+                << " cached values for an unconstrained space of " << shape.getUnconstrainedSpaceSize() << " points!";
             THROW_NCML_INTERNAL_ERROR(msg.str());
         }
 
-        if (count != shape.getConstrainedSpaceSize()) {
+        // This reflects the current constraints, so is what we want.
+        unsigned int numVals = length();
+        if (numVals == 0) {
+            return;
+        }
+
+        // The Vector buffer may have been released or made for another constraint, so
+        // don't reuse it.  With no constraints, copy straight from the shared values.
+        if (!shape.isConstrained()) {
+            NCML_ASSERT(numVals <= allValues.size());
+            val2buf(const_cast<void*>(static_cast<const void*>(&(allValues[0]))), false);
+            return;
+        }
+
+        vector<T> values(numVals); // Exceptions may wind through and I want this storage cleaned, so vector<T> rather than T*.
+
+        // Copies whole runs of the hyperslab rather than looking up each point.
+        unsigned int count = shape.copyConstrainedValues(&(allValues[0]), &(values[0]));
+
+        // Sanity check the number of points we added.  They need to match or something is wrong.
+        if (count != numVals || count != shape.getConstrainedSpaceSize()) {
             stringstream msg;
             msg << "While adding points to hyperslab buffer we got differing number of points "
-                "from Shape space enumeration as expected from the shape.getConstrainedSpaceSize()! "
-                "Shape::IndexIterator produced " << count << " points but we expected "
-                << shape.getConstrainedSpaceSize();
+                "than expected from the constraints! "
+                "Shape::copyConstrainedValues() produced " << count << " points but we expected " << numVals
+                << " and the shape has " << shape.getConstrainedSpaceSize();
             THROW_NCML_INTERNAL_ERROR(msg.str());
         }
 
         // Otherwise, we're good, so blast the values into the valuebuffer.
-        // tell it to reuse the current buffer since by definition is has enough room since it holds all points to start.
-        val2buf(static_cast<void*>(&(values[0])), true);
+        val2buf(static_cast<void*>(&(values[0])), false);
     }
 
 private:
     // This class ONLY methods
 
+    /** Whether serialize() can send _allValues directly: a numeric type, no constraints and some values. */
+    bool canSerializeFromValues()
+    {
+        cacheSuperclassStateIfNeeded();
+        libdap::Type type = var()->type();
+        return type != libdap::dods_str_c && type != libdap::dods_url_c && !isConstrained() && length() > 0
+            && _allValues.get() && static_cast<unsigned int>(length()) <= _allValues->values().size();
+    }
+
     /** Copy in this the local data (private rep) in proto
      * Used by ptr_duplicate() and copy ctor */
     void copyLocalRepFrom(const NCMLArray<T>& proto)
@@ -412,24 +536,21 @@ private:
         // Blow away any old data before copying new
         destroy();
 
-        // If there are values, make a copy of the vector.
-        if (proto._allValues) {
-            _allValues = new vector<T>(*(proto._allValues));
-        }
+        // The values never change, so share them.
+        _allValues = proto._allValues;
     }
 
     /** Helper to destroy all the local data to pristine state. */
     void destroy() throw ()
     {
-        delete _allValues;
-        _allValues = 0;
+        _allValues = agg_util::RCPtr<NCMLArrayValues<T> >(0);
     }
 
 private:
 
     // The unconstrained data set, cached from super in first call to cacheSuperclassStateIfNeeded()
-    // if it is null.
-    std::vector<T>* _allValues;
+    // if it is null.  Shared with our copies.
+    agg_util::RCPtr<NCMLArrayValues<T> > _allValues;
 
 };
 // class NCMLArray<T>
@@ -28,18 +28,66 @@
 /////////////////////////////////////////////////////////////////////////////
 #include "NCMLCacheAggXMLCommand.h"
 
+#include <memory>
+#include <sstream>
+#include <sys/time.h>
+
+#include <DDS.h>
+#include <Grid.h>
+
 #include "BESXMLUtils.h"
 #include "BESUtil.h"
+#include "BESForbiddenError.h"
 #include "BESSyntaxUserError.h"
 #include "BESDebug.h"
+#include "BESInfo.h"
+#include "BESInfoList.h"
+#include "BESDapResponse.h"
+#include "BESStopWatch.h"
 
+#include "AggMemberDatasetDimensionCache.h"
+#include "ArrayJoinExistingAggregation.h"
+#include "DDSLoader.h"
+#include "DirectoryUtil.h"
 #include "NCMLDebug.h"
+#include "NCMLParser.h"
 #include "NCMLResponseNames.h"
+#include "NCMLUtil.h"
 
+using std::auto_ptr;
 using std::string;
+using agg_util::AggMemberDatasetDimensionCache;
+using agg_util::ArrayJoinExistingAggregation;
+using agg_util::DDSLoader;
+using agg_util::DirectoryUtil;
 
 namespace ncml_module {
 
+/** Fill the joinExisting coordinate variable cache from the variables of dds
+ * and the maps of its Grids.  @return how many of them are in the cache. */
+static unsigned int fillCoordinateCaches(libdap::DDS& dds)
+{
+    unsigned int numCached = 0;
+    for (libdap::DDS::Vars_iter it = dds.var_begin(); it != dds.var_end(); ++it) {
+        ArrayJoinExistingAggregation* pArray = dynamic_cast<ArrayJoinExistingAggregation*>(*it);
+        if (pArray && pArray->fillCoordinateCache()) {
+            ++numCached;
+        }
+
+        libdap::Grid* pGrid = dynamic_cast<libdap::Grid*>(*it);
+        if (!pGrid) {
+            continue;
+        }
+        for (libdap::Grid::Map_iter mapIt = pGrid->map_begin(); mapIt != pGrid->map_end(); ++mapIt) {
+            ArrayJoinExistingAggregation* pMap = dynamic_cast<ArrayJoinExistingAggregation*>(*mapIt);
+            if (pMap && pMap->fillCoordinateCache()) {
+                ++numCached;
+            }
+        }
+    }
+    return numCached;
+}
+
 NCMLCacheAggXMLCommand::NCMLCacheAggXMLCommand(const BESDataHandlerInterface& baseDHI) :
     BESXMLCommand(baseDHI)
 {
@@ -143,13 +191,89 @@ void NCMLCacheAggResponseHandler::execute(BESDataHandlerInterface& dhi)
 
     const std::string& loc = dhi.data[ModuleConstants::CACHE_AGG_LOCATION_DATA_KEY];
     BESDEBUG("ncml", "We got a cacheAgg request for the aggregation location = " << loc << endl);
+
+    BESStopWatch sw;
+    if (BESISDEBUG(TIMING_LOG)) sw.start("NCMLCacheAggResponseHandler::execute", loc);
+
+    AggMemberDatasetDimensionCache *dimCache = AggMemberDatasetDimensionCache::get_instance();
+    unsigned long long hitsBefore = dimCache ? dimCache->getMemoryCacheHits() : 0;
+    unsigned long long missesBefore = dimCache ? dimCache->getMemoryCacheMisses() : 0;
+
+    struct timeval startTime;
+    gettimeofday(&startTime, 0);
+
+    // The location comes from the client, keep it inside the data root.
+    if (DirectoryUtil::hasRelativePath(loc)) {
+        throw BESForbiddenError("cacheAgg: can't use location=" + loc + " since it has a relative path (../)",
+            __FILE__, __LINE__);
+    }
+    string rootDir = DirectoryUtil::getBESRootDir();
+    BESUtil::check_path(loc, rootDir, false); // no symlinks, as DirectoryUtil::setRootDir()
+
+    // Loading the NcML as a DDX runs the scans and fills the caches
+    // for every granule, exactly as the first DDS request would.
+    // Then the joinExisting coordinate variables are read whole to
+    // fill their GranuleDataCache entries, as the first data request would.
+    string filename = BESUtil::assemblePath(rootDir, loc, true);
+    unsigned int numCoordinatesCached = 0;
+    {
+        DDSLoader loader(dhi);
+        NCMLParser parser(loader);
+        auto_ptr<BESDapResponse> loaded_bdds = parser.parse(filename, DDSLoader::eRT_RequestDDX);
+        libdap::DDS* pDDS = NCMLUtil::getDDSFromEitherResponse(loaded_bdds.get());
+        if (pDDS) {
+            numCoordinatesCached = fillCoordinateCaches(*pDDS);
+        }
+    }
+
+    struct timeval endTime;
+    gettimeofday(&endTime, 0);
+    double seconds = (endTime.tv_sec - startTime.tv_sec) + (endTime.tv_usec - startTime.tv_usec) / 1.0e6;
+
+    BESInfo *info = BESInfoList::TheList()->build_info();
+    _response = info;
+    info->begin_response(ModuleConstants::CACHE_AGG_RESPONSE, dhi);
+
+    map<string, string> attrs;
+    attrs[ModuleConstants::CACHE_AGG_LOCATION_XML_ATTR] = loc;
+    info->begin_tag(ModuleConstants::CACHE_AGG_RESPONSE, &attrs);
+
+    std::ostringstream oss;
+    oss << seconds;
+    info->add_tag("seconds", oss.str());
+
+    if (dimCache) {
+        oss.str("");
+        oss << dimCache->getMemoryCacheHits() - hitsBefore;
+        info->add_tag("dimensionCacheHits", oss.str());
+        oss.str("");
+        oss << dimCache->getMemoryCacheMisses() - missesBefore;
+        info->add_tag("dimensionCacheMisses", oss.str());
+    }
+
+    oss.str("");
+    oss << numCoordinatesCached;
+    info->add_tag("coordinateVariablesCached", oss.str());
+
+    info->end_tag(ModuleConstants::CACHE_AGG_RESPONSE);
+    info->end_response();
+
+    BESDEBUG("ncml", "cacheAgg for " << loc << " took " << seconds << " seconds." << endl);
 }
 
 /* virtual */
-void NCMLCacheAggResponseHandler::transmit(BESTransmitter* /* pTransmitter */, BESDataHandlerInterface& /* dhi */)
+void NCMLCacheAggResponseHandler::transmit(BESTransmitter* pTransmitter, BESDataHandlerInterface& dhi)
 {
     BESDEBUG("ncml",
         "NCMLCacheAggResponseHandler::transmit() called for command: " << ModuleConstants::CACHE_AGG_RESPONSE << endl);
+
+    if (_response) {
+        BESInfo *info = dynamic_cast<BESInfo *>(_response);
+        if (!info) {
+            THROW_NCML_INTERNAL_ERROR("NCMLCacheAggResponseHandler::transmit(): expected a BESInfo response object.");
+        }
+        info->transmit(pTransmitter, dhi);
+    }
 }
 
 /* virtual */
@@ -38,7 +38,12 @@ namespace ncml_module {
 /**
  * The BESXMLCommand for the command to recalculate the aggregation caches.
  *
- * @note This code is not currently used. jhrg 4/16/14
+ * @verbatim <cacheAgg location="path/to/file.ncml"/> @endverbatim
+ *
+ * The location is relative to the BES catalog root. The NcML file is loaded
+ * just as for a DDS request, expanding its scan elements and filling the
+ * dimension cache for every granule, so it can be run (e.g. from cron)
+ * after new data lands instead of leaving that cost to the first user.
  */
 class NCMLCacheAggXMLCommand: public BESXMLCommand {
 public:
@@ -59,7 +64,9 @@ public:
 // class NCMLCacheAggXMLCommand
 
 /**
- * The response handler for the NCMLCacheAggXMLCommand
+ * The response handler for the NCMLCacheAggXMLCommand. The response is a
+ * BESInfo reporting the location, how long the caching took and the
+ * dimension cache hit counts.
  */
 class NCMLCacheAggResponseHandler: public BESResponseHandler {
 public:
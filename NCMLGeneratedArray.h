@@ -0,0 +1,181 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2009 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef __NCML_MODULE__NCMLGENERATEDARRAY_H__
+#define __NCML_MODULE__NCMLGENERATEDARRAY_H__
+
+#include <Array.h>
+#include <BaseType.h>
+#include "NCMLBaseArray.h"
+#include "NCMLDebug.h"
+#include "Shape.h"
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace ncml_module {
+
+/**
+ * @brief An NCMLBaseArray for the values@start and values@increment form of a values element.
+ * All the code is in the .h, so no .cc is defined.
+ *
+ * Rather than holding every value of the sequence like NCMLArray<T>, this stores only
+ * the start and increment and (in the Array superclass) the shape.  read() computes
+ * just the points in the current constraint into the Vector buffer, so a request for
+ * the DDS or DAS, or for a few points of a long coordinate variable, never makes the
+ * whole sequence.
+ *
+ * The point at row major index i of the unconstrained space is start + i * increment in
+ * type T (with the usual wraparound for the integer types), the same as ValuesElement
+ * makes for an existing variable.  Each point is computed on its own, so the floating
+ * point values don't pick up the rounding of a running sum.
+ */
+template<typename T>
+class NCMLGeneratedArray: public NCMLBaseArray {
+public:
+    /** Make the generated version of proto, which has its name, attributes, template var
+     * and dimensions set but no values, using the given start and increment.
+     */
+    NCMLGeneratedArray(const NCMLBaseArray& proto, T start, T increment) :
+        NCMLBaseArray(proto), _start(start), _increment(increment)
+    {
+    }
+
+    explicit NCMLGeneratedArray(const NCMLGeneratedArray<T>& proto) :
+        NCMLBaseArray(proto), _start(proto._start), _increment(proto._increment)
+    {
+    }
+
+    virtual ~NCMLGeneratedArray()
+    {
+    }
+
+    NCMLGeneratedArray<T>&
+    operator=(const NCMLGeneratedArray<T>& rhs)
+    {
+        if (&rhs == this) {
+            return *this;
+        }
+
+        NCMLBaseArray::operator=(rhs);
+        _start = rhs._start;
+        _increment = rhs._increment;
+        return *this;
+    }
+
+    /** Override virtual constructor, deep clone */
+    virtual NCMLGeneratedArray<T>* ptr_duplicate()
+    {
+        return new NCMLGeneratedArray(*this);
+    }
+
+    /** Our values are a function of the start and increment, so there's nothing to copy into. */
+    virtual void copyDataFrom(libdap::Array& from)
+    {
+        THROW_NCML_INTERNAL_ERROR(
+            "NCMLGeneratedArray<T>::copyDataFrom(): can't copy values into the generated array name=" + name()
+                + " from array name=" + from.name());
+    }
+
+    /** The values can always be generated. */
+    virtual bool isDataCached() const
+    {
+        return true;
+    }
+
+protected:
+
+    /** Nothing to cache, the unconstrained shape from NCMLBaseArray is all we need. */
+    virtual void cacheValuesIfNeeded()
+    {
+    }
+
+    /**
+     * Generate the values for the current constraints of the super Array
+     * into the Vector buffer.
+     * ASSUMES: cacheSuperclassStateIfNeeded() has already been called once.
+     */
+    virtual void createAndSetConstrainedValueBuffer()
+    {
+        BESDEBUG("ncml", "NCMLGeneratedArray<T>::createAndSetConstrainedValueBuffer() called!" << endl);
+
+        VALID_PTR(_noConstraints);
+
+        // Our current space, with constraints
+        const Shape shape = getSuperShape();
+        unsigned int numVals = length();
+        if (numVals == 0) {
+            return;
+        }
+
+        std::vector<T> values(numVals);
+        RunGenerator generator(_start, _increment, &(values[0]));
+        shape.visitConstrainedRuns(generator);
+        values.resize(generator.out - &(values[0]));
+
+        if (values.size() != numVals || values.size() != shape.getConstrainedSpaceSize()) {
+            std::stringstream msg;
+            msg << "While generating the hyperslab buffer we got differing number of points "
+                "than expected from the constraints! "
+                "We generated " << values.size() << " points but we expected " << numVals
+                << " and the shape has " << shape.getConstrainedSpaceSize();
+            THROW_NCML_INTERNAL_ERROR(msg.str());
+        }
+
+        // Don't reuse the buffer: unlike NCMLArray<T> it may have been made for a smaller constraint.
+        val2buf(static_cast<void*>(&(values[0])), false);
+    }
+
+private:
+    /** The Shape::visitConstrainedRuns() visitor that computes the values of each run. */
+    struct RunGenerator {
+        RunGenerator(T startValue, T incrementValue, T* pOut) :
+            start(startValue), increment(incrementValue), out(pOut)
+        {
+        }
+
+        void operator()(unsigned int first, unsigned int count, unsigned int step)
+        {
+            for (unsigned int i = 0, index = first; i < count; ++i, index += step) {
+                *out++ = static_cast<T>(start + index * increment);
+            }
+        }
+
+        T start;
+        T increment;
+        T* out;
+    };
+
+    T _start;
+    T _increment;
+};
+// class NCMLGeneratedArray<T>
+
+}// namespace ncml_module
+
+#endif /* __NCML_MODULE__NCMLGENERATEDARRAY_H__ */
@@ -48,10 +48,12 @@
 #include "NCMLModule.h"
 #include "NCMLRequestHandler.h"
 #include "NCMLResponseNames.h"
+#include "NCMLCacheAggXMLCommand.h"
+#include "TransformedDDSCache.h"
+#include "UnionVariableIndex.h"
 
 #if 0
 // Not used. jhrg 8/12/15
-#include "NCMLCacheAggXMLCommand.h"
 #include "NCMLContainerStorage.h"
 #endif
 
@@ -66,12 +68,9 @@ void NCMLModule::initialize(const string &modname)
 
     BESRequestHandlerList::TheList()->add_handler(modname, new NCMLRequestHandler(modname));
 
-    // If new commands are needed, then let's declare this once here. If
-    // not, then you can remove this line.
-#if 0
-    // Not used. jhrg 4/16/14
+    // Adds the cacheAgg command used to pre-build the aggregation caches.
     addCommandAndResponseHandlers(modname);
-#endif
+
     // Dap services
     BESDapService::handle_dap_service(modname);
 
@@ -113,10 +112,11 @@ void NCMLModule::terminate(const string &modname)
     if (rh) delete rh;
 
     // If new commands were added, remove them here.
-#if 0
-    // Not used. jhrg 4/16/14
     removeCommandAndResponseHandlers();
-#endif
+
+    // The cached DDSs hold our types, free them while the module is still loaded.
+    TransformedDDSCache::delete_instance();
+    UnionVariableIndex::delete_instance();
 
     BESContainerStorageList::TheList()->deref_persistence(NCML_CATALOG);
 
@@ -142,8 +142,6 @@ void NCMLModule::dump(ostream &strm) const
     strm << BESIndent::LMarg << "NCMLModule::dump - (" << (void *) this << ")" << endl;
 }
 
-#if 0
-// Not used. jhrg 4/16/14
 void NCMLModule::addCommandAndResponseHandlers(const string& modname)
 {
     BESDEBUG(modname, "Adding module extensions..." << endl);
@@ -182,4 +180,3 @@ void NCMLModule::removeCacheAggCommandAndResponseHandlers()
     BESDEBUG( ModuleConstants::NCML_NAME, "    removing " << cmdName << " command" << endl );
     BESXMLCommand::del_command(cmdName);
 }
-#endif
@@ -52,8 +52,9 @@
 #include "NetcdfElement.h"  // ncml_module
 #include "OtherXMLParser.h" // ncml_module
 #include <parser.h> // libdap  for the type checking...
-#include "SaxParserWrapper.h"  // ncml_module
+#include "CompiledNcML.h" // ncml_module
 #include <sstream>
+#include <sys/stat.h>
 
 // For extra debug spew for now.
 #define DEBUG_NCML_PARSER_INTERNALS 1
@@ -67,6 +68,7 @@ static const unsigned int MAX_DAP_STRING_SIZE = 32767;
 
 // Consider filling this with a compilation flag.
 /* static */bool NCMLParser::sThrowExceptionOnUnknownElements = true;
+/* static */NCMLParser* NCMLParser::sInnermostParser = 0;
 
 // An attribute or variable with type "Structure" will match this string.
 const string NCMLParser::STRUCTURE_TYPE("Structure");
@@ -134,7 +136,7 @@ void AttrTableLazyPtr::loadAndSetAttrTable()
 NCMLParser::NCMLParser(DDSLoader& loader) :
     _filename(""), _loader(loader), _responseType(DDSLoader::eRT_RequestDDX), _response(0), _rootDataset(0), _currentDataset(
         0), _pVar(0), _pCurrentTable(*this, 0), _elementStack(), _scope(), _namespaceStack(), _pOtherXMLParser(0), _currentParseLine(
-        NO_CURRENT_PARSE_LINE_NUMBER)
+        NO_CURRENT_PARSE_LINE_NUMBER), _recordDependencies(false), _dependencies(), _resultCacheable(true), _requestedVariables(), _skippedUnionMembers(false)
 {
     BESDEBUG("ncml", "Created NCMLParser." << endl);
 }
@@ -179,10 +181,36 @@ void NCMLParser::parseInto(const string& ncmlFilename, DDSLoader::ResponseType r
     // In case we care.
     _filename = ncmlFilename;
 
-    // Invoke the libxml sax parser
-    SaxParserWrapper parser(*this);
+    // A nested parse reports what it read to the one it's nested in.
+    NCMLParser* pEnclosingParser = sInnermostParser;
+    if (pEnclosingParser && pEnclosingParser->_recordDependencies) {
+        _recordDependencies = true;
+    }
+
+    // Start the record of what this parse reads with the NcML file itself.
+    _dependencies.clear();
+    _resultCacheable = true;
+    _skippedUnionMembers = false;
+    addDependency(ncmlFilename);
+
+    // Invoke the libxml sax parser, or replay the compiled form of the file
+    sInnermostParser = this;
+    try {
+        CompiledNcML::parse(ncmlFilename, *this);
+    }
+    catch (...) {
+        sInnermostParser = pEnclosingParser;
+        throw;
+    }
+    sInnermostParser = pEnclosingParser;
 
-    parser.parse(ncmlFilename);
+    if (pEnclosingParser && _recordDependencies) {
+        pEnclosingParser->_dependencies.insert(pEnclosingParser->_dependencies.end(), _dependencies.begin(),
+            _dependencies.end());
+        if (!_resultCacheable) {
+            pEnclosingParser->setResultUncacheable();
+        }
+    }
 
     // Prepare for a new parse, making sure it's all cleaned up (with the exception of the _ddsResponse
     // which where's about to send off)
@@ -197,6 +225,75 @@ bool NCMLParser::parsing() const
     return !_filename.empty();
 }
 
+void NCMLParser::setRecordDependencies(bool record)
+{
+    _recordDependencies = record;
+}
+
+const NCMLParser::DependencyList&
+NCMLParser::getDependencies() const
+{
+    return _dependencies;
+}
+
+/* static */
+bool NCMLParser::isAnyParseInProgress()
+{
+    return sInnermostParser != 0;
+}
+
+bool NCMLParser::isResultCacheable() const
+{
+    return _resultCacheable;
+}
+
+void NCMLParser::setRequestedVariables(const std::set<std::string>& names)
+{
+    _requestedVariables = names;
+}
+
+const std::set<std::string>&
+NCMLParser::getRequestedVariables() const
+{
+    return _requestedVariables;
+}
+
+bool NCMLParser::skippedUnionMembers() const
+{
+    return _skippedUnionMembers;
+}
+
+bool NCMLParser::isRecordingDependencies() const
+{
+    return _recordDependencies;
+}
+
+void NCMLParser::addDependency(const std::string& fullPath, time_t modTime)
+{
+    if (_recordDependencies) {
+        _dependencies.push_back(std::make_pair(fullPath, modTime));
+    }
+}
+
+void NCMLParser::addDependency(const std::string& fullPath)
+{
+    if (!_recordDependencies) {
+        return;
+    }
+    struct stat statBuf;
+    addDependency(fullPath, (stat(fullPath.c_str(), &statBuf) == 0) ? statBuf.st_mtime : 0);
+}
+
+void NCMLParser::setResultUncacheable()
+{
+    _resultCacheable = false;
+}
+
+void NCMLParser::setSkippedUnionMembers()
+{
+    _skippedUnionMembers = true;
+}
+
 int NCMLParser::getParseLineNumber() const
 {
     return _currentParseLine;
@@ -695,6 +792,44 @@ void NCMLParser::deleteVariableAtCurrentScope(const string& name)
     }
 }
 
+BaseType*
+NCMLParser::replaceCurrentVariable(BaseType& replacement)
+{
+    BaseType* pOldVar = _pVar;
+    VALID_PTR(pOldVar);
+    const string name = pOldVar->name();
+    NCML_ASSERT_MSG(replacement.name() == name,
+        "NCMLParser::replaceCurrentVariable: replacement name=" + replacement.name()
+            + " doesn't match the current variable name=" + name);
+
+    BaseType* pNewVar = 0;
+    BaseType* pParent = pOldVar->get_parent();
+    if (pParent) // In container?
+    {
+        Structure* pVarContainer = dynamic_cast<Structure*>(pParent);
+        if (!pVarContainer) {
+            THROW_NCML_INTERNAL_ERROR(
+                "NCMLParser::replaceCurrentVariable: the parent of variable name=" + name
+                    + " is not a Structure class variable!  scope=" + getTypedScopeString());
+        }
+        pVarContainer->del_var(name);
+        pVarContainer->add_var(&replacement); // adds a copy
+        pNewVar = agg_util::AggregationUtil::getVariableNoRecurse(*pVarContainer, name);
+    }
+    else // Global
+    {
+        DDS* pDDS = getDDSForCurrentDataset();
+        VALID_PTR(pDDS);
+        pDDS->del_var(name);
+        pDDS->add_var(&replacement); // adds a copy
+        pNewVar = agg_util::AggregationUtil::getVariableNoRecurse(*pDDS, name);
+    }
+    VALID_PTR(pNewVar);
+
+    setCurrentVariable(pNewVar);
+    return pNewVar;
+}
+
 BaseType*
 NCMLParser::getCurrentVariable() const
 {
@@ -33,9 +33,12 @@
 #include "config.h"
 
 #include <memory>
+#include <set>
 #include <stack>
 #include <string>
+#include <utility>
 #include <vector>
+#include <time.h>
 
 #include <AttrTable.h> // needed due to parameter with AttrTable::Attr_iter
 
@@ -224,6 +227,37 @@ public:
     /** If using namespaces, get the current stack of namespaces. Might be empty. */
     const XMLNamespaceStack& getXMLNamespaceStack() const;
 
+    /** (full path, modification time) of a file or directory the parse depended on */
+    typedef std::vector<std::pair<std::string, time_t> > DependencyList;
+
+    /** Record getDependencies() during the parse. Off by default, since it
+     * stats every dataset, and only needed to cache the result. A nested
+     * parse (of an NcML dataset location) records if the parse it's nested
+     * in does, and adds what it recorded to that parse's dependencies. */
+    void setRecordDependencies(bool record);
+
+    /** The NcML file, the datasets it refers to and the scanned directories
+     * of the last parse, if it recorded them (see setRecordDependencies()).
+     * If none of them have changed, neither has the result. */
+    const DependencyList& getDependencies() const;
+
+    /** Is an NcML parse running on this thread? If so, a new one is nested in it. */
+    static bool isAnyParseInProgress();
+
+    /** False if the result of the last parse depends on more than
+     * getDependencies(), e.g. on the time of day through scan@olderThan. */
+    bool isResultCacheable() const;
+
+    /** Only the top-level variables in names will be read from the result,
+     * so union aggregations need only load the members that provide them
+     * (see AggregationElement::processUnion()). Empty, the default, means all. */
+    void setRequestedVariables(const std::set<std::string>& names);
+    const std::set<std::string>& getRequestedVariables() const;
+
+    /** True if the last parse left out union members because of
+     * setRequestedVariables(). */
+    bool skippedUnionMembers() const;
+
     ////////////////////////////////////////////////////////////////////////////////
     // Interface SaxParser:  Wrapped calls from the libxml C SAX parser
 
@@ -249,6 +283,21 @@ public:
 private:
     //methods
 
+    /** Is this parse recording its dependencies? See setRecordDependencies() */
+    bool isRecordingDependencies() const;
+
+    /** Record something the result of this parse depends on, see getDependencies() */
+    void addDependency(const std::string& fullPath, time_t modTime);
+
+    /** As above, using the current modification time of fullPath (0 if it can't be stat'd) */
+    void addDependency(const std::string& fullPath);
+
+    /** Note that the result of this parse can't be reused, see isResultCacheable() */
+    void setResultUncacheable();
+
+    /** Note that a union left out some of its members, see skippedUnionMembers() */
+    void setSkippedUnionMembers();
+
     /** Is the innermost scope an atomic (leaf) attribute? */
     bool isScopeAtomicAttribute() const;
 
@@ -406,6 +455,18 @@ private:
      */
     void deleteVariableAtCurrentScope(const string& name);
 
+    /** @brief Replace the current variable with a copy of replacement, which must have
+     * the same name, in its container (the top-level DDS or a Structure) and make
+     * the copy the current variable.
+     *
+     * This is for swapping in a different class for a new variable while
+     * it is still being parsed, so it is always the last variable in its container
+     * and removing it and adding the copy keeps the variable order.
+     *
+     * @return the copy now in the container.
+     */
+    BaseType* replaceCurrentVariable(BaseType& replacement);
+
     /** Get the current variable container we are in.  If NULL, we are
      * within the top level DDS scope and not a cosntructor variable.
      */
@@ -607,6 +668,10 @@ private:
     // If false, we just BESDEBUG the warning and ignore them entirely.
     static bool sThrowExceptionOnUnknownElements;
 
+    // The innermost parse in progress. Parses only nest through DDSLoader,
+    // which runs on the request thread.
+    static NCMLParser* sInnermostParser;
+
     // name of the ncml file we are parsing
     string _filename;
 
@@ -663,6 +728,15 @@ private:
     // Where we are in the parse to help debugging, set from the SaxParser interface.
     int _currentParseLine;
 
+    // What the last parse read, kept after the parse for the caller.
+    bool _recordDependencies;
+    DependencyList _dependencies;
+    bool _resultCacheable;
+
+    // See setRequestedVariables() and skippedUnionMembers()
+    std::set<std::string> _requestedVariables;
+    bool _skippedUnionMembers;
+
 };
 // class NCMLParser
 
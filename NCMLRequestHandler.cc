@@ -29,6 +29,7 @@
 #include "config.h"
 
 #include <memory>
+#include <set>
 
 #include <DMR.h>
 #include <DataDDS.h>
@@ -39,6 +40,7 @@
 #include "NCMLRequestHandler.h"
 
 #include <BESConstraintFuncs.h>
+#include <BESContainer.h>
 #include <BESContainerStorage.h>
 #include <BESContainerStorageList.h>
 #include <BESDapNames.h>
@@ -51,6 +53,7 @@
 #include <BESDebug.h>
 #include "BESStopWatch.h"
 #include <BESInternalError.h>
+#include <BESSyntaxUserError.h>
 #include <BESDapError.h>
 #include <BESError.h>
 #include <BESRequestHandlerList.h>
@@ -63,12 +66,14 @@
 #include <TheBESKeys.h>
 
 #include "DDSLoader.h"
+#include "DecompressingReader.h"
 
 #include "NCMLDebug.h"
 #include "NCMLUtil.h"
 #include "NCMLParser.h"
 #include "NCMLResponseNames.h"
 #include "SimpleLocationParser.h"
+#include "TransformedDDSCache.h"
 
 using namespace agg_util;
 using namespace ncml_module;
@@ -155,6 +160,88 @@ bool NCMLRequestHandler::ncml_build_redirect(BESDataHandlerInterface &dhi, const
 }
 #endif
 
+// The ncml file to parse for the container. The parser streams compressed
+// ncml files itself (see DecompressingReader), so for those we skip access(),
+// which would uncompress the whole file into the BES cache first.
+static string getNcmlFilename(BESContainer* container)
+{
+    string realName = container->get_real_name();
+    if (DecompressingReader::isCompressedFilename(realName)) {
+        return realName;
+    }
+    return container->access();
+}
+
+// Parse the ncml file into the DDX response. If useCache, take it from the
+// TransformedDDSCache when the ncml and everything it refers to are unchanged
+// since the last parse, and store the result there otherwise. Only metadata
+// responses that don't call server functions may use the cache, see
+// TransformedDDSCache and callsServerFunctions().
+static void parseDDXInto(BESDataHandlerInterface &dhi, const string& filename, BESDapResponse* response, bool useCache)
+{
+    // A parse nested in another one (an NcML dataset location) has to run
+    // so the outer parse sees everything the inner one depends on.
+    TransformedDDSCache* cache = useCache ? TransformedDDSCache::get_instance() : 0;
+    if (cache && !NCMLParser::isAnyParseInProgress() && cache->get(filename, NCMLUtil::getDDSFromEitherResponse(response))) {
+        return;
+    }
+
+    // Block it up to force cleanup of DHI.
+    {
+        DDSLoader loader(dhi);
+        NCMLParser parser(loader);
+        parser.setRecordDependencies(cache != 0);
+        parser.parseInto(filename, DDSLoader::eRT_RequestDDX, response);
+
+        if (cache && parser.isResultCacheable()) {
+            DDS* dds = NCMLUtil::getDDSFromEitherResponse(response);
+            VALID_PTR(dds);
+            cache->put(filename, *dds, parser.getDependencies());
+        }
+    }
+}
+
+// Does the request call server functions, in a DAP2 constraint or as a
+// DAP4 function? They read the variables of the response we build, even
+// for a DDS or DMR, and a DDS from the TransformedDDSCache holds
+// aggregations whose members load through the DDSLoader of the request
+// that built it, which is long gone. So those requests mustn't use it.
+static bool callsServerFunctions(BESDataHandlerInterface &dhi)
+{
+    return dhi.container->get_constraint().find('(') != string::npos
+        || !dhi.container->get_dap4_function().empty();
+}
+
+// The top-level variables a DAP2 constraint projects. Leaves names empty if
+// we can't be sure those are all it refers to: no projection (everything),
+// selections and function calls (which may name others) or escaped names.
+static void getProjectedVariableNames(const string& ce, std::set<string>& names)
+{
+    names.clear();
+    if (ce.empty() || ce.find_first_of("&()%\"") != string::npos) {
+        return;
+    }
+
+    string::size_type start = 0;
+    while (start <= ce.size()) {
+        string::size_type end = ce.find(',', start);
+        if (end == string::npos) {
+            end = ce.size();
+        }
+        // Just the top-level name of " grid.array[0:1]" and the like
+        string name = ce.substr(start, end - start);
+        name = name.substr(0, name.find_first_of("[."));
+        string::size_type first = name.find_first_not_of(" \t\n");
+        name = (first == string::npos) ? "" : name.substr(first, name.find_last_not_of(" \t\n") - first + 1);
+        if (name.empty()) {
+            names.clear();
+            return;
+        }
+        names.insert(name);
+        start = end + 1;
+    }
+}
+
 // Here we load the DDX response with by hijacking the current dhi via DDSLoader
 // and hand it to our parser to load the ncml, load the DDX for the location,
 // apply ncml transformations to it, then return the modified DDS.
@@ -163,13 +250,12 @@ bool NCMLRequestHandler::ncml_build_das(BESDataHandlerInterface &dhi)
     BESStopWatch sw;
     if (BESISDEBUG(TIMING_LOG)) sw.start("NCMLRequestHandler::ncml_build_das", dhi.data[REQUEST_ID]);
 
-    string filename = dhi.container->access();
+    string filename = getNcmlFilename(dhi.container);
 
     // Any exceptions winding through here will cause the loader and parser dtors
     // to clean up dhi state, etc.
-    DDSLoader loader(dhi);
-    NCMLParser parser(loader);
-    auto_ptr<BESDapResponse> loaded_bdds = parser.parse(filename, DDSLoader::eRT_RequestDDX);
+    auto_ptr<BESDapResponse> loaded_bdds = DDSLoader::makeResponseForType(DDSLoader::eRT_RequestDDX);
+    parseDDXInto(dhi, filename, loaded_bdds.get(), true);
 
     // Now fill in the desired DAS response object from the DDS
     DDS* dds = NCMLUtil::getDDSFromEitherResponse(loaded_bdds.get());
@@ -198,7 +284,7 @@ bool NCMLRequestHandler::ncml_build_dds(BESDataHandlerInterface &dhi)
     BESStopWatch sw;
     if (BESISDEBUG(TIMING_LOG)) sw.start("NCMLRequestHandler::ncml_build_dds", dhi.data[REQUEST_ID]);
 
-    string filename = dhi.container->access();
+    string filename = getNcmlFilename(dhi.container);
 
     // Any exceptions winding through here will cause the loader and parser dtors
     // to clean up dhi state, etc.
@@ -246,19 +332,14 @@ bool NCMLRequestHandler::ncml_build_dds(BESDataHandlerInterface &dhi)
     BESStopWatch sw;
     if (BESISDEBUG(TIMING_LOG)) sw.start("NCMLRequestHandler::ncml_build_dds", dhi.data[REQUEST_ID]);
 
-    string filename = dhi.container->access();
+    string filename = getNcmlFilename(dhi.container);
 
     // it better be a data response!
     BESDDSResponse* ddsResponse = dynamic_cast<BESDDSResponse *>(dhi.response_handler->get_response_object());
     NCML_ASSERT_MSG(ddsResponse,
         "NCMLRequestHandler::ncml_build_data(): expected BESDDSResponse* but didn't get it!!");
 
-    // Block it up to force cleanup of DHI.
-    {
-        DDSLoader loader(dhi);
-        NCMLParser parser(loader);
-        parser.parseInto(filename, DDSLoader::eRT_RequestDDX, ddsResponse);
-    }
+    parseDDXInto(dhi, filename, ddsResponse, !callsServerFunctions(dhi));
 
     DDS *dds = ddsResponse->get_dds();
     VALID_PTR(dds);
@@ -283,15 +364,45 @@ bool NCMLRequestHandler::ncml_build_data(BESDataHandlerInterface &dhi)
     BESStopWatch sw;
     if (BESISDEBUG(TIMING_LOG)) sw.start("NCMLRequestHandler::ncml_build_data", dhi.data[REQUEST_ID]);
 
-    string filename = dhi.container->access();
+    string filename = getNcmlFilename(dhi.container);
 
     // it better be a data response!
     BESDataDDSResponse* dataResponse = dynamic_cast<BESDataDDSResponse *>(dhi.response_handler->get_response_object());
     NCML_ASSERT_MSG(dataResponse,
         "NCMLRequestHandler::ncml_build_data(): expected BESDataDDSResponse* but didn't get it!!");
 
+    // Union aggregations only need the members with the variables asked for.
+    std::set<string> requested;
+    getProjectedVariableNames(dhi.container->get_constraint(), requested);
+
     // Block it up to force cleanup of DHI.
+    bool retryWithAllMembers = false;
     {
+        DDSLoader loader(dhi);
+        NCMLParser parser(loader);
+        parser.setRequestedVariables(requested);
+        try {
+            parser.parseInto(filename, DDSLoader::eRT_RequestDataDDS, dataResponse);
+        }
+        catch (BESSyntaxUserError &e) {
+            // The NcML may refer to variables of the members that were left out.
+            if (!parser.skippedUnionMembers()) {
+                throw;
+            }
+            BESDEBUG("ncml", "NCMLRequestHandler::ncml_build_data(): " << e.get_message()
+                << " Parsing again with all the union members." << endl);
+            retryWithAllMembers = true;
+        }
+    }
+
+    if (retryWithAllMembers) {
+        DDS* dds = NCMLUtil::getDDSFromEitherResponse(dataResponse);
+        VALID_PTR(dds);
+        while (dds->var_begin() != dds->var_end()) {
+            dds->del_var(dds->var_begin());
+        }
+        dds->get_attr_table().erase();
+
         DDSLoader loader(dhi);
         NCMLParser parser(loader);
         parser.parseInto(filename, DDSLoader::eRT_RequestDataDDS, dataResponse);
@@ -320,18 +431,18 @@ bool NCMLRequestHandler::ncml_build_dmr(BESDataHandlerInterface &dhi)
     BESStopWatch sw;
     if (BESISDEBUG(TIMING_LOG)) sw.start("NCMLRequestHandler::ncml_build_dmr", dhi.data[REQUEST_ID]);
 
-    // Because this code does not yet know how to build a DMR directly, use
-    // the DMR ctor that builds a DMR using a 'full DDS' (a DDS with attributes).
-    // First step, build the 'full DDS'
-    string data_path = dhi.container->access();
+    // The NcML transformations work on a DDS, so build the 'full DDS'
+    // (a DDS with attributes) first and move it into the DMR below.
+    string data_path = getNcmlFilename(dhi.container);
 
     DDS *dds = 0;	// This will be deleted when loaded_bdds goes out of scope.
     auto_ptr<BESDapResponse> loaded_bdds(0);
     try {
-        DDSLoader loader(dhi);
-        NCMLParser parser(loader);
-        loaded_bdds = parser.parse(data_path, DDSLoader::eRT_RequestDDX);
+        // The DAP4 data response, and a DMR request with a function,
+        // reads through this DMR, so only a plain DMR can come from the cache.
+        loaded_bdds = DDSLoader::makeResponseForType(DDSLoader::eRT_RequestDDX);
         if (!loaded_bdds.get()) throw BESInternalError("Null BESDDSResonse in ncml DDS handler.", __FILE__, __LINE__);
+        parseDDXInto(dhi, data_path, loaded_bdds.get(), dhi.action == DMR_RESPONSE && !callsServerFunctions(dhi));
         dds = NCMLUtil::getDDSFromEitherResponse(loaded_bdds.get());
         VALID_PTR(dds);
         dds->filename(data_path);
@@ -356,11 +467,13 @@ bool NCMLRequestHandler::ncml_build_dmr(BESDataHandlerInterface &dhi)
     BESDMRResponse &bdmr = dynamic_cast<BESDMRResponse &>(*response);
 
     // Get the DMR made by the BES in the BES/dap/BESDMRResponseHandler, make sure there's a
-    // factory we can use and then dump the DAP2 variables and attributes in using the
-    // BaseType::transform_to_dap4() method that transforms individual variables
+    // factory we can use and then move the DAP2 variables and attributes in using the
+    // BaseType::transform_to_dap4() method that transforms individual variables.
+    // Each DAP2 variable is freed once it's transformed, rather than the whole DDS
+    // living alongside the DMR until we return.
     DMR *dmr = bdmr.get_dmr();
     dmr->set_factory(new D4BaseTypeFactory);
-    dmr->build_using_dds(*dds);
+    NCMLUtil::transferVariablesAndAttributesInto(*dds, *dmr);
 
     // Instead of fiddling with the internal storage of the DHI object,
     // (by setting dhi.data[DAP4_CONSTRAINT], etc., directly) use these
@@ -34,6 +34,9 @@
 #include "DAS.h"
 #include "DDS.h"
 #include <DataDDS.h>
+#include <DMR.h>
+#include <D4Group.h>
+#include <D4Attributes.h>
 #include <AttrTable.h>
 
 #include "BESDapResponse.h"
@@ -253,6 +256,34 @@ void NCMLUtil::copyVariablesAndAttributesInto(DDS* dds_out, const DDS& dds_in)
     }
 }
 
+void NCMLUtil::transferVariablesAndAttributesInto(DDS& dds, DMR& dmr)
+{
+    dmr.set_name(dds.get_dataset_name());
+    dmr.set_filename(dds.filename());
+
+    D4Group* root = dmr.root();
+    VALID_PTR(root);
+    root->attributes()->transform_to_dap4(dds.get_attr_table());
+
+    while (dds.var_begin() != dds.var_end()) {
+        DDS::Vars_iter it = dds.var_begin();
+        BaseType* var = *it;
+        if (!root->var(var->name())) {
+            // Grids add their own coverage and maps to root and return null.
+            BaseType* d4_var = var->transform_to_dap4(root, root);
+            if (d4_var) {
+                root->add_var_nocopy(d4_var);
+            }
+        }
+        else {
+            BESDEBUG("ncml", "NCMLUtil::transferVariablesAndAttributesInto: " << var->name() <<
+                " is already in the DMR, skipping it." << endl);
+        }
+        // The DAP4 variable is a copy, drop the DAP2 one now.
+        dds.del_var(it);
+    }
+}
+
 libdap::DDS*
 NCMLUtil::getDDSFromEitherResponse(BESDapResponse* response)
 {
@@ -49,6 +49,7 @@ class BaseType;
 class Constructor;
 class DDS;
 class DAS;
+class DMR;
 class AttrTable;
 }
 
@@ -140,6 +141,16 @@ public:
      */
     static void copyVariablesAndAttributesInto(libdap::DDS* dds_out, const libdap::DDS& dds_in);
 
+    /** Move the global attributes and variables of dds into dmr as DAP4
+     * objects, as DMR::build_using_dds() does, but delete each DAP2 variable
+     * as soon as it's transformed so the two full trees never coexist.
+     * A variable whose name is already in the root group (a map a Grid
+     * already added) is not added a second time.
+     * @param dds source DDS, left with no variables
+     * @param dmr the DMR to fill, which must have its factory set
+     */
+    static void transferVariablesAndAttributesInto(libdap::DDS& dds, libdap::DMR& dmr);
+
     /**
      * Return the DDS* for the given response object. It is assumed to be either a
      * BESDDSResponse or BESDataDDSResponse.
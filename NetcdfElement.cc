@@ -31,6 +31,7 @@
 
 #include <BaseType.h> // libdap
 #include <BESDapResponse.h> // bes
+#include <BESUtil.h> // bes
 
 #include "AggMemberDataset.h" // agg_util
 #include "AggMemberDatasetDDSWrapper.h" // agg_util
@@ -38,6 +39,7 @@
 #include "AggMemberDatasetUsingLocationRef.h" // agg_util
 #include "AggregationElement.h"
 #include "DimensionElement.h"
+#include "DirectoryUtil.h" // agg_util
 #include "NetcdfElement.h"
 #include "NCMLDebug.h"
 #include "NCMLParser.h"
@@ -151,6 +153,10 @@ void NetcdfElement::handleBegin()
     // If this is the root, it also needs to set up our response!!
     p.pushCurrentDataset(this);
 
+    if (!_location.empty() && p.isRecordingDependencies()) {
+        p.addDependency(BESUtil::assemblePath(agg_util::DirectoryUtil::getBESRootDir(), _location, true));
+    }
+
     // Make sure the attributes that are set are valid for context
     // that we just pushed.
     validateAttributeContextOrThrow();
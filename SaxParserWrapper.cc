@@ -33,8 +33,10 @@
 #include <iostream>
 #include <libxml/parser.h>
 #include <libxml/xmlstring.h>
+#include <memory>
 #include <stdio.h> // for vsnprintf
 #include <string>
+#include <vector>
 
 #include "BESDebug.h"
 #include "BESError.h"
@@ -43,6 +45,7 @@
 #include "BESSyntaxUserError.h"
 #include "BESForbiddenError.h"
 #include "BESNotFoundError.h"
+#include "DecompressingReader.h"
 #include "NCMLDebug.h"
 #include "SaxParser.h"
 #include "XMLHelpers.h"
@@ -53,6 +56,10 @@
 // but I will leave them here for now in case there's issues ]
 #define NCML_PARSER_USE_SAX2_NAMESPACES 1
 
+// Size of the decompressed chunks we push into libxml for compressed NcML.
+// This is all the decompressed document we ever hold at once.
+static const unsigned int NCML_PUSH_PARSER_CHUNK_SIZE = 64 * 1024;
+
 using namespace std;
 using namespace ncml_module;
 
@@ -326,8 +333,6 @@ bool SaxParserWrapper::parse(const string& ncmlFilename)
     // OK, now we're parsing
     _state = PARSING;
 
-    setupParser(ncmlFilename);
-
     // Old way where we have no context.
     //  int errNo = xmlSAXUserParseFile(&_handler, this, ncmlFilename.c_str());
     //  success = (errNo == 0);
@@ -335,7 +340,22 @@ bool SaxParserWrapper::parse(const string& ncmlFilename)
     // Any BESError thrown in SaxParser callbacks will be deferred by the safe handler blocks
     // So that we safely pass this line.
     // Even if not, _context is cleared in dtor just in case.
-    xmlParseDocument(_context);
+    if (DecompressingReader::isCompressedFilename(ncmlFilename)) {
+        // Errors reading the compressed file aren't parser callbacks, so they come
+        // straight through and we have to clean up here.
+        try {
+            parseCompressedDocument(ncmlFilename);
+        }
+        catch (...) {
+            cleanupParser();
+            _state = NOT_PARSING;
+            throw;
+        }
+    }
+    else {
+        setupParser(ncmlFilename);
+        xmlParseDocument(_context);
+    }
 
     success = (_context->errNo == 0);
 
@@ -442,7 +462,25 @@ static void setAllHandlerCBToNulls(xmlSAXHandler& h)
     h.serror = 0;
 }
 
-void SaxParserWrapper::setupParser(const string& filename)
+void SaxParserWrapper::parseCompressedDocument(const string& filename)
+{
+    std::auto_ptr<DecompressingReader> reader = DecompressingReader::open(filename);
+    vector<char> chunk(NCML_PUSH_PARSER_CHUNK_SIZE);
+
+    // libxml wants the first few bytes up front to guess the encoding.
+    unsigned int bytesRead = reader->read(&chunk[0], 4);
+    setupPushParser(filename, &chunk[0], bytesRead);
+
+    // No sense decompressing the rest once a callback has failed.
+    while (!isExceptionState() && (bytesRead = reader->read(&chunk[0], chunk.size())) > 0) {
+        xmlParseChunk(_context, &chunk[0], bytesRead, 0);
+    }
+    if (!isExceptionState()) {
+        xmlParseChunk(_context, 0, 0, 1);
+    }
+}
+
+void SaxParserWrapper::setupHandler()
 {
     // setup the handler for version 2,
     // which sets an internal version magic number
@@ -474,6 +512,11 @@ void SaxParserWrapper::setupParser(const string& filename)
     _handler.startElementNs = 0;
     _handler.endElementNs = 0;
 #endif // NCML_PARSER_USE_SAX2_NAMESPACES
+}
+
+void SaxParserWrapper::setupParser(const string& filename)
+{
+    setupHandler();
 
     // Create the non-validating parser context for the file
     // using this as the userData for making exception-safe
@@ -487,6 +530,22 @@ void SaxParserWrapper::setupParser(const string& filename)
     _context->validate = false;
 }
 
+void SaxParserWrapper::setupPushParser(const string& filename, const char* firstBytes, int size)
+{
+    setupHandler();
+
+    _context = xmlCreatePushParserCtxt(&_handler, this, firstBytes, size, filename.c_str());
+    if (!_context) {
+        THROW_NCML_PARSE_ERROR(-1, "Cannot parse: Unable to create a libxml push parse context for " + filename);
+    }
+    // The push context makes its own copy of the handler. Use ours instead,
+    // as setupParser() does, so that cleanupParser() can treat both the same.
+    xmlFree(_context->sax);
+    _context->sax = &_handler;
+    _context->userData = this;
+    _context->validate = false;
+}
+
 void SaxParserWrapper::cleanupParser() throw ()
 {
     if (_context) {
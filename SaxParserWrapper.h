@@ -46,6 +46,8 @@ namespace ncml_module {
  *
  * On a parse(const string& ncmlFilename) call, the filename is parsed using the libxml C SAX parser
  * and the C callbacks are passed onto our C++ parser via the SaxParser interface class.
+ * A filename ending in .gz, .bz2 or .Z is decompressed a chunk at a time into the libxml
+ * push parser instead, so it never has to be uncompressed as a whole (see DecompressingReader).
  *
  * Since the underlying libxml is C and uses its internal static memory pools
  * which will be used by other parts of the BES, we have to be careful with exceptions.
@@ -164,9 +166,20 @@ public:
 
 private:
 
+    /** Feed the decompressed contents of a .gz, .bz2 or .Z filename through
+     * the push parser a chunk at a time */
+    void parseCompressedDocument(const string& filename);
+
+    /** Fill in _handler with our callbacks */
+    void setupHandler();
+
     /** Prepare the parser to load the given filename, setting up the handler and context */
     void setupParser(const string& filename);
 
+    /** Set up the handler and a push parser context for filename, starting it on the
+     * size bytes of the document in firstBytes */
+    void setupPushParser(const string& filename, const char* firstBytes, int size);
+
     /** Clean the _context and any other state */
     void cleanupParser() throw ();
 
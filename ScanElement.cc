@@ -42,6 +42,7 @@
 
 #include "AggregationElement.h"
 #include "DirectoryUtil.h" // agg_util
+#include "FixedFieldDateParser.h" // agg_util
 #include "NCMLDebug.h"
 #include "NCMLParser.h"
 #include "NetcdfElement.h"
@@ -49,6 +50,8 @@
 #include "SimpleTimeParser.h"
 #include "XMLHelpers.h"
 
+#include "BESUtil.h" // bes
+#include "TheBESKeys.h" // bes
 #include "Error.h" // libdap
 
 // ICU includes for the SimpleDateFormat used in this file only
@@ -61,11 +64,27 @@ using agg_util::DirectoryUtil;
 namespace ncml_module {
 const string ScanElement::_sTypeName = "scan";
 const vector<string> ScanElement::_sValidAttrs = getValidAttributes();
+const string ScanElement::MAX_SCAN_CACHE_ENTRIES_KEY = "NCML.ScanCache.maxEntries";
+ScanElement::ScanResultCache ScanElement::_sScanResultCache;
+
+// Default bound on the number of cached scan results
+static const unsigned long DEFAULT_MAX_SCAN_CACHE_ENTRIES = 100;
+
+// Orderings for the (location, coordValue) pairs of a ScanResult.
+static bool isLocationLessThan(const std::pair<string, string>& lhs, const std::pair<string, string>& rhs)
+{
+    return lhs.first < rhs.first;
+}
+
+static bool isCoordValueLessThan(const std::pair<string, string>& lhs, const std::pair<string, string>& rhs)
+{
+    return lhs.second < rhs.second;
+}
 
 // The rep for the opaque pointer in the header.
 struct ScanElement::DateFormatters {
     DateFormatters() :
-        _pDateFormat(0), _pISO8601(0), _markPos(0), _sdfLen(0)
+        _pDateFormat(0), _pISO8601(0), _fastParser(), _sdfPattern(""), _markPos(0), _sdfLen(0)
     {
     }
     ~DateFormatters()
@@ -82,6 +101,13 @@ struct ScanElement::DateFormatters {
     // for ISO 8601 times for output into the coordinate
     SimpleDateFormat* _pISO8601;
 
+    // Handles the common numeric patterns without ICU. If it can't
+    // (pattern or filename), we fall back to _pDateFormat.
+    agg_util::FixedFieldDateParser _fastParser;
+
+    // The SDF pattern, for messages
+    std::string _sdfPattern;
+
     // The position of the # mark in the date format string
     // We match the preceding characters with the filename.
     size_t _markPos;
@@ -226,7 +252,124 @@ long ScanElement::getOlderThanAsSeconds() const
     }
 }
 
+long ScanElement::getRecheckEveryAsSeconds() const
+{
+    if (!_pParent || _pParent->recheckEvery().empty()) {
+        return 0L;
+    }
+
+    long secs = 0;
+    if (!agg_util::SimpleTimeParser::parseIntoSeconds(secs, _pParent->recheckEvery())) {
+        BESDEBUG("ncml",
+            "Couldn't parse the aggregation recheckEvery=\"" << _pParent->recheckEvery() << "\" so the scan won't be cached." << endl);
+        return 0L;
+    }
+    return secs;
+}
+
 void ScanElement::getDatasetList(vector<NetcdfElement*>& datasets) const
+{
+    // With a recheckEvery we can reuse the last scan of this element
+    // rather than walking the directories again on every request.
+    long recheckSecs = (getMaxScanCacheEntries() > 0) ? getRecheckEveryAsSeconds() : 0L;
+    string cacheKey;
+    const ScanResult* pResult = 0;
+    ScanResult freshResult;
+    if (recheckSecs > 0) {
+        cacheKey = _parser->_filename + "#" + toString();
+        ScanResultCache::iterator it = _sScanResultCache.find(cacheKey);
+        if (it != _sScanResultCache.end()) {
+            if (isScanResultValid(it->second, recheckSecs)) {
+                BESDEBUG("ncml", "Using the cached result for " << toString() << " (recheckEvery=" << recheckSecs << "s)" << endl);
+                pResult = &(it->second);
+            }
+            else {
+                _sScanResultCache.erase(it);
+            }
+        }
+    }
+
+    if (!pResult) {
+        scanDatasets(freshResult);
+        if (recheckSecs > 0) {
+            // Keep it bounded. We don't track use order, any entry will do.
+            if (_sScanResultCache.size() >= getMaxScanCacheEntries()) {
+                _sScanResultCache.erase(_sScanResultCache.begin());
+            }
+            ScanResult& cached = _sScanResultCache[cacheKey];
+            cached = freshResult;
+            pResult = &cached;
+        }
+        else {
+            pResult = &freshResult;
+        }
+    }
+
+    // Whatever is cached from this parse depends on the directories
+    // and the datasets we found in them.
+    typedef vector<std::pair<string, time_t> >::const_iterator DirIter;
+    for (DirIter it = pResult->dirModTimes.begin(); it != pResult->dirModTimes.end(); ++it) {
+        _parser->addDependency(it->first, it->second);
+    }
+    if (!_olderThan.empty()) {
+        _parser->setResultUncacheable();
+    }
+    string rootDir = DirectoryUtil::getBESRootDir();
+
+    // Let the user know we're performing syntactic sugar with ncoords
+    // We'll let the other context decide whether its proper to use it.
+    if (!_ncoords.empty()) {
+        BESDEBUG("ncml",
+            "Scan has ncoords attribute specified: ncoords=" << _ncoords << "  Will be inherited by all matching datasets!" << endl);
+    }
+
+    // Adapt the file list into NetcdfElements created from the
+    // parser's factory so they get added to its memory pool.
+    // The scan result is already in aggregation order.
+    XMLAttributeMap attrs;
+    datasets.reserve(datasets.size() + pResult->datasets.size());
+    typedef vector<std::pair<string, string> >::const_iterator DatasetIter;
+    for (DatasetIter it = pResult->datasets.begin(); it != pResult->datasets.end(); ++it) {
+        // start fresh
+        attrs.clear();
+
+        // The path to the file, relative to the BES root as needed.
+        attrs.addAttribute(XMLAttribute("location", it->first));
+        if (_parser->isRecordingDependencies()) {
+            _parser->addDependency(BESUtil::assemblePath(rootDir, it->first, true));
+        }
+
+        // If the user has specified the ncoords sugar,
+        // pass it down into the netcdf element.
+        if (!_ncoords.empty()) {
+            attrs.addAttribute(XMLAttribute("ncoords", _ncoords));
+        }
+
+        // If there's a dateFormatMark, use the coordVal we pulled
+        // out of the filename and not the location for the new map vector.
+        if (!_dateFormatMark.empty()) {
+            attrs.addAttribute(XMLAttribute("coordValue", it->second));
+        }
+
+        // Make the dataset using the parser so it's in the parser memory pool.
+        RCPtr<NCMLElement> dataset = _parser->_elementFactory.makeElement("netcdf", attrs, *_parser);
+        VALID_PTR(dataset.get());
+
+        // Up the ref count (since it's in an RCPtr) and add to the result vector.
+        // We are transferring the ref to the output, so the
+        // refcount is still correct as is.
+        datasets.push_back(static_cast<NetcdfElement*>(dataset.refAndGet()));
+    }
+
+    // Also, if there's a dateFormatMark, we want to specify that a new
+    // _CoordinateAxisType attribute be added with value "Time" (according to NcML Aggregations page)
+    if (!_dateFormatMark.empty()) {
+        VALID_PTR(getParent());
+        getParent()->setAggregationVariableCoordinateAxisType("Time");
+    }
+}
+
+void ScanElement::scanDatasets(ScanResult& result) const
 {
     // Use BES root as our root
     DirectoryUtil scanner;
@@ -236,13 +379,24 @@ void ScanElement::getDatasetList(vector<NetcdfElement*>& datasets) const
 
     setupFilters(scanner);
 
+    // Note the scan root's mtime before we read it so a change
+    // made while we are scanning invalidates the result.
+    result.scanTime = time(0);
+    string rootPath = _location;
+    DirectoryUtil::removePrecedingSlashes(rootPath);
+    rootPath = scanner.getRootDir() + "/" + rootPath;
+    struct stat statBuf;
+    if (stat(rootPath.c_str(), &statBuf) == 0) {
+        result.dirModTimes.push_back(std::make_pair(rootPath, statBuf.st_mtime));
+    }
+
     vector<FileInfo> files;
-    //vector<FileInfo> dirs;
+    vector<FileInfo> dirs;
     try // catch BES errors to give more context,,,,
     {
         // Call the right version depending on setting of subtree recursion.
         if (shouldScanSubdirs()) {
-            scanner.getListingOfRegularFilesRecursive(_location, files);
+            scanner.getListingForPathRecursive(_location, &files, &dirs);
         }
         else {
             scanner.getListingForPath(_location, &files, 0);
@@ -260,6 +414,12 @@ void ScanElement::getDatasetList(vector<NetcdfElement*>& datasets) const
     // and Forbidden are pretty clear and likely not a typo
     // in the NCML like NotFound could be.
 
+    for (vector<FileInfo>::const_iterator it = dirs.begin(); it != dirs.end(); ++it) {
+        string dirPath = it->getFullPath();
+        DirectoryUtil::removePrecedingSlashes(dirPath);
+        result.dirModTimes.push_back(std::make_pair(scanner.getRootDir() + "/" + dirPath, it->modTime()));
+    }
+
     BESDEBUG("ncml", "Scan " << toString() << " returned matching regular files: " << endl);
     if (files.empty()) {
         BESDEBUG("ncml", "WARNING: No matching files found!" << endl);
@@ -268,81 +428,70 @@ void ScanElement::getDatasetList(vector<NetcdfElement*>& datasets) const
         DirectoryUtil::printFileInfoList(files);
     }
 
-    // Let the user know we're performing syntactic sugar with ncoords
-    // We'll let the other context decide whether its proper to use it.
-    if (!_ncoords.empty()) {
-        BESDEBUG("ncml",
-            "Scan has ncoords attribute specified: ncoords=" << _ncoords << "  Will be inherited by all matching datasets!" << endl);
-    }
-
-    // Adapt the file list into a temp vector of NetcdfElements
-    // created from the parser's factory so they
-    // get added to its memory pool
-    // We use a temp vector since we need to sort the datasets
-    // before appending them to the output dataset vector.
-    XMLAttributeMap attrs;
-    vector<NetcdfElement*> scannedDatasets;
-    scannedDatasets.reserve(files.size());
-    // Now add them...
+    result.datasets.reserve(files.size());
     for (vector<FileInfo>::const_iterator it = files.begin(); it != files.end(); ++it) {
-        // start fresh
-        attrs.clear();
-
-        // The path to the file, relative to the BES root as needed.
-        attrs.addAttribute(XMLAttribute("location", it->getFullPath()));
-
-        // If the user has specified the ncoords sugar,
-        // pass it down into the netcdf element.
-        if (!_ncoords.empty()) {
-            attrs.addAttribute(XMLAttribute("ncoords", _ncoords));
-        }
-
         // If there's a dateFormatMark, pull out the coordVal
-        // and add it to the attrs map since we want to use that and
-        // not the location for the new map vector.
+        // since we want to use that and not the location for the new map vector.
+        string timeCoord;
         if (!_dateFormatMark.empty()) {
-            string timeCoord = extractTimeFromFilename(it->basename());
+            timeCoord = extractTimeFromFilename(it->basename());
             BESDEBUG("ncml", "Got an ISO 8601 time from dateFormatMark: " << timeCoord << endl);
-            attrs.addAttribute(XMLAttribute("coordValue", timeCoord));
         }
-
-        // Make the dataset using the parser so it's in the parser memory pool.
-        RCPtr<NCMLElement> dataset = _parser->_elementFactory.makeElement("netcdf", attrs, *_parser);
-        VALID_PTR(dataset.get());
-
-        // Up the ref count (since it's in an RCPtr) and add to the result vector
-        scannedDatasets.push_back(static_cast<NetcdfElement*>(dataset.refAndGet()));
+        result.datasets.push_back(std::make_pair(it->getFullPath(), timeCoord));
     }
 
-    // We have the scanned datasets in scannedDatasets vector now, so sort
-    // on location() or coordValue() depending on whether we have a dateFormatMark...
+    // Sort on location or coordValue depending on whether we have a dateFormatMark...
     if (_dateFormatMark.empty()) // sort by location()
     {
         BESDEBUG("ncml", "Sorting scanned datasets by location()..." << endl);
-        std::sort(scannedDatasets.begin(), scannedDatasets.end(), NetcdfElement::isLocationLexicographicallyLessThan);
+        std::sort(result.datasets.begin(), result.datasets.end(), isLocationLessThan);
     }
     else // sort by coordValue()
     {
         BESDEBUG("ncml",
             "Sorting scanned datasets by coordValue() since we got a dateFormatMark" " and the coordValue are ISO 8601 dates..." << endl);
-        std::sort(scannedDatasets.begin(), scannedDatasets.end(), NetcdfElement::isCoordValueLexicographicallyLessThan);
+        std::sort(result.datasets.begin(), result.datasets.end(), isCoordValueLessThan);
     }
+}
 
-    // Also, if there's a dateFormatMark, we want to specify that a new
-    // _CoordinateAxisType attribute be added with value "Time" (according to NcML Aggregations page)
-    if (!_dateFormatMark.empty()) {
-        VALID_PTR(getParent());
-        getParent()->setAggregationVariableCoordinateAxisType("Time");
+bool ScanElement::isScanResultValid(const ScanResult& result, long recheckSecs)
+{
+    if (time(0) - result.scanTime >= recheckSecs) {
+        return false;
     }
 
-    // Now we can append the sorted local vector of datasets to the output.
-    // We need not worry about reference counts since the scannedDatasets
-    // has them red'd already and won't deref when it goes out of scope.
-    // We are merely transferring them to the ouput, so the
-    // refcount is still correct as is.
-    BESDEBUG("ncml", "Adding the sorted scanned datasets to the current aggregation list..." << endl);
-    datasets.reserve(datasets.size() + scannedDatasets.size());
-    datasets.insert(datasets.end(), scannedDatasets.begin(), scannedDatasets.end());
+    // Adding or removing a file changes its directory's mtime.
+    typedef vector<std::pair<string, time_t> >::const_iterator DirIter;
+    for (DirIter it = result.dirModTimes.begin(); it != result.dirModTimes.end(); ++it) {
+        struct stat statBuf;
+        if (stat(it->first.c_str(), &statBuf) != 0 || statBuf.st_mtime != it->second) {
+            BESDEBUG("ncml", "Scanned directory " << it->first << " changed, rescanning." << endl);
+            return false;
+        }
+    }
+    return true;
+}
+
+unsigned long ScanElement::getMaxScanCacheEntries()
+{
+    static bool sInited = false;
+    static unsigned long sMaxEntries = DEFAULT_MAX_SCAN_CACHE_ENTRIES;
+    if (!sInited) {
+        sInited = true;
+
+        bool found = false;
+        string value;
+        TheBESKeys::TheKeys()->get_value(MAX_SCAN_CACHE_ENTRIES_KEY, value, found);
+        if (found) {
+            std::istringstream iss(value);
+            iss >> sMaxEntries;
+            if (iss.fail()) {
+                BESDEBUG("ncml", "ScanElement: ignoring bad value for " << MAX_SCAN_CACHE_ENTRIES_KEY << "=\"" << value << "\"" << endl);
+                sMaxEntries = DEFAULT_MAX_SCAN_CACHE_ENTRIES;
+            }
+        }
+    }
+    return sMaxEntries;
 }
 
 void ScanElement::setupFilters(agg_util::DirectoryUtil& scanner) const
@@ -426,6 +575,11 @@ void ScanElement::initSimpleDateFormats(const std::string& dateFormatMark)
 
     // Cache the length of the pattern for later substr calcs.
     _pDateFormatters->_sdfLen = dateFormat.size();
+    _pDateFormatters->_sdfPattern = dateFormat;
+
+    if (_pDateFormatters->_fastParser.compile(dateFormat)) {
+        BESDEBUG("ncml", "The date format is parsed without ICU when the filenames allow it." << endl);
+    }
 
     // Try to make the formatter from the user given string
     UErrorCode success = U_ZERO_ERROR;
@@ -460,12 +614,12 @@ std::string ScanElement::extractTimeFromFilename(const std::string& filename) co
     // they match, just the quantity).
     string sdfPortion = filename.substr(_pDateFormatters->_markPos, _pDateFormatters->_sdfLen);
 
-    UnicodeString usPattern;
-    _pDateFormatters->_pDateFormat->toPattern(usPattern);
-    string sdfPattern;
-    bool conversionSuccess = convertUnicodeStringToStdString(sdfPattern, usPattern);
-    NCML_ASSERT_MSG(conversionSuccess,
-        "ScanElement::extractTimeFromFilename: couldn't convert the UnicodeString date pattern to a std::string!");
+    string result;
+    if (_pDateFormatters->_fastParser.isCompiled() && _pDateFormatters->_fastParser.parseToISO8601(sdfPortion, result)) {
+        return result;
+    }
+
+    const string& sdfPattern = _pDateFormatters->_sdfPattern;
 
     BESDEBUG("ncml",
         "Scan is now matching the date portion of the filename " << sdfPortion << " to the SimpleDateFormat=" "\"" << sdfPattern << "\"" << endl);
@@ -482,8 +636,7 @@ std::string ScanElement::extractTimeFromFilename(const std::string& filename) co
 
     UnicodeString usISODate;
     _pDateFormatters->_pISO8601->format(theDate, usISODate);
-    string result;
-    conversionSuccess = convertUnicodeStringToStdString(result, usISODate);
+    bool conversionSuccess = convertUnicodeStringToStdString(result, usISODate);
     NCML_ASSERT_MSG(conversionSuccess,
         "ScanElement::extractTimeFromFilename: failed to convert the UnicodeString ISO date to a std::string!");
     // usISODate.toUTF8String(result);
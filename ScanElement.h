@@ -32,6 +32,9 @@
 #include "NCMLElement.h"
 #include "AggMemberDataset.h"
 
+#include <map>
+#include <utility>
+
 namespace agg_util {
 class DirectoryUtil;
 }
@@ -54,6 +57,9 @@ public:
     // All possible attributes for this element.
     static const vector<string> _sValidAttrs;
 
+    // BES key for the number of scan results kept for recheckEvery
+    static const string MAX_SCAN_CACHE_ENTRIES_KEY;
+
 private:
     ScanElement& operator=(const ScanElement& rhs); // disallow
 
@@ -88,6 +94,12 @@ public:
     /** is the subdirs attribute true? */
     bool shouldScanSubdirs() const;
 
+    /** Get the recheckEvery attribute of the parent aggregation in seconds.
+     * Returns 0 if it is empty or can't be parsed, meaning the
+     * scan is not cached.
+     */
+    long getRecheckEveryAsSeconds() const;
+
     /** Get the olderThan attribute in seconds.
      * Returns 0 for the empty attribute
      * and -1 if there's an error parsing the attribute.
@@ -102,6 +114,10 @@ public:
      * Fill in the vector with matching datasets, sorted
      * by the filename.
      *
+     * If the parent aggregation has a recheckEvery, the result of the
+     * directory scan is cached per (NcML file, scan) and reused until
+     * recheckEvery has passed or the mtime of a scanned directory changes.
+     *
      * NOTE: The members added to this vector will be ref()'d
      * so the caller needs to make sure to deref them!
      *
@@ -110,8 +126,40 @@ public:
     void getDatasetList(vector<NetcdfElement*>& datasets) const;
 
 private:
+    /** The result of a directory scan, kept across requests when
+     * the aggregation has a recheckEvery.
+     */
+    struct ScanResult {
+        ScanResult() :
+            scanTime(0), dirModTimes(), datasets()
+        {
+        }
+
+        // when the scan was done
+        time_t scanTime;
+        // full path and mtime of each directory that was scanned
+        std::vector<std::pair<std::string, time_t> > dirModTimes;
+        // the location and coordValue (empty without a dateFormatMark)
+        // of each matched dataset, in aggregation order
+        std::vector<std::pair<std::string, std::string> > datasets;
+    };
+    typedef std::map<std::string, ScanResult> ScanResultCache;
+
     // internal methods
 
+    /** Walk the filesystem and fill result with the matching
+     * datasets, sorted as getDatasetList() needs them.
+     */
+    void scanDatasets(ScanResult& result) const;
+
+    /** Is result younger than recheckSecs and are all its
+     * directories unchanged?
+     */
+    static bool isScanResultValid(const ScanResult& result, long recheckSecs);
+
+    /** The bound on _sScanResultCache, from MAX_SCAN_CACHE_ENTRIES_KEY. */
+    static unsigned long getMaxScanCacheEntries();
+
     /** Set the filters on scanner from the attributes we have set. */
     void setupFilters(agg_util::DirectoryUtil& scanner) const;
 
@@ -155,6 +203,9 @@ private:
     // Back pointer to our parent
     AggregationElement* _pParent;
 
+    // Scan results by NcML file and scan, for recheckEvery
+    static ScanResultCache _sScanResultCache;
+
     // We use an opaque ptr (pimpl idiom) to push the
     // decl of the ICU classes to the .cc
     // to get config.h information as well as hide the icu headers.
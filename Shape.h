@@ -30,6 +30,7 @@
 #ifndef __NCML_MODULE__SHAPE_H__
 #define __NCML_MODULE__SHAPE_H__
 
+#include <algorithm>
 #include <iostream>
 #include <iterator>
 #include <Array.h>
@@ -209,6 +210,100 @@ public:
      * @see beginSpaceEnumeration() */
     Shape::IndexIterator endSpaceEnumeration() const;
 
+    /**
+     * Copy the points of this Shape's constrained space (the same ones, in
+     * the same order, as beginSpaceEnumeration()) out of allValues, the
+     * row major values of the whole unconstrained space, into out.
+     * See visitConstrainedRuns() for how the points are walked.
+     *
+     * @param allValues getUnconstrainedSpaceSize() values
+     * @param out room for getConstrainedSpaceSize() values
+     * @return the number of values copied into out
+     */
+    template<typename T>
+    unsigned int copyConstrainedValues(const T* allValues, T* out) const
+    {
+        RunCopier<T> copier(allValues, out);
+        visitConstrainedRuns(copier);
+        return copier.out - out;
+    }
+
+    /**
+     * Walk the points of this Shape's constrained space, in the order of
+     * beginSpaceEnumeration(), as runs of row major indices into the
+     * unconstrained space: visit(first, count, step) for the count
+     * indices first, first + step, ...
+     *
+     * Rather than computing the index of every point, this walks the outer
+     * dimensions only: the trailing dimensions that are unconstrained make
+     * contiguous blocks, and a stride of 1 on the innermost constrained
+     * dimension makes one run of its blocks. Otherwise each block is a
+     * run, or with blocks of one value, the stride is the run's step.
+     */
+    template<typename RunVisitor>
+    void visitConstrainedRuns(RunVisitor& visit) const
+    {
+        const unsigned int rank = _dims.size();
+        if (rank == 0 || getConstrainedSpaceSize() == 0) {
+            return;
+        }
+
+        // runDim is the innermost constrained dim. Everything inside it is
+        // a contiguous block of blockSize values per index of runDim.
+        unsigned int runDim = rank - 1;
+        unsigned int blockSize = 1;
+        while (runDim > 0 && isUnconstrained(_dims[runDim])) {
+            blockSize *= _dims[runDim].size;
+            --runDim;
+        }
+        const Array::dimension& run = _dims[runDim];
+
+        // Distance in allValues between successive indices of each outer dim.
+        std::vector<unsigned int> spans(runDim + 1);
+        spans[runDim] = blockSize;
+        for (int d = static_cast<int>(runDim) - 1; d >= 0; --d) {
+            spans[d] = spans[d + 1] * _dims[d + 1].size;
+        }
+
+        // Odometer over the dims outside runDim.
+        std::vector<unsigned int> indices(runDim);
+        unsigned int outerOffset = 0;
+        for (unsigned int d = 0; d < runDim; ++d) {
+            indices[d] = _dims[d].start;
+            outerOffset += indices[d] * spans[d];
+        }
+
+        for (;;) {
+            unsigned int first = outerOffset + run.start * blockSize;
+            if (run.stride == 1) {
+                visit(first, run.c_size * blockSize, 1);
+            }
+            else if (blockSize == 1) {
+                visit(first, run.c_size, run.stride);
+            }
+            else {
+                for (int i = 0; i < run.c_size; ++i, first += run.stride * blockSize) {
+                    visit(first, blockSize, 1);
+                }
+            }
+
+            int d = static_cast<int>(runDim) - 1;
+            for (; d >= 0; --d) {
+                const Array::dimension& dim = _dims[d];
+                if (static_cast<int>(indices[d]) + dim.stride <= dim.stop) {
+                    indices[d] += dim.stride;
+                    outerOffset += dim.stride * spans[d];
+                    break;
+                }
+                outerOffset -= (indices[d] - dim.start) * spans[d];
+                indices[d] = dim.start;
+            }
+            if (d < 0) {
+                break;
+            }
+        }
+    }
+
     /** Make a string that prints the contents of this */
     std::string toString() const;
 
@@ -226,6 +321,37 @@ public:
 private:
     // Methods
 
+    /** The run visitor for copyConstrainedValues(). */
+    template<typename T>
+    struct RunCopier {
+        RunCopier(const T* allValues, T* pOut) :
+            src(allValues), out(pOut)
+        {
+        }
+
+        void operator()(unsigned int first, unsigned int count, unsigned int step)
+        {
+            const T* pRun = src + first;
+            if (step == 1) {
+                out = std::copy(pRun, pRun + count, out);
+            }
+            else {
+                for (unsigned int i = 0; i < count; ++i, pRun += step) {
+                    *out++ = *pRun;
+                }
+            }
+        }
+
+        const T* src;
+        T* out;
+    };
+
+    /** Whether dim's constraint selects all of it, in order. */
+    static bool isUnconstrained(const Array::dimension& dim)
+    {
+        return dim.start == 0 && dim.stride == 1 && dim.c_size == dim.size;
+    }
+
 private:
     std::vector<Array::dimension> _dims;
 
@@ -0,0 +1,159 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+#include "config.h"
+
+#include "TransformedDDSCache.h"
+
+#include <sstream>
+#include <sys/stat.h>
+
+#include <BaseTypeFactory.h> // libdap
+#include <DDS.h> // libdap
+
+#include <BESDebug.h>
+#include <TheBESKeys.h>
+
+#include "NCMLUtil.h"
+
+using std::string;
+using libdap::DDS;
+
+namespace ncml_module {
+
+const string TransformedDDSCache::MAX_ENTRIES_KEY = "NCML.DDSCache.maxEntries";
+
+TransformedDDSCache* TransformedDDSCache::_sInstance = 0;
+bool TransformedDDSCache::_sInited = false;
+
+TransformedDDSCache*
+TransformedDDSCache::get_instance()
+{
+    if (!_sInited) {
+        _sInited = true;
+
+        bool found = false;
+        string value;
+        TheBESKeys::TheKeys()->get_value(MAX_ENTRIES_KEY, value, found);
+        unsigned long maxEntries = 0;
+        if (found) {
+            std::istringstream iss(value);
+            iss >> maxEntries;
+            if (iss.fail()) {
+                BESDEBUG("ncml", "TransformedDDSCache: ignoring bad value for " << MAX_ENTRIES_KEY << "=\"" << value << "\"" << endl);
+                maxEntries = 0;
+            }
+        }
+
+        if (maxEntries > 0) {
+            _sInstance = new TransformedDDSCache(maxEntries);
+        }
+    }
+    return _sInstance;
+}
+
+void TransformedDDSCache::delete_instance()
+{
+    delete _sInstance;
+    _sInstance = 0;
+    _sInited = false;
+}
+
+TransformedDDSCache::TransformedDDSCache(unsigned long maxEntries) :
+    _entries(), _maxEntries(maxEntries)
+{
+}
+
+TransformedDDSCache::~TransformedDDSCache()
+{
+    while (!_entries.empty()) {
+        erase(_entries.begin());
+    }
+}
+
+bool TransformedDDSCache::get(const std::string& ncmlFilename, DDS* dds_out)
+{
+    EntryMap::iterator it = _entries.find(ncmlFilename);
+    if (it == _entries.end()) {
+        return false;
+    }
+
+    if (!dependenciesUnchanged(it->second.dependencies)) {
+        BESDEBUG("ncml", "TransformedDDSCache: " << ncmlFilename << " or something it refers to changed, reparsing." << endl);
+        erase(it);
+        return false;
+    }
+
+    BESDEBUG("ncml", "TransformedDDSCache: using the cached DDS for " << ncmlFilename << endl);
+    NCMLUtil::copyVariablesAndAttributesInto(dds_out, *(it->second.dds));
+    dds_out->set_dataset_name(it->second.dds->get_dataset_name());
+    return true;
+}
+
+void TransformedDDSCache::put(const std::string& ncmlFilename, const DDS& dds, const DependencyList& dependencies)
+{
+    EntryMap::iterator it = _entries.find(ncmlFilename);
+    if (it != _entries.end()) {
+        erase(it);
+    }
+    // Keep it bounded. We don't track use order, any entry will do.
+    else if (_entries.size() >= _maxEntries) {
+        erase(_entries.begin());
+    }
+
+    // The copy gets its own factory, the one in dds belongs to the response.
+    Entry entry;
+    entry.dds = new DDS(new libdap::BaseTypeFactory(), const_cast<DDS&>(dds).get_dataset_name());
+    NCMLUtil::copyVariablesAndAttributesInto(entry.dds, dds);
+    entry.dependencies = dependencies;
+    _entries.insert(std::make_pair(ncmlFilename, entry));
+
+    BESDEBUG("ncml", "TransformedDDSCache: cached the DDS for " << ncmlFilename << " with " << dependencies.size() << " dependencies" << endl);
+}
+
+bool TransformedDDSCache::dependenciesUnchanged(const DependencyList& dependencies)
+{
+    for (DependencyList::const_iterator it = dependencies.begin(); it != dependencies.end(); ++it) {
+        struct stat statBuf;
+        time_t modTime = (stat(it->first.c_str(), &statBuf) == 0) ? statBuf.st_mtime : 0;
+        if (modTime != it->second) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TransformedDDSCache::erase(EntryMap::iterator it)
+{
+    libdap::BaseTypeFactory* factory = it->second.dds->get_factory();
+    delete it->second.dds;
+    delete factory;
+    _entries.erase(it);
+}
+
+}
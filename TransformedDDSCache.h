@@ -0,0 +1,110 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef __NCML_MODULE__TRANSFORMED_DDS_CACHE_H__
+#define __NCML_MODULE__TRANSFORMED_DDS_CACHE_H__
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <time.h>
+
+namespace libdap {
+class DDS;
+}
+
+namespace ncml_module {
+
+/**
+ * Process wide cache of the DDX an NcML file transforms into, so the
+ * metadata requests of a session (DAS, DDS, DMR) don't each reparse the
+ * NcML, reload the underlying datasets and rerun the aggregations.
+ *
+ * An entry is keyed by the NcML file and is valid as long as none of the
+ * files and directories the parse read (NCMLParser::getDependencies(): the
+ * NcML file, every dataset location and every scanned directory, including
+ * those of NcML dataset locations) has a different modification time.
+ *
+ * Only use this for responses that don't read data, which rules out DDS
+ * and DMR requests that call server functions too. The aggregation
+ * variables in the cached DDS refer to the request that built them, so a
+ * copy must never be asked to read().
+ *
+ * The cache is off unless MAX_ENTRIES_KEY is set.
+ */
+class TransformedDDSCache {
+public:
+    /** (full path, modification time), same as NCMLParser::DependencyList */
+    typedef std::vector<std::pair<std::string, time_t> > DependencyList;
+
+    /** BES key for the number of NcML files to keep, 0 (the default) turns the cache off */
+    static const std::string MAX_ENTRIES_KEY;
+
+    /** @return the cache, or null if it is turned off */
+    static TransformedDDSCache* get_instance();
+
+    /** Free the cache and everything in it */
+    static void delete_instance();
+
+    /** If there is a valid entry for ncmlFilename, copy its variables
+     * and attributes into dds_out.
+     * @return true on a hit */
+    bool get(const std::string& ncmlFilename, libdap::DDS* dds_out);
+
+    /** Keep a copy of dds as the transformed DDS for ncmlFilename. */
+    void put(const std::string& ncmlFilename, const libdap::DDS& dds, const DependencyList& dependencies);
+
+    /** @return true if every file in dependencies still has the recorded modification time */
+    static bool dependenciesUnchanged(const DependencyList& dependencies);
+
+private:
+    struct Entry {
+        libdap::DDS* dds;
+        DependencyList dependencies;
+    };
+    typedef std::map<std::string, Entry> EntryMap;
+
+    explicit TransformedDDSCache(unsigned long maxEntries);
+    ~TransformedDDSCache();
+
+    TransformedDDSCache(const TransformedDDSCache&); // disallow
+    TransformedDDSCache& operator=(const TransformedDDSCache&); // disallow
+
+    void erase(EntryMap::iterator it);
+
+    EntryMap _entries;
+    unsigned long _maxEntries;
+
+    static TransformedDDSCache* _sInstance;
+    static bool _sInited;
+};
+
+}
+
+#endif /* __NCML_MODULE__TRANSFORMED_DDS_CACHE_H__ */
@@ -0,0 +1,130 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+#include "config.h"
+
+#include "UnionVariableIndex.h"
+
+#include <sstream>
+
+#include <BESDebug.h>
+#include <TheBESKeys.h>
+
+#include "TransformedDDSCache.h"
+
+using std::string;
+
+namespace ncml_module {
+
+const string UnionVariableIndex::MAX_ENTRIES_KEY = "NCML.UnionIndex.maxEntries";
+
+UnionVariableIndex* UnionVariableIndex::_sInstance = 0;
+bool UnionVariableIndex::_sInited = false;
+
+UnionVariableIndex*
+UnionVariableIndex::get_instance()
+{
+    if (!_sInited) {
+        _sInited = true;
+
+        bool found = false;
+        string value;
+        TheBESKeys::TheKeys()->get_value(MAX_ENTRIES_KEY, value, found);
+        unsigned long maxEntries = 0;
+        if (found) {
+            std::istringstream iss(value);
+            iss >> maxEntries;
+            if (iss.fail()) {
+                BESDEBUG("ncml", "UnionVariableIndex: ignoring bad value for " << MAX_ENTRIES_KEY << "=\"" << value << "\"" << endl);
+                maxEntries = 0;
+            }
+        }
+
+        if (maxEntries > 0) {
+            _sInstance = new UnionVariableIndex(maxEntries);
+        }
+    }
+    return _sInstance;
+}
+
+void UnionVariableIndex::delete_instance()
+{
+    delete _sInstance;
+    _sInstance = 0;
+    _sInited = false;
+}
+
+UnionVariableIndex::UnionVariableIndex(unsigned long maxEntries) :
+    _entries(), _maxEntries(maxEntries)
+{
+}
+
+UnionVariableIndex::~UnionVariableIndex()
+{
+    _entries.clear();
+}
+
+bool UnionVariableIndex::get(const std::string& unionKey, VariableMap& variables, libdap::AttrTable& globalAttrs)
+{
+    EntryMap::iterator it = _entries.find(unionKey);
+    if (it == _entries.end()) {
+        return false;
+    }
+
+    if (!TransformedDDSCache::dependenciesUnchanged(it->second.dependencies)) {
+        BESDEBUG("ncml", "UnionVariableIndex: the NcML or a union member changed, dropping the index." << endl);
+        _entries.erase(it);
+        return false;
+    }
+
+    variables = it->second.variables;
+    globalAttrs = it->second.globalAttrs;
+    return true;
+}
+
+void UnionVariableIndex::put(const std::string& unionKey, const VariableMap& variables,
+    const libdap::AttrTable& globalAttrs, const DependencyList& dependencies)
+{
+    EntryMap::iterator it = _entries.find(unionKey);
+    if (it != _entries.end()) {
+        _entries.erase(it);
+    }
+    // Keep it bounded. We don't track use order, any entry will do.
+    else if (_entries.size() >= _maxEntries) {
+        _entries.erase(_entries.begin());
+    }
+
+    Entry& entry = _entries[unionKey];
+    entry.variables = variables;
+    entry.globalAttrs = globalAttrs;
+    entry.dependencies = dependencies;
+
+    BESDEBUG("ncml", "UnionVariableIndex: indexed " << variables.size() << " variables of a union with " << dependencies.size() << " dependencies" << endl);
+}
+
+}
@@ -0,0 +1,105 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+#ifndef __NCML_MODULE__UNION_VARIABLE_INDEX_H__
+#define __NCML_MODULE__UNION_VARIABLE_INDEX_H__
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <time.h>
+
+#include <AttrTable.h>
+
+namespace ncml_module {
+
+/**
+ * Process wide record, for each union aggregation, of which member dataset
+ * supplies each of the union's top-level variables, so a data request that
+ * projects a few of them only has to load those members
+ * (see AggregationElement::processUnion()). Since the skipped members still
+ * contribute global attributes, the entry also keeps the union of all the
+ * members' global attribute tables.
+ *
+ * An entry is made the first time a union is built from all its members and
+ * is valid as long as neither the NcML file nor any member has a different
+ * modification time.
+ *
+ * The index is off unless MAX_ENTRIES_KEY is set.
+ */
+class UnionVariableIndex {
+public:
+    /** (full path, modification time), same as NCMLParser::DependencyList */
+    typedef std::vector<std::pair<std::string, time_t> > DependencyList;
+
+    /** Variable name to the index of the member (in document order) it comes from */
+    typedef std::map<std::string, unsigned int> VariableMap;
+
+    /** BES key for the number of unions to index, 0 (the default) turns the index off */
+    static const std::string MAX_ENTRIES_KEY;
+
+    /** @return the index, or null if it is turned off */
+    static UnionVariableIndex* get_instance();
+
+    /** Free the index and everything in it */
+    static void delete_instance();
+
+    /** If there is a valid entry for unionKey, copy it to variables and
+     * the members' merged global attributes to globalAttrs.
+     * @return true on a hit */
+    bool get(const std::string& unionKey, VariableMap& variables, libdap::AttrTable& globalAttrs);
+
+    /** Record variables and the members' merged global attributes as the index for unionKey. */
+    void put(const std::string& unionKey, const VariableMap& variables, const libdap::AttrTable& globalAttrs,
+        const DependencyList& dependencies);
+
+private:
+    struct Entry {
+        VariableMap variables;
+        libdap::AttrTable globalAttrs;
+        DependencyList dependencies;
+    };
+    typedef std::map<std::string, Entry> EntryMap;
+
+    explicit UnionVariableIndex(unsigned long maxEntries);
+    ~UnionVariableIndex();
+
+    UnionVariableIndex(const UnionVariableIndex&); // disallow
+    UnionVariableIndex& operator=(const UnionVariableIndex&); // disallow
+
+    EntryMap _entries;
+    unsigned long _maxEntries;
+
+    static UnionVariableIndex* _sInstance;
+    static bool _sInited;
+};
+
+}
+
+#endif /* __NCML_MODULE__UNION_VARIABLE_INDEX_H__ */
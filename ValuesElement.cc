@@ -44,7 +44,10 @@
 #include "UInt32.h"
 #include "Url.h"
 
+#include "DecimalTokenParser.h"
+#include "NCMLBaseArray.h"
 #include "NCMLDebug.h"
+#include "NCMLGeneratedArray.h"
 #include "NCMLParser.h"
 #include "NCMLUtil.h"
 #include <sstream>
@@ -231,6 +234,14 @@ void ValuesElement::handleEnd()
             "Values element=" + toString() + " expected content for values but didn't get any!");
     }
 #endif
+    // Numeric arrays are parsed straight out of the content, which avoids a string and
+    // a stringstream per value for large values elements.
+    if (!shouldAutoGenerateValues() && isStreamableNumericArray(p, *pVar)) {
+        setNumericVectorValuesFromContent(p, *pVar);
+        setGotValuesOnOurVariableElement(p);
+        return;
+    }
+
     // Tokenize the values for all cases EXCEPT if it's a scalar string.
     // We'll make a special exception an assume the entire content is the token
     // to avoid accidental tokenization with whitespace, which is clearly not intended
@@ -366,18 +377,7 @@ void ValuesElement::setVectorValues(libdap::Array* pArray, const vector<string>&
     int count = 0; // only to help error output msg
     vector<string>::const_iterator endIt = valueTokens.end();
     for (vector<string>::const_iterator it = valueTokens.begin(); it != endIt; ++it) {
-        DAPType value;
-        stringstream valueTokenAsStream;
-        const std::string& token = *it;
-        valueTokenAsStream.str(token);
-        valueTokenAsStream >> value;
-        if (valueTokenAsStream.fail()) {
-            stringstream msg;
-            msg << "Got fail() on parsing a value token for an Array name=" << pArray->name()
-                << " for value token index " << count << " with token=" << (*it) << " for element " << toString();
-            THROW_NCML_PARSE_ERROR(_parser->getParseLineNumber(), msg.str());
-        }
-        values.push_back(value);
+        values.push_back(parseVectorValueToken<DAPType>(pArray, *it, count));
         count++;
     }
 
@@ -385,6 +385,87 @@ void ValuesElement::setVectorValues(libdap::Array* pArray, const vector<string>&
     pArray->set_value(values, values.size());
 }
 
+template<typename DAPType>
+DAPType ValuesElement::parseVectorValueToken(libdap::Array* pArray, const string& token, unsigned int index) const
+{
+    DAPType value;
+    stringstream valueTokenAsStream;
+    valueTokenAsStream.str(token);
+    valueTokenAsStream >> value;
+    if (valueTokenAsStream.fail()) {
+        stringstream msg;
+        msg << "Got fail() on parsing a value token for an Array name=" << pArray->name()
+            << " for value token index " << index << " with token=" << token << " for element " << toString();
+        THROW_NCML_PARSE_ERROR(_parser->getParseLineNumber(), msg.str());
+    }
+    return value;
+}
+
+template<typename DAPType>
+void ValuesElement::parseAndSetNumericVectorValues(NCMLParser& p, libdap::Array* pArray)
+{
+    VALID_PTR(pArray);
+
+    // Same token rules as NCMLUtil::tokenize(): any run of separator chars splits tokens.
+    const string& sep = ((_separator.empty()) ? (NCMLUtil::WHITESPACE) : (_separator));
+    bool isSeparator[256] = { false };
+    for (string::const_iterator it = sep.begin(); it != sep.end(); ++it) {
+        isSeparator[static_cast<unsigned char>(*it)] = true;
+    }
+
+    vector<DAPType> values;
+    if (pArray->length() > 0) {
+        values.reserve(pArray->length());
+    }
+
+    // Tokens the fast parse won't take are checked and parsed the original way once
+    // we know the count, so the errors (and their order) are the same as before.
+    vector<unsigned int> slowIndices;
+    vector<string> slowTokens;
+
+    // c_str() so strtod() always finds a terminator after the last token
+    const char* c = _accumulated_content.c_str();
+    const char* end = c + _accumulated_content.size();
+    while (true) {
+        while (c != end && isSeparator[static_cast<unsigned char>(*c)])
+            ++c;
+        if (c == end) {
+            break;
+        }
+        const char* tokenEnd = c;
+        while (tokenEnd != end && !isSeparator[static_cast<unsigned char>(*tokenEnd)])
+            ++tokenEnd;
+
+        DAPType value = 0;
+        if (!DecimalTokenParser<DAPType>::parse(c, tokenEnd, value)) {
+            slowIndices.push_back(values.size());
+            slowTokens.push_back(string(c, tokenEnd));
+        }
+        values.push_back(value);
+        c = tokenEnd;
+    }
+
+    if (pArray->length() > 0 && static_cast<unsigned int>(pArray->length()) != values.size()) {
+        stringstream msg;
+        msg << "Dimension mismatch!  Variable name=" << pArray->name() << " has dimension product="
+            << pArray->length() << " but we got " << values.size() << " values in the values element " << toString();
+        THROW_NCML_PARSE_ERROR(_parser->getParseLineNumber(), msg.str());
+    }
+
+    if (!slowTokens.empty()) {
+        BESDEBUG("ncml", "ValuesElement: " << slowTokens.size() << " of " << values.size()
+            << " value tokens for " << pArray->name() << " were not plain decimal; parsing them with streams." << endl);
+        BaseType* pTemplate = pArray->var();
+        VALID_PTR(pTemplate);
+        p.checkDataIsValidForCanonicalTypeOrThrow(pTemplate->type_name(), slowTokens);
+        for (unsigned int i = 0; i < slowTokens.size(); ++i) {
+            values[slowIndices[i]] = parseVectorValueToken<DAPType>(pArray, slowTokens[i], slowIndices[i]);
+        }
+    }
+
+    pArray->set_value(values, values.size());
+}
+
 /** Specialization to handle the fact that operator>> tokenizes itself,
  * but we just want to shove the ENTIRE token in there for each one.
  */
@@ -596,6 +677,67 @@ void ValuesElement::setVectorVariableValuesFromTokens(NCMLParser& p, libdap::Bas
 
 }
 
+bool ValuesElement::isStreamableNumericArray(NCMLParser& p, libdap::BaseType& var) const
+{
+    Array* pArray = dynamic_cast<Array*>(&var);
+    if (!pArray || !pArray->var()) {
+        return false;
+    }
+
+    switch (pArray->var()->type()) {
+    case dods_int16_c:
+    case dods_uint16_c:
+    case dods_int32_c:
+    case dods_uint32_c:
+    case dods_float32_c:
+    case dods_float64_c:
+        // The NcML char and string types never map to these, but make sure
+        return (getNCMLTypeForVariable(p) != "char" && getNCMLTypeForVariable(p) != "string");
+
+    default:
+        return false;
+    }
+}
+
+void ValuesElement::setNumericVectorValuesFromContent(NCMLParser& p, libdap::BaseType& var)
+{
+    Array* pVecVar = dynamic_cast<Array*>(&var);
+    NCML_ASSERT_MSG(pVecVar, "ValuesElement::setNumericVectorValuesFromContent expect var"
+        " to be castable to class Array but it wasn't!!");
+    VALID_PTR(pVecVar->var());
+
+    switch (pVecVar->var()->type()) {
+    case dods_int16_c:
+        parseAndSetNumericVectorValues<dods_int16>(p, pVecVar);
+        break;
+
+    case dods_uint16_c:
+        parseAndSetNumericVectorValues<dods_uint16>(p, pVecVar);
+        break;
+
+    case dods_int32_c:
+        parseAndSetNumericVectorValues<dods_int32>(p, pVecVar);
+        break;
+
+    case dods_uint32_c:
+        parseAndSetNumericVectorValues<dods_uint32>(p, pVecVar);
+        break;
+
+    case dods_float32_c:
+        parseAndSetNumericVectorValues<dods_float32>(p, pVecVar);
+        break;
+
+    case dods_float64_c:
+        parseAndSetNumericVectorValues<dods_float64>(p, pVecVar);
+        break;
+
+    default:
+        THROW_NCML_INTERNAL_ERROR("ValuesElement::setNumericVectorValuesFromContent called for a non-numeric Array!")
+        ;
+        break;
+    } // switch
+}
+
 template<typename DAPType>
 void ValuesElement::generateAndSetVectorValues(NCMLParser& p, libdap::Array* pArray)
 {
@@ -629,13 +771,24 @@ void ValuesElement::generateAndSetVectorValues(NCMLParser& p, libdap::Array* pAr
 
     int numPoints = pArray->length();
     NCML_ASSERT(numPoints >= 1);
+
+    // For the new variables we make, swap in an array that keeps just the start and
+    // increment and generates only the constrained points when it's read.
+    NCMLBaseArray* pNCMLArray = dynamic_cast<NCMLBaseArray*>(pArray);
+    VariableElement* pVarElt = const_cast<VariableElement*>(getContainingVariableElement(p));
+    if (pNCMLArray && pVarElt && pVarElt->isNewVariable() && pArray == p.getCurrentVariable()) {
+        BESDEBUG("ncml", "ValuesElement: generating the " << numPoints << " values of " << pArray->name()
+            << " from start and increment on read." << endl);
+        NCMLGeneratedArray<DAPType> generated(*pNCMLArray, start, increment);
+        pVarElt->setNewlyCreatedVariable(p.replaceCurrentVariable(generated));
+        return;
+    }
+
+    // The same values NCMLGeneratedArray makes, without a running sum's rounding.
     vector<DAPType> values;
     values.reserve(numPoints);
-    DAPType x = start;
-    values.push_back(x);
-    for (int i = 1; i < numPoints; ++i) {
-        x += increment;
-        values.push_back(x);
+    for (int i = 0; i < numPoints; ++i) {
+        values.push_back(static_cast<DAPType>(start + static_cast<unsigned int>(i) * increment));
     }
     NCML_ASSERT(values.size() == static_cast<unsigned int>(numPoints));
     pArray->set_value(values, values.size());
@@ -124,6 +124,10 @@ private:
      *  Generate the correct number of points using _start and _increment for the given DAPType.
      *  Use these to set the value on pArray
      *
+     *  If pArray is a new variable we made, it is instead replaced in the dataset by an
+     *  NCMLGeneratedArray<DAPType>, which makes only the constrained points at read time,
+     *  so pArray is no longer valid after the call.
+     *
      *  @param p the parser start to use
      *  @param pArray the Array variable to generate values for.
      *
@@ -161,6 +165,36 @@ private:
      */
     template<typename DAPType> void setVectorValues(libdap::Array* pArray, const std::vector<string>& valueTokens);
 
+    /** Parse a single value token for pArray using streams, exactly as setVectorValues() does.
+     * @param index the index of the token in the values element, only for the error message.
+     * @exception BESSyntaxUserError if the token cannot be read as a DAPType.
+     */
+    template<typename DAPType> DAPType parseVectorValueToken(libdap::Array* pArray, const string& token,
+        unsigned int index) const;
+
+    /** @return true if var is an Array of a numeric type whose values can be parsed
+     * straight out of _accumulated_content by setNumericVectorValuesFromContent()
+     * without tokenizing it first.  Byte (and so "char") and string arrays are not.
+     */
+    bool isStreamableNumericArray(NCMLParser& p, libdap::BaseType& var) const;
+
+    /** @brief Set the values of the numeric Array var in a single pass over _accumulated_content.
+     *
+     * This is the equivalent of tokenizing the content and calling setVectorVariableValuesFromTokens(),
+     * without the intermediate vector of token strings or a stringstream per value, which
+     * dominate the cost of large values elements.  The errors thrown are the same.
+     *
+     * Assumes: isStreamableNumericArray(p, var)
+     */
+    void setNumericVectorValuesFromContent(NCMLParser& p, libdap::BaseType& var);
+
+    /** Template helper for setNumericVectorValuesFromContent() for the Array's underlying DAPType.
+     * Tokens in plain decimal notation are parsed in place; any other token (hex, octal,
+     * nan, out of range, etc.) is handed to the original check and stream path so it parses,
+     * or fails, exactly as it did before.
+     */
+    template<typename DAPType> void parseAndSetNumericVectorValues(NCMLParser& p, libdap::Array* pArray);
+
     /** Special case for parsing char's instead of bytes. */
     void parseAndSetCharValue(libdap::BaseType& var, const string& valueAsToken);
 
@@ -143,6 +143,13 @@ void VariableElement::setGotValues()
     _gotValues = true;
 }
 
+void VariableElement::setNewlyCreatedVariable(libdap::BaseType* pNewVar)
+{
+    NCML_ASSERT_MSG(isNewVariable(), "VariableElement::setNewlyCreatedVariable called for a variable we didn't create!");
+    VALID_PTR(pNewVar);
+    _pNewlyCreatedVar = pNewVar;
+}
+
 ////////////////// NON PUBLIC IMPLEMENTATION
 
 void VariableElement::processBegin(NCMLParser& p)
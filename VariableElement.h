@@ -105,6 +105,11 @@ public:
     /** Called once we set the values from ValuesElement so we are aware. */
     void setGotValues();
 
+    /** Called if ValuesElement replaces the new variable we created
+     * (see NCMLParser::replaceCurrentVariable()) so we keep the one in the dataset.
+     */
+    void setNewlyCreatedVariable(libdap::BaseType* pNewVar);
+
 private:
 
     /**
@@ -0,0 +1,204 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+
+// Compares agg_util::FixedFieldDateParser with the ICU SimpleDateFormat
+// parse ScanElement falls back to, first for agreement on random file
+// names and then for speed on 100k names like those of a daily scan.
+//
+// Usage: bench_date_parse [number_of_names]
+
+#include "config.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/time.h>
+
+#include <unicode/smpdtfmt.h>
+#include <unicode/timezone.h>
+
+#include "FixedFieldDateParser.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+namespace {
+
+double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1.0e6;
+}
+
+// The ICU parse and ISO 8601 format ScanElement::extractTimeFromFilename() does.
+class IcuDateParser {
+public:
+    IcuDateParser(const string& pattern) :
+        _pFormat(0), _pISO8601(0)
+    {
+        UErrorCode status = U_ZERO_ERROR;
+        _pFormat = new SimpleDateFormat(UnicodeString(pattern.c_str()), status);
+        _pFormat->setTimeZone(*TimeZone::getGMT());
+        _pISO8601 = new SimpleDateFormat(status);
+        _pISO8601->setTimeZone(*TimeZone::getGMT());
+        _pISO8601->applyPattern("yyyy-MM-dd'T'HH:mm:ss'Z'");
+    }
+
+    ~IcuDateParser()
+    {
+        delete _pFormat;
+        delete _pISO8601;
+    }
+
+    bool parseToISO8601(const string& text, string& iso) const
+    {
+        UErrorCode status = U_ZERO_ERROR;
+        UDate date = _pFormat->parse(UnicodeString(text.c_str()), status);
+        if (U_FAILURE(status)) {
+            return false;
+        }
+        UnicodeString result;
+        _pISO8601->format(date, result);
+        iso.clear();
+        result.toUTF8String(iso);
+        return true;
+    }
+
+private:
+    IcuDateParser(const IcuDateParser&);
+    IcuDateParser& operator=(const IcuDateParser&);
+
+    SimpleDateFormat* _pFormat;
+    SimpleDateFormat* _pISO8601;
+};
+
+// Every text the fixed parser accepts must come out of ICU the same.
+// The patterns it refuses to compile are in the list too, to check
+// that they are refused.
+unsigned int checkAgreement()
+{
+    const char* patterns[] = { "yyyyMMdd", "yyyyMMdd_HHmmss", "yyyy-MM-dd", "yyyy.DDD", "yyyyDDDHHmm", "yyyyMM", "HHmm",
+        "yyyy_MM_dd'T'", "yyMMdd", "MMM" };
+    const unsigned int numPatterns = sizeof(patterns) / sizeof(patterns[0]);
+
+    srand(1);
+    unsigned int numMismatches = 0;
+    for (unsigned int p = 0; p < numPatterns; ++p) {
+        const string pattern = patterns[p];
+        agg_util::FixedFieldDateParser fast;
+        bool compiled = fast.compile(pattern);
+        IcuDateParser icu(pattern);
+
+        unsigned int numParsed = 0;
+        for (int i = 0; compiled && i < 20000; ++i) {
+            // Mostly digits where the fields are, with the odd bad character.
+            string text = pattern;
+            for (size_t k = 0; k < text.size(); ++k) {
+                if (isalpha(pattern[k])) {
+                    text[k] = (rand() % 100 < 97) ? static_cast<char>('0' + rand() % 10) : 'x';
+                }
+                else if (rand() % 100 == 0) {
+                    text[k] = '#';
+                }
+            }
+
+            string fastIso, icuIso;
+            if (!fast.parseToISO8601(text, fastIso)) {
+                continue;
+            }
+            ++numParsed;
+            if (!icu.parseToISO8601(text, icuIso) || fastIso != icuIso) {
+                cerr << "MISMATCH pattern=" << pattern << " text=" << text << " fixed=" << fastIso << " icu=" << icuIso
+                    << endl;
+                ++numMismatches;
+            }
+        }
+        cout << pattern << ": compiled=" << compiled << " parsed " << numParsed << " of 20000" << endl;
+    }
+    return numMismatches;
+}
+
+void timeParsers(unsigned int numNames)
+{
+    const string pattern = "yyyyMMdd_HHmmss";
+    vector<string> names;
+    names.reserve(numNames);
+    char buf[32];
+    for (unsigned int i = 0; i < numNames; ++i) {
+        snprintf(buf, sizeof(buf), "%04u%02u%02u_%02u%02u%02u", 1990 + i % 30, 1 + i % 12, 1 + i % 28, i % 24, i % 60,
+            (i * 7) % 60);
+        names.push_back(buf);
+    }
+
+    IcuDateParser icu(pattern);
+    agg_util::FixedFieldDateParser fast;
+    fast.compile(pattern);
+
+    string iso;
+    size_t checksum = 0;
+    double start = now();
+    for (unsigned int i = 0; i < names.size(); ++i) {
+        icu.parseToISO8601(names[i], iso);
+        checksum += iso.size();
+    }
+    double icuSecs = now() - start;
+
+    start = now();
+    for (unsigned int i = 0; i < names.size(); ++i) {
+        fast.parseToISO8601(names[i], iso);
+        checksum += iso.size();
+    }
+    double fastSecs = now() - start;
+
+    cout << numNames << " names (" << pattern << "): ICU " << icuSecs * 1000 << " ms, fixed field " << fastSecs * 1000
+        << " ms (checksum " << checksum << ")" << endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    unsigned int numNames = (argc > 1) ? atoi(argv[1]) : 100000;
+
+    unsigned int numMismatches = checkAgreement();
+    timeParsers(numNames);
+
+    if (numMismatches > 0) {
+        cerr << numMismatches << " mismatches between the fixed field parser and ICU" << endl;
+        return 1;
+    }
+    return 0;
+}
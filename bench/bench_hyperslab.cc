@@ -0,0 +1,206 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+
+// Compares Shape::copyConstrainedValues(), which NCMLArray uses to pull a
+// hyperslab out of its values, with the point at a time walk over
+// Shape::IndexIterator it replaced: first for agreement on random shapes
+// and constraints and then for speed on a few hyperslabs of a 2D array.
+//
+// Usage: bench_hyperslab [size_of_each_dimension]
+
+#include "config.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <sys/time.h>
+
+#include <Array.h>
+#include <Float32.h>
+#include <Int32.h>
+
+#include "Shape.h"
+
+using ncml_module::Shape;
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::vector;
+
+namespace {
+
+double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1.0e6;
+}
+
+// One dimension's constraint, as it would come in a DAP2 CE.
+struct Constraint {
+    int size;
+    int start;
+    int stride;
+    int stop;
+};
+
+// An Array with the given dims and constraints, just for its Shape.
+void makeArray(libdap::Array& array, const vector<Constraint>& dims)
+{
+    for (unsigned int i = 0; i < dims.size(); ++i) {
+        array.append_dim(dims[i].size);
+    }
+    libdap::Array::Dim_iter it = array.dim_begin();
+    for (unsigned int i = 0; i < dims.size(); ++i, ++it) {
+        array.add_constraint(it, dims[i].start, dims[i].stride, dims[i].stop);
+    }
+}
+
+// The per point copy NCMLArray did before copyConstrainedValues().
+template<typename T>
+void copyPointByPoint(const Shape& shape, const Shape& fullShape, const vector<T>& allValues, vector<T>& values)
+{
+    values.clear();
+    values.reserve(shape.getConstrainedSpaceSize());
+    Shape::IndexIterator endIt = shape.endSpaceEnumeration();
+    for (Shape::IndexIterator it = shape.beginSpaceEnumeration(); it != endIt; ++it) {
+        values.push_back(allValues[fullShape.getRowMajorIndex(*it, false)]);
+    }
+}
+
+// Random ranks, sizes and constraints, a third of the dims unconstrained.
+unsigned int checkAgreement()
+{
+    srand(7);
+    unsigned int numMismatches = 0;
+    for (int t = 0; t < 3000; ++t) {
+        vector<Constraint> dims;
+        vector<Constraint> fullDims;
+        int rank = 1 + rand() % 4;
+        for (int r = 0; r < rank; ++r) {
+            Constraint c;
+            c.size = 1 + rand() % 7;
+            c.start = rand() % c.size;
+            c.stride = 1 + rand() % 3;
+            c.stop = c.start + rand() % (c.size - c.start);
+            if (rand() % 3 == 0) {
+                c.start = 0;
+                c.stride = 1;
+                c.stop = c.size - 1;
+            }
+            dims.push_back(c);
+            Constraint full = { c.size, 0, 1, c.size - 1 };
+            fullDims.push_back(full);
+        }
+
+        libdap::Int32 proto("v");
+        libdap::Array array("v", &proto);
+        libdap::Array fullArray("v", &proto);
+        makeArray(array, dims);
+        makeArray(fullArray, fullDims);
+        Shape shape(array);
+        Shape fullShape(fullArray);
+
+        vector<int> allValues(fullShape.getUnconstrainedSpaceSize());
+        for (unsigned int i = 0; i < allValues.size(); ++i) {
+            allValues[i] = i;
+        }
+
+        vector<int> expected;
+        copyPointByPoint(shape, fullShape, allValues, expected);
+        vector<int> values(shape.getConstrainedSpaceSize() + 1);
+        values.resize(shape.copyConstrainedValues(&allValues[0], &values[0]));
+        if (values != expected) {
+            ++numMismatches;
+        }
+    }
+    cout << "3000 random shapes: " << numMismatches << " mismatches" << endl;
+    return numMismatches;
+}
+
+unsigned int timeCopies(int n)
+{
+    const char* names[] = { "whole", "[0:1:n/2-1][n/4:1:3n/4-1]", "[*][0:2:n-1]", "[0:2:n-1][*]" };
+    Constraint cases[4][2] = {
+        { { n, 0, 1, n - 1 }, { n, 0, 1, n - 1 } },
+        { { n, 0, 1, n / 2 - 1 }, { n, n / 4, 1, 3 * n / 4 - 1 } },
+        { { n, 0, 1, n - 1 }, { n, 0, 2, n - 1 } },
+        { { n, 0, 2, n - 1 }, { n, 0, 1, n - 1 } } };
+
+    libdap::Float32 proto("v");
+    libdap::Array fullArray("v", &proto);
+    makeArray(fullArray, vector<Constraint>(cases[0], cases[0] + 2));
+    Shape fullShape(fullArray);
+    vector<float> allValues(fullShape.getUnconstrainedSpaceSize());
+    for (unsigned int i = 0; i < allValues.size(); ++i) {
+        allValues[i] = i * 0.5f;
+    }
+
+    unsigned int numMismatches = 0;
+    for (int k = 0; k < 4; ++k) {
+        libdap::Array array("v", &proto);
+        makeArray(array, vector<Constraint>(cases[k], cases[k] + 2));
+        Shape shape(array);
+
+        vector<float> expected;
+        double start = now();
+        copyPointByPoint(shape, fullShape, allValues, expected);
+        double pointSecs = now() - start;
+
+        vector<float> values(shape.getConstrainedSpaceSize());
+        start = now();
+        shape.copyConstrainedValues(&allValues[0], &values[0]);
+        double runSecs = now() - start;
+
+        if (values != expected) {
+            ++numMismatches;
+        }
+        cout << n << "x" << n << " Float32 " << names[k] << ": point by point " << pointSecs * 1000
+            << " ms, by runs " << runSecs * 1000 << " ms" << ((values == expected) ? "" : " DIFFER") << endl;
+    }
+    return numMismatches;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    int n = (argc > 1) ? atoi(argv[1]) : 2000;
+    if (n < 4) {
+        cerr << "The dimension size has to be at least 4" << endl;
+        return 1;
+    }
+
+    unsigned int numMismatches = checkAgreement() + timeCopies(n);
+    if (numMismatches > 0) {
+        cerr << numMismatches << " mismatches between the run and point by point copies" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,346 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+
+// Times the real SaxParserWrapper on NcML files, plain or compressed, and
+// checks that compressed copies of a file give the same SAX events as the
+// plain one.  For each file it prints the best parse time, the time just
+// to decompress it (what the BES uncompress cache used to spend before the
+// parse) and the process peak RSS so far, so run one file per invocation
+// to compare memory.
+//
+// With no files it writes a joinNew catalog of number_of_datasets netcdf
+// elements, each with an attribute, to TMPDIR (or /tmp) as .ncml, .ncml.gz
+// and .ncml.bz2 and times those.  Add a .ncml.Z made with compress(1) on
+// the command line to time that too.
+//
+// Usage: bench_sax_parse [repetitions [number_of_datasets | file...]]
+
+#include "config.h"
+
+#include <bzlib.h>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <zlib.h>
+
+#include "BESError.h"
+#include "DecompressingReader.h"
+#include "SaxParser.h"
+#include "SaxParserWrapper.h"
+#include "XMLHelpers.h"
+
+using ncml_module::DecompressingReader;
+using ncml_module::SaxParser;
+using ncml_module::SaxParserWrapper;
+using ncml_module::XMLAttributeMap;
+using ncml_module::XMLNamespaceMap;
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::map;
+using std::string;
+using std::vector;
+
+namespace {
+
+double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1.0e6;
+}
+
+long maxRSSKB()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Counts the SAX events and hashes them (FNV-1a) so two parses can be
+// compared.  The characters are hashed as one stream since the push parser
+// may split them across calls differently than xmlParseDocument does.
+class EventDigest: public SaxParser {
+public:
+    EventDigest() :
+        _numElements(0), _numAttributes(0), _numChars(0), _hash(2166136261u), _line(0)
+    {
+    }
+
+    unsigned long numElements() const
+    {
+        return _numElements;
+    }
+    unsigned long numAttributes() const
+    {
+        return _numAttributes;
+    }
+    unsigned long numChars() const
+    {
+        return _numChars;
+    }
+    unsigned int hash() const
+    {
+        return _hash;
+    }
+
+    virtual void onStartDocument()
+    {
+    }
+    virtual void onEndDocument()
+    {
+    }
+    virtual void onStartElement(const string& name, const XMLAttributeMap& attrs)
+    {
+        onStartElementWithNamespace(name, "", "", attrs, XMLNamespaceMap());
+    }
+    virtual void onEndElement(const string& name)
+    {
+        onEndElementWithNamespace(name, "", "");
+    }
+    virtual void onStartElementWithNamespace(const string& localname, const string& /* prefix */,
+        const string& /* uri */, const XMLAttributeMap& attributes, const XMLNamespaceMap& /* namespaces */)
+    {
+        ++_numElements;
+        add('<');
+        add(localname);
+        for (XMLAttributeMap::const_iterator it = attributes.begin(); it != attributes.end(); ++it) {
+            ++_numAttributes;
+            add(' ');
+            add(it->localname);
+            add('=');
+            add(it->value);
+        }
+        add('>');
+    }
+    virtual void onEndElementWithNamespace(const string& localname, const string& /* prefix */,
+        const string& /* uri */)
+    {
+        add('/');
+        add(localname);
+    }
+    virtual void onCharacters(const string& content)
+    {
+        _numChars += content.size();
+        add(content);
+    }
+    virtual void onParseWarning(string msg)
+    {
+        cerr << "Warning at line " << _line << ": " << msg << endl;
+    }
+    virtual void onParseError(string msg)
+    {
+        cerr << "Error at line " << _line << ": " << msg << endl;
+    }
+    virtual void setParseLineNumber(int line)
+    {
+        _line = line;
+    }
+
+private:
+    void add(char c)
+    {
+        _hash = (_hash ^ static_cast<unsigned char>(c)) * 16777619u;
+    }
+    void add(const string& s)
+    {
+        for (string::const_iterator it = s.begin(); it != s.end(); ++it) {
+            add(*it);
+        }
+    }
+
+    unsigned long _numElements;
+    unsigned long _numAttributes;
+    unsigned long _numChars;
+    unsigned int _hash;
+    int _line;
+};
+
+// Write the same catalog to the plain, gzip and bzip2 files.
+bool writeCatalog(const string& plainName, unsigned int numDatasets)
+{
+    FILE* plain = fopen(plainName.c_str(), "w");
+    gzFile gz = gzopen((plainName + ".gz").c_str(), "wb");
+    FILE* bz2File = fopen((plainName + ".bz2").c_str(), "wb");
+    int bzError = BZ_OK;
+    BZFILE* bz2 = (bz2File) ? BZ2_bzWriteOpen(&bzError, bz2File, 9, 0, 0) : 0;
+    if (!plain || !gz || !bz2) {
+        cerr << "Can't write the catalog files " << plainName << "[.gz|.bz2]" << endl;
+        return false;
+    }
+
+    srand(3);
+    string chunk;
+    for (unsigned int i = 0; i <= numDatasets + 1; ++i) {
+        char buf[512];
+        if (i == 0) {
+            snprintf(buf, sizeof(buf), "%s",
+                "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                    "<netcdf xmlns=\"http://www.unidata.ucar.edu/namespaces/netcdf/ncml-2.2\">\n"
+                    " <aggregation type=\"joinNew\" dimName=\"time\">\n  <variableAgg name=\"sst\"/>\n");
+        }
+        else if (i <= numDatasets) {
+            unsigned int n = i - 1;
+            snprintf(buf, sizeof(buf),
+                "  <netcdf location=\"data/granules/%04u/%03u/sst_%07u.nc\" coordValue=\"%u\">"
+                    "<attribute name=\"source\" type=\"string\" value=\"sensor-%d run %d\"/></netcdf>\n",
+                n / 1000, n % 1000, n, n * 3600, rand() % 10, rand() % 100000);
+        }
+        else {
+            snprintf(buf, sizeof(buf), "%s", " </aggregation>\n</netcdf>\n");
+        }
+        chunk += buf;
+
+        if (chunk.size() > 65536 || i == numDatasets + 1) {
+            fwrite(chunk.data(), 1, chunk.size(), plain);
+            gzwrite(gz, chunk.data(), chunk.size());
+            BZ2_bzWrite(&bzError, bz2, const_cast<char*>(chunk.data()), chunk.size());
+            chunk.clear();
+        }
+    }
+
+    BZ2_bzWriteClose(&bzError, bz2, 0, 0, 0);
+    bool ok = (fclose(bz2File) == 0) && (bzError == BZ_OK);
+    ok = (gzclose(gz) == Z_OK) && ok;
+    ok = (fclose(plain) == 0) && ok;
+    return ok;
+}
+
+// The name of the plain file for a compressed one.
+string plainFilename(const string& filename)
+{
+    if (!DecompressingReader::isCompressedFilename(filename)) {
+        return filename;
+    }
+    return filename.substr(0, filename.rfind('.'));
+}
+
+double timeDecompress(const string& filename, int repetitions)
+{
+    double best = 0;
+    vector<char> buf(65536);
+    for (int rep = 0; rep < repetitions; ++rep) {
+        double start = now();
+        std::auto_ptr<DecompressingReader> reader = DecompressingReader::open(filename);
+        while (reader->read(&buf[0], buf.size()) > 0) {
+        }
+        double secs = now() - start;
+        if (rep == 0 || secs < best) {
+            best = secs;
+        }
+    }
+    return best;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    int repetitions = (argc > 1) ? atoi(argv[1]) : 5;
+    if (repetitions < 1) {
+        repetitions = 1;
+    }
+
+    vector<string> filenames;
+    if (argc > 2 && atoi(argv[2]) == 0) {
+        filenames.assign(argv + 2, argv + argc);
+    }
+    else {
+        unsigned int numDatasets = (argc > 2) ? atoi(argv[2]) : 400000;
+        const char* tmpDir = getenv("TMPDIR");
+        string plainName = string((tmpDir) ? tmpDir : "/tmp") + "/bench_sax_parse.ncml";
+        if (!writeCatalog(plainName, numDatasets)) {
+            return 1;
+        }
+        filenames.push_back(plainName);
+        filenames.push_back(plainName + ".gz");
+        filenames.push_back(plainName + ".bz2");
+    }
+
+    // The event digest of each plain file, to check its compressed copies against.
+    map<string, unsigned int> plainHashes;
+    unsigned int numMismatches = 0;
+    for (unsigned int i = 0; i < filenames.size(); ++i) {
+        const string& filename = filenames[i];
+        bool isCompressed = DecompressingReader::isCompressedFilename(filename);
+        double best = 0;
+        EventDigest events;
+        try {
+            bool parsed = true;
+            for (int rep = 0; parsed && rep < repetitions; ++rep) {
+                events = EventDigest();
+                SaxParserWrapper parser(events);
+                double start = now();
+                parsed = parser.parse(filename);
+                double secs = now() - start;
+                if (rep == 0 || secs < best) {
+                    best = secs;
+                }
+            }
+            if (!parsed) {
+                cerr << filename << ": parse failed" << endl;
+                ++numMismatches;
+                continue;
+            }
+            cout << filename << ": parse " << best << " s";
+            if (isCompressed) {
+                cout << ", decompress only " << timeDecompress(filename, repetitions) << " s";
+            }
+            cout << ", " << events.numElements() << " elements, " << events.numAttributes() << " attributes, "
+                << events.numChars() << " chars, peak RSS " << maxRSSKB() << " KB" << endl;
+        }
+        catch (BESError& e) {
+            cerr << filename << ": " << e.get_message() << endl;
+            ++numMismatches;
+            continue;
+        }
+
+        string plainName = plainFilename(filename);
+        map<string, unsigned int>::const_iterator found = plainHashes.find(plainName);
+        if (!isCompressed) {
+            plainHashes[plainName] = events.hash();
+        }
+        else if (found != plainHashes.end() && found->second != events.hash()) {
+            cerr << filename << ": SAX events differ from " << plainName << endl;
+            ++numMismatches;
+        }
+    }
+
+    if (numMismatches > 0) {
+        cerr << numMismatches << " files failed to parse or differed from their plain copy" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,277 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of the "NcML Module" project, a BES module designed
+// to allow NcML files to be used to be used as a wrapper to add
+// AIS to existing datasets of any format.
+//
+// Copyright (c) 2010 OPeNDAP, Inc.
+// Author: Michael Johnson  <m.johnson@opendap.org>
+//
+// For more information, please also see the main website: http://opendap.org/
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// Please see the files COPYING and COPYRIGHT for more information on the GLPL.
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+/////////////////////////////////////////////////////////////////////////////
+
+// Compares the single pass parse ValuesElement does for numeric Array
+// values with the tokenize, check_*() and stringstream path it replaced:
+// first for agreement, values and accept/reject, on random contents that
+// mix edge cases with ordinary numbers, then for speed on 1M values of
+// each type.
+//
+// Usage: bench_values_parse [number_of_values]
+
+#include "config.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/time.h>
+
+#include <dods-datatypes.h>
+#include <parser.h> // libdap for the check_*() functions
+
+#include "DecimalTokenParser.h"
+#include "NCMLUtil.h"
+
+using ncml_module::DecimalTokenParser;
+using ncml_module::NCMLUtil;
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+using std::stringstream;
+using std::vector;
+
+namespace {
+
+double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1.0e6;
+}
+
+// The check NCMLParser::checkDataIsValidForCanonicalTypeOrThrow() does per type.
+bool checkToken(libdap::dods_int16*, const string& token)
+{
+    return libdap::check_int16(token.c_str());
+}
+bool checkToken(libdap::dods_uint16*, const string& token)
+{
+    return libdap::check_uint16(token.c_str());
+}
+bool checkToken(libdap::dods_int32*, const string& token)
+{
+    return libdap::check_int32(token.c_str());
+}
+bool checkToken(libdap::dods_uint32*, const string& token)
+{
+    return libdap::check_uint32(token.c_str());
+}
+bool checkToken(libdap::dods_float32*, const string& token)
+{
+    return libdap::check_float32(token.c_str());
+}
+bool checkToken(libdap::dods_float64*, const string& token)
+{
+    return libdap::check_float64(token.c_str());
+}
+
+// Check every token, then read each with a stream, as ValuesElement did.
+template<typename T>
+bool parseTokens(const vector<string>& tokens, vector<T>& values)
+{
+    for (unsigned int i = 0; i < tokens.size(); ++i) {
+        if (!checkToken(static_cast<T*>(0), tokens[i])) {
+            return false;
+        }
+    }
+    values.resize(tokens.size());
+    for (unsigned int i = 0; i < tokens.size(); ++i) {
+        stringstream ss;
+        ss.str(tokens[i]);
+        ss >> values[i];
+        if (ss.fail()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename T>
+bool tokenizeAndParse(const string& content, vector<T>& values)
+{
+    vector<string> tokens;
+    NCMLUtil::tokenize(content, tokens, NCMLUtil::WHITESPACE);
+    return parseTokens(tokens, values);
+}
+
+// ValuesElement::parseAndSetNumericVectorValues() without the Array.
+template<typename T>
+bool singlePassParse(const string& content, vector<T>& values)
+{
+    bool isSeparator[256] = { false };
+    for (string::const_iterator it = NCMLUtil::WHITESPACE.begin(); it != NCMLUtil::WHITESPACE.end(); ++it) {
+        isSeparator[static_cast<unsigned char>(*it)] = true;
+    }
+
+    values.clear();
+    vector<unsigned int> slowIndices;
+    vector<string> slowTokens;
+    const char* c = content.c_str();
+    const char* end = c + content.size();
+    while (true) {
+        while (c != end && isSeparator[static_cast<unsigned char>(*c)])
+            ++c;
+        if (c == end) {
+            break;
+        }
+        const char* tokenEnd = c;
+        while (tokenEnd != end && !isSeparator[static_cast<unsigned char>(*tokenEnd)])
+            ++tokenEnd;
+
+        T value = 0;
+        if (!DecimalTokenParser<T>::parse(c, tokenEnd, value)) {
+            slowIndices.push_back(values.size());
+            slowTokens.push_back(string(c, tokenEnd));
+        }
+        values.push_back(value);
+        c = tokenEnd;
+    }
+
+    vector<T> slowValues;
+    if (!parseTokens(slowTokens, slowValues)) {
+        return false;
+    }
+    for (unsigned int i = 0; i < slowIndices.size(); ++i) {
+        values[slowIndices[i]] = slowValues[i];
+    }
+    return true;
+}
+
+const char* edgeCases[] = { "0", "-0", "+0", "007", "08", "0x1F", "1e5", "1.", "-.5", ".e1", "nan", "inf", "-inf",
+    "1e-40", "1e39", "1e-310", "1e309", "3.4028235e38", "3.40282357e38", "2147483647", "2147483648", "-2147483648",
+    "-2147483649", "4294967295", "4294967296", "65535", "65536", "-1", "32767", "-32768", "32768", "1,5", "+5", "--1",
+    "1e", "e1", "12a", "0.000000000000000000000000000000000000011754944", "1.17549435e-38" };
+
+template<typename T>
+unsigned int checkAgreement(const char* typeName)
+{
+    srand(7);
+    unsigned int numMismatches = 0;
+    for (int trial = 0; trial < 20000; ++trial) {
+        string content;
+        int numTokens = 1 + rand() % 5;
+        for (int i = 0; i < numTokens; ++i) {
+            char buf[64];
+            switch (rand() % 4) {
+            case 0:
+                content += edgeCases[rand() % (sizeof(edgeCases) / sizeof(edgeCases[0]))];
+                break;
+            case 1:
+                snprintf(buf, sizeof(buf), "%d", (rand() - RAND_MAX / 2) >> (rand() % 31));
+                content += buf;
+                break;
+            case 2:
+                snprintf(buf, sizeof(buf), "%.*g", 1 + rand() % 17,
+                    (rand() / static_cast<double>(RAND_MAX) - 0.5) * pow(10.0, rand() % 80 - 40));
+                content += buf;
+                break;
+            default:
+                snprintf(buf, sizeof(buf), "%.9g",
+                    static_cast<float>((rand() / static_cast<double>(RAND_MAX)) * pow(10.0, rand() % 76 - 38)));
+                content += buf;
+                break;
+            }
+            content += (rand() % 2) ? " " : "\n\t";
+        }
+
+        vector<T> expected, values;
+        bool expectedOk = tokenizeAndParse(content, expected);
+        bool ok = singlePassParse(content, values);
+        bool same = (expectedOk == ok)
+            && (!ok || (values.size() == expected.size()
+                && (values.empty() || memcmp(&values[0], &expected[0], values.size() * sizeof(T)) == 0)));
+        if (!same) {
+            if (numMismatches < 5) {
+                cerr << typeName << " MISMATCH content=\"" << content << "\" streams=" << expectedOk
+                    << " single pass=" << ok << endl;
+            }
+            ++numMismatches;
+        }
+    }
+    cout << typeName << ": " << numMismatches << " mismatches in 20000 random contents" << endl;
+    return numMismatches;
+}
+
+template<typename T>
+void timeParsers(const char* typeName, const char* format, bool isFloat, unsigned int numValues)
+{
+    string content;
+    content.reserve(numValues * 12);
+    char buf[64];
+    srand(1);
+    for (unsigned int i = 0; i < numValues; ++i) {
+        if (isFloat) {
+            snprintf(buf, sizeof(buf), format, (rand() / static_cast<double>(RAND_MAX) - 0.5) * 2000.0);
+        }
+        else {
+            snprintf(buf, sizeof(buf), format, rand() - RAND_MAX / 2);
+        }
+        content += buf;
+        content += ' ';
+    }
+
+    vector<T> expected, values;
+    double start = now();
+    tokenizeAndParse(content, expected);
+    double streamSecs = now() - start;
+    start = now();
+    singlePassParse(content, values);
+    double singlePassSecs = now() - start;
+
+    cout << numValues << " " << typeName << " values: streams " << streamSecs * 1000 << " ms, single pass "
+        << singlePassSecs * 1000 << " ms" << ((values == expected) ? "" : " DIFFER") << endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    unsigned int numValues = (argc > 1) ? atoi(argv[1]) : 1000000;
+
+    unsigned int numMismatches = checkAgreement<libdap::dods_int16>("int16")
+        + checkAgreement<libdap::dods_uint16>("uint16") + checkAgreement<libdap::dods_int32>("int32")
+        + checkAgreement<libdap::dods_uint32>("uint32") + checkAgreement<libdap::dods_float32>("float32")
+        + checkAgreement<libdap::dods_float64>("float64");
+
+    timeParsers<libdap::dods_int32>("int32", "%d", false, numValues);
+    timeParsers<libdap::dods_float32>("float32", "%.7g", true, numValues);
+    timeParsers<libdap::dods_float64>("float64", "%.15g", true, numValues);
+
+    if (numMismatches > 0) {
+        cerr << numMismatches << " mismatches between the single pass and stream parses" << endl;
+        return 1;
+    }
+    return 0;
+}